@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-100 万次算术求值：内建的 $(( ))/(( )) 对比每次 fork 一个 expr
+# 用法: bench/arith.sh [myshell 路径] [expr 次数]
+# 内建算术的表达式只在第一次编译，之后每次查缓存、执行字节码；expr 每次都要 fork+exec，
+# 跑 100 万次太慢，只跑几千次再按比例换算。
+
+SHELL_BIN=${1:-./myshell}
+EXPR_COUNT=${2:-2000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# 循环 50 万轮，每轮求值两次（条件和赋值），合计 10^6 次
+cat > "$TMP/builtin.sh" <<'SCRIPT'
+i=0
+while ((i < 500000)); do i=$((i + 1)); done
+SCRIPT
+
+cat > "$TMP/compound.sh" <<'SCRIPT'
+for ((i = 0; i < 500000; i++)); do :; done
+SCRIPT
+
+words=$(seq 1 "$EXPR_COUNT" | tr '\n' ' ')
+echo "for i in $words; do expr \$i + 1 > /dev/null; done" > "$TMP/expr.sh"
+
+# run 名字 求值次数 换算到的次数 命令...
+run() {
+    local name=$1 evals=$2 scale=$3 start end
+    shift 3
+    start=$(date +%s.%N)
+    "$@"
+    end=$(date +%s.%N)
+    awk -v n="$name" -v s="$start" -v e="$end" -v k="$evals" -v m="$scale" \
+        'BEGIN { t = e - s; printf "%-22s %8.3f s for 1M evals  %7.3f us/eval  %12.0f evals/s\n",
+                 n, t * m / k, t * 1e6 / k, k / t }'
+}
+
+run 'myshell $(( ))' 1000000 1000000 "$SHELL_BIN" "$TMP/builtin.sh"
+run 'myshell for (( ))' 1000000 1000000 "$SHELL_BIN" "$TMP/compound.sh"
+run 'myshell expr (fork)' "$EXPR_COUNT" 1000000 "$SHELL_BIN" "$TMP/expr.sh"
+run 'myshell expr (zygote)' "$EXPR_COUNT" 1000000 "$SHELL_BIN" --zygote "$TMP/expr.sh"
+command -v bash >/dev/null && run 'bash $(( ))' 1000000 1000000 bash "$TMP/builtin.sh"
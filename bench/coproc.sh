@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-每条数据启动一次 python3/awk，和把数据交给常驻的协同进程（coproc）处理的每条耗时
+# 用法: bench/coproc.sh [myshell 路径] [条数]
+# 每条数据都是把一行数字加起来。逐条启动时解释器的启动时间占了绝大部分；常驻进程只在开头启动一次，
+# 之后每条只是一次管道往返。"同步" 每发一条就等回复，"流水线" 先把一批全部发出去再逐条读回复，
+# 几个工作进程可以同时处理（单 CPU 的机器上 -n 4 不会比 -n 1 快多少）。启动常驻进程的时间也算在总耗时里，
+# 条数少时 -n 4 要多付三次解释器启动。
+
+SHELL_BIN=${1:-./myshell}
+ITEMS=${2:-300}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+PY_ONCE='import sys; print(sum(map(int, sys.argv[1:])))'
+PY_WORKER='import sys
+for line in sys.stdin: print(sum(map(int, line.split())), flush=True)'
+AWK_PROG='{ s = 0; for (i = 1; i <= NF; i++) s += $i; print s; fflush() }'
+# mawk 默认攒满一整块输入才处理，必须用 -W interactive 逐行读
+AWK_FLAGS=
+awk -W version 2>/dev/null | grep -q mawk && AWK_FLAGS="-W interactive"
+
+run() {
+    local name=$1 file=$2 start end
+    start=$(date +%s.%N)
+    "$SHELL_BIN" --norc "$file" > "$TMP/out" 2>&1
+    end=$(date +%s.%N)
+    awk -v n="$name" -v s="$start" -v e="$end" -v k="$ITEMS" \
+        'BEGIN { printf "%-30s %9.1f us/item\n", n, (e - s) * 1e6 / k }'
+    if grep -q "^bad" "$TMP/out"; then
+        echo "  wrong replies: $(cat "$TMP/out")"
+    fi
+}
+
+# 逐条启动：结果直接输出，Shell 没有命令替换，拿不到结果，这已经是最省事的写法
+spawn_script() {
+    cat > "$TMP/$1.sh" <<EOF
+i=0
+while [ \$i -lt $ITEMS ]; do
+    $2 \$i 1 2 > /dev/null
+    i=\$((i+1))
+done
+EOF
+}
+spawn_script spawn_py "python3 -c '$PY_ONCE'"
+spawn_script spawn_awk "awk 'BEGIN { print ARGV[1] + ARGV[2] + ARGV[3] }'"
+
+# 常驻进程：同步
+sync_script() {
+    cat > "$TMP/$1.sh" <<EOF
+coproc -n $2 W $3
+i=0
+while [ \$i -lt $ITEMS ]; do
+    cosend W \$i 1 2
+    coread W s
+    [ "\$s" = \$((i+3)) ] || echo "bad \$i: \$s"
+    i=\$((i+1))
+done
+coproc -k W
+EOF
+}
+
+# 常驻进程：流水线，每批 50 条
+pipelined_script() {
+    cat > "$TMP/$1.sh" <<EOF
+coproc -n $2 W $3
+i=0
+while [ \$i -lt $ITEMS ]; do
+    j=\$i
+    while [ \$j -lt \$((i+50)) ] && [ \$j -lt $ITEMS ]; do cosend W \$j 1 2; j=\$((j+1)); done
+    while [ \$i -lt \$j ]; do
+        coread W s
+        [ "\$s" = \$((i+3)) ] || echo "bad \$i: \$s"
+        i=\$((i+1))
+    done
+done
+coproc -k W
+EOF
+}
+sync_script pool1_py 1 "python3 -u -c '$PY_WORKER'"
+pipelined_script pool4_py 4 "python3 -u -c '$PY_WORKER'"
+sync_script pool1_awk 1 "awk $AWK_FLAGS '$AWK_PROG'"
+pipelined_script pool4_awk 4 "awk $AWK_FLAGS '$AWK_PROG'"
+
+echo "$ITEMS items"
+run "python3 -c per item" "$TMP/spawn_py.sh"
+run "python3 coproc -n 1, sync" "$TMP/pool1_py.sh"
+run "python3 coproc -n 4, pipelined" "$TMP/pool4_py.sh"
+run "awk per item" "$TMP/spawn_awk.sh"
+run "awk coproc -n 1, sync" "$TMP/pool1_awk.sh"
+run "awk coproc -n 4, pipelined" "$TMP/pool4_awk.sh"
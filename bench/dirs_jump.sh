@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-cd 访问记录数据库：启动时读入索引的耗时，以及 cd -j 片段 和 cd 绝对路径的每次耗时
+# 用法: bench/dirs_jump.sh [myshell 路径] [目录数]
+# 两种 cd 成功后都要加锁、读入最新的数据库、写临时文件再 rename，cd -j 另外要给所有目录打分排序。
+
+SHELL_BIN=${1:-./myshell}
+DIRS=${2:-3000}
+ROUNDS=2000
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+export HOME="$TMP" # 数据库 ~/.myshell_dirs 放在临时目录
+
+# 模拟很深的部署目录树: 区域/环境/服务/版本
+awk -v n="$DIRS" -v tmp="$TMP" 'BEGIN {
+    for (i = 0; i < n; i++)
+        printf "%s/deploy/region%d/env%d/service%d/release%d\n", tmp, i % 7, i % 3, i % 50, i
+}' > "$TMP/dirs"
+xargs mkdir -p < "$TMP/dirs"
+
+# 交互模式才记录 cd：标准输入不是脚本文件，而是逐行读入的命令
+sed 's/^/cd /' "$TMP/dirs" | "$SHELL_BIN" --norc > /dev/null 2>&1
+
+run() {
+    local name=$1 file=$2 start end
+    start=$(date +%s.%N)
+    "$SHELL_BIN" --norc < "$file" > /dev/null 2>&1
+    end=$(date +%s.%N)
+    awk -v n="$name" -v s="$start" -v e="$end" -v k="$ROUNDS" \
+        'BEGIN { printf "%-22s %8.1f us/cd\n", n, (e - s) * 1e6 / k }'
+}
+
+# 随机挑选目录：cd -j 用它的最后两段作为片段，另一组用完整路径
+awk -v k="$ROUNDS" -v n="$DIRS" 'BEGIN { srand(1); for (i = 0; i < k; i++) print int(rand() * n) + 1 }' > "$TMP/picks"
+awk 'NR == FNR { dir[FNR] = $0; next } { print dir[$1] }' "$TMP/dirs" "$TMP/picks" > "$TMP/targets"
+awk -F/ '{ print "cd -j " $(NF - 1) " " $NF }' "$TMP/targets" > "$TMP/jump"
+sed 's/^/cd /' "$TMP/targets" > "$TMP/plain"
+
+"$SHELL_BIN" --norc --startup-stats < /dev/null 2>&1 | grep "directories indexed"
+run "cd -j fragments" "$TMP/jump"
+run "cd absolute path" "$TMP/plain"
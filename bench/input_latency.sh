@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-在伪终端里逐个发送按键，测量从按键到回显的延迟，
+#                比较空闲时和大量后台任务不断结束（事件循环不停打印通知）时的分布
+# 用法: bench/input_latency.sh [myshell 路径] [按键次数]
+
+SHELL_BIN=${1:-./myshell}
+KEYS=${2:-400}
+
+command -v python3 >/dev/null || { echo "input_latency: python3 not found, skipped"; exit 0; }
+
+python3 - "$SHELL_BIN" "$KEYS" <<'PY'
+import os, pty, select, sys, time
+
+shell, keys = sys.argv[1], int(sys.argv[2])
+pid, fd = pty.fork()
+if pid == 0:
+    os.execv(shell, [shell, "--norc"])
+
+def drain(seconds):
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        if select.select([fd], [], [], 0.01)[0]:
+            try:
+                os.read(fd, 65536)
+            except OSError:  # Shell 已退出
+                return
+
+def measure(name):
+    # 'z' 不会出现在提示符和任务通知里，看到它就说明按键已被处理并回显
+    samples = []
+    for _ in range(keys):
+        start = time.monotonic()
+        os.write(fd, b"z")
+        seen = b""
+        while b"z" not in seen:
+            if select.select([fd], [], [], 1.0)[0]:
+                seen += os.read(fd, 65536)
+            else:
+                break
+        samples.append((time.monotonic() - start) * 1e6)
+        os.write(fd, b"\x7f")  # 删掉它，保持输入行为空
+        drain(0.005)
+    samples.sort()
+    pick = lambda q: samples[min(len(samples) - 1, int(len(samples) * q))]
+    print("%-6s keys=%d  p50 %7.1f us  p90 %7.1f us  p99 %7.1f us  max %8.1f us"
+          % (name, len(samples), pick(0.5), pick(0.9), pick(0.99), samples[-1]))
+
+drain(0.5)
+measure("idle")
+
+# 启动 300 个后台任务，在接下来约 3 秒内陆续结束，每个都会触发 pidfd 事件和一条通知
+delays = " ".join("%.2f" % (i * 0.01) for i in range(1, 301))
+os.write(fd, ("for d in %s; do sleep $d & done\r" % delays).encode())
+drain(0.3)
+measure("churn")
+
+os.write(fd, b"exit\r")
+drain(0.2)
+os.waitpid(pid, 0)
+PY
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-把同一份输出写到多个文件：比较多个 > 目标（tee/splice 分发）和管道接外部 tee 的吞吐量
+# 用法: bench/multios.sh [myshell 路径] [数据大小MB]
+
+SHELL_BIN=$(realpath "${1:-./myshell}")
+SIZE_MB=${2:-512}
+
+# 放在 tmpfs 上，测的是数据搬运而不是磁盘
+base=/dev/shm
+[ -d "$base" ] && [ -w "$base" ] || base=${TMPDIR:-/tmp}
+dir=$(mktemp -d "$base/multios.XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom > "$dir/data"
+
+# run <说明> <命令>：运行 3 次取最快的一次，报告 GB/s（按输入数据量计算）
+run() {
+    local best=
+    for _ in 1 2 3; do
+        rm -f "$dir"/out*
+        local start end
+        start=$(date +%s.%N)
+        "$SHELL_BIN" -c "$2" > /dev/null
+        end=$(date +%s.%N)
+        best=$(awk -v s="$start" -v e="$end" -v b="$best" 'BEGIN { t = e - s; print (b == "" || t < b) ? t : b }')
+    done
+    for f in "$dir"/out*; do
+        cmp -s "$dir/data" "$f" || echo "multios: $f differs from input" >&2
+    done
+    awk -v n="$1" -v t="$best" -v mb="$SIZE_MB" 'BEGIN { printf "%-30s %7.3f s  %6.2f GB/s\n", n, t, mb / 1024 / t }'
+}
+
+cd "$dir" || exit 1
+run "cat > 1 file"                "cat data > out1"
+run "cat > 2 files (fanout)"      "cat data > out1 > out2"
+run "cat | tee 1 > 1 (external)"  "cat data | tee out1 > out2"
+run "cat > 3 files (fanout)"      "cat data > out1 > out2 > out3"
+run "cat | tee 2 > 1 (external)"  "cat data | tee out1 out2 > out3"
+run "cat > 1 >> 1 (fanout)"       "cat data > out1 >> out2"
+run "cat | tee -a 1 > 1 (external)"  "cat data | tee -a out1 > out2"
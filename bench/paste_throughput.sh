@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-在伪终端里粘贴一大段多行命令，比较逐行输入（每行重绘提示符、写一次历史）
+#                和 bracketed paste 批量执行的吞吐量（行/秒）
+# 用法: bench/paste_throughput.sh [myshell 路径] [行数]
+
+SHELL_BIN=${1:-./myshell}
+LINES=${2:-5000}
+
+command -v python3 >/dev/null || { echo "paste_throughput: python3 not found, skipped"; exit 0; }
+
+python3 - "$SHELL_BIN" "$LINES" <<'PY'
+import os, pty, select, sys, time
+
+shell, lines = sys.argv[1], int(sys.argv[2])
+
+def run(name, bracketed):
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.execv(shell, [shell, "--norc"])
+    os.set_blocking(fd, False)
+
+    def read_some(timeout):
+        if select.select([fd], [], [], timeout)[0]:
+            try:
+                return os.read(fd, 65536)
+            except OSError:
+                return None
+        return b""
+
+    end = time.monotonic() + 0.5
+    while time.monotonic() < end:
+        if read_some(0.05) is None:
+            break
+
+    # 输入回显里是 DONE_$m，只有真正执行后才会输出 DONE_MARK
+    body = "".join("echo line %d > /dev/null\r" % i for i in range(lines))
+    body += "m=MARK; echo DONE_$m\r"
+    data = (b"\x1b[200~" + body.encode() + b"\x1b[201~") if bracketed else body.encode()
+
+    start = time.monotonic()
+    seen = b""
+    while b"DONE_MARK" not in seen:
+        if data:
+            try:
+                n = os.write(fd, data[:4096])
+                data = data[n:]
+            except BlockingIOError:
+                pass
+        chunk = read_some(0 if data else 5.0)
+        if chunk is None or (chunk == b"" and not data):
+            print("%-10s no output, giving up" % name)
+            break
+        seen = seen[-64:] + chunk
+    elapsed = time.monotonic() - start
+    print("%-10s lines=%d  %.3f s  %9.0f lines/s" % (name, lines, elapsed, lines / elapsed))
+
+    os.write(fd, b"exit\r")
+    while read_some(0.2):
+        pass
+    os.waitpid(pid, 0)
+
+run("line-by-line", False)
+run("paste", True)
+PY
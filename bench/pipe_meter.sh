@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-比较普通管道 `|` 和测速管道 `|>` 的耗时，评估测速中继的开销
+# 用法: bench/pipe_meter.sh [myshell 路径] [数据大小MB]
+
+SHELL_BIN=${1:-./myshell}
+SIZE_MB=${2:-128}
+data=$(mktemp)
+trap 'rm -f "$data"' EXIT
+head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom | base64 > "$data"
+
+# run <说明> <管道>：测速报告写到 stderr，这里一并显示
+run() {
+    local start end
+    start=$(date +%s.%N)
+    "$SHELL_BIN" -c "$2" > /dev/null
+    end=$(date +%s.%N)
+    awk -v n="$1" -v s="$start" -v e="$end" 'BEGIN { printf "%-22s %7.3f s\n", n, e - s }'
+}
+
+run "cat | wc -c"   "cat $data | wc -c"
+run "cat |> wc -c"  "cat $data |> wc -c"
+run "cat | sort"    "cat $data | sort"
+run "cat |> sort"   "cat $data |> sort"
@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-用 run --pipe-size 调整管道容量，观察批量数据管道的吞吐量变化
+# 用法: bench/pipe_size.sh [myshell 路径] [数据大小MB]
+
+SHELL_BIN=${1:-./myshell}
+SIZE_MB=${2:-512}
+
+for size in 4K 16K 64K 256K 1M; do
+    start=$(date +%s.%N)
+    "$SHELL_BIN" -c "run --pipe-size $size -- dd if=/dev/zero bs=1M count=$SIZE_MB status=none | dd of=/dev/null bs=1M status=none"
+    end=$(date +%s.%N)
+    awk -v n="$size" -v s="$start" -v e="$end" -v mb="$SIZE_MB" \
+        'BEGIN { t = e - s; printf "pipe-size %-5s %7.3f s  %8.1f MB/s\n", n, t, mb / t }'
+done
@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-read/mapfile 逐行读取 1000 万行文件的速度 (lines/s)
+# 用法: bench/read_lines.sh [myshell 路径] [行数]
+# myshell 在普通文件和管道上都使用预读缓冲区；bash 的 read 在管道上每次只读一个字节，作为逐字节读取的基线。
+
+SHELL_BIN=${1:-./myshell}
+LINES=${2:-10000000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+seq -f "line %.0f of the benchmark input" 1 "$LINES" > "$TMP/input"
+echo 'while read -r line; do :; done < "$1"' > "$TMP/file.sh"
+echo 'cat "$1" | while read -r line; do :; done' > "$TMP/pipe.sh"
+echo 'mapfile -t < "$1"' > "$TMP/mapfile.sh"
+
+run() {
+    local name=$1 start end
+    shift
+    start=$(date +%s.%N)
+    "$@" "$TMP/input"
+    end=$(date +%s.%N)
+    awk -v n="$name" -v s="$start" -v e="$end" -v k="$LINES" \
+        'BEGIN { t = e - s; printf "%-22s %8.2f s  %12.0f lines/s\n", n, t, k / t }'
+}
+
+run "myshell read (file)" "$SHELL_BIN" "$TMP/file.sh"
+run "myshell read (pipe)" "$SHELL_BIN" "$TMP/pipe.sh"
+run "myshell mapfile" "$SHELL_BIN" "$TMP/mapfile.sh"
+if command -v bash >/dev/null; then
+    run "bash read (file)" bash "$TMP/file.sh"
+    run "bash read (pipe)" bash "$TMP/pipe.sh"
+fi
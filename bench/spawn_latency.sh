@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-比较 fork 和孵化器 (--zygote) 两种方式启动外部命令的延迟分布
+# 用法: bench/spawn_latency.sh [myshell 路径] [次数]
+# “胖”的一组先用大量变量把 Shell 的堆撑到约 128MB，fork 需要复制的页表随之变大，孵化器不受影响。
+
+SHELL_BIN=${1:-./myshell}
+COUNT=${2:-2000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+words=$(seq 1 "$COUNT" | tr '\n' ' ')
+loop="for i in $words; do time /bin/true; done"
+echo "$loop" > "$TMP/lean.sh"
+awk 'BEGIN { pad = sprintf("%4000s", ""); for (i = 0; i < 32768; i++) printf "v%d=\"%s\"\n", i, pad }' > "$TMP/fat.sh"
+echo "$loop" >> "$TMP/fat.sh"
+
+for heap in lean fat; do
+    for backend in fork zygote; do
+        opt=""
+        [ "$backend" = zygote ] && opt="--zygote"
+        "$SHELL_BIN" $opt "$TMP/$heap.sh" 2>&1 >/dev/null |
+            awk '/^real/ { sub(/s$/, "", $2); print $2 * 1e6 }' | sort -n |
+            awk -v name="$heap/$backend" '
+            { t[++n] = $1 }
+            END {
+                printf "%-12s n=%d  p50 %7.1f us  p90 %7.1f us  p99 %7.1f us  max %8.1f us\n",
+                       name, n, t[int(n * 0.5)], t[int(n * 0.9)], t[int(n * 0.99)], t[n]
+            }'
+    done
+done
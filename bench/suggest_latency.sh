@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-命令找不到时给出拼写建议的耗时：PATH 中有 2 万个命令名时，
+#                第一次（扫描目录建索引）和之后每次（位并行编辑距离）各需要多久
+# 用法: bench/suggest_latency.sh [myshell 路径] [命令名个数] [次数]
+# 用 `time type 拼错的名字` 测量，type 找不到命令时给出同样的建议，不需要 fork。
+
+SHELL_BIN=${1:-./myshell}
+NAMES=${2:-20000}
+COUNT=${3:-500}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# 随机的命令名：空的可执行文件
+mkdir "$TMP/bin"
+awk -v n="$NAMES" 'BEGIN {
+    srand(7)
+    for (i = 0; i < n; i++) {
+        len = 3 + int(rand() * 10); name = ""
+        for (k = 0; k < len; k++) name = name sprintf("%c", 97 + int(rand() * 26))
+        print name "-" i % 100
+    }
+}' > "$TMP/names"
+(cd "$TMP/bin" && xargs touch < "$TMP/names" && chmod +x ./*)
+
+typos="gti sl grpe mkae pyhton dokcer kubectll systemclt"
+words=$(for i in $(seq 1 "$COUNT"); do printf '%s ' $typos; done)
+echo "for w in $words; do time type \$w; done" > "$TMP/run.sh"
+
+for path in "/nonexistent" "$TMP/bin"; do
+    PATH="$path" "$SHELL_BIN" "$TMP/run.sh" 2>&1 >/dev/null |
+        awk '/^real/ { sub(/s$/, "", $2); print (++n == 1 ? "first " : "") $2 * 1e6 }' | sort -n |
+        awk -v name="$( [ "$path" = /nonexistent ] && echo "0 names" || echo "$NAMES names")" '
+        $1 == "first" { first = $2; next }
+        { t[++n] = $1 }
+        END {
+            printf "%-12s first %8.1f us   then n=%d  p50 %7.1f us  p99 %7.1f us  max %7.1f us\n",
+                   name, first, n, t[int(n * 0.5)], t[int(n * 0.99)], t[n]
+        }'
+done
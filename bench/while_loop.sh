@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# @Descripttion: 基准测试-100 万次 while 循环迭代，每次迭代调用一次内建命令 [
+# 用法: bench/while_loop.sh [myshell 路径]
+# 循环体只解析一次；对比 bash 可以看出按语法树执行的开销。
+
+SHELL_BIN=${1:-./myshell}
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+
+# 外层 5 重 for 循环共 10^5 次，内层 while 每次跑 10 轮，合计 10^6 次 while 迭代
+cat > "$script" <<'SCRIPT'
+d="0 1 2 3 4 5 6 7 8 9"
+for a in $d; do for b in $d; do for c in $d; do for e in $d; do for f in $d; do
+    s=
+    while [ "$s" != xxxxxxxxxx ]; do s=${s}x; done
+done; done; done; done; done
+SCRIPT
+
+run() {
+    local start end
+    start=$(date +%s.%N)
+    "$@" "$script"
+    end=$(date +%s.%N)
+    awk -v n="$1" -v s="$start" -v e="$end" \
+        'BEGIN { t = e - s; printf "%-12s %7.3f s  %10.0f iter/s\n", n, t, 1000000 / t }'
+}
+
+run "$SHELL_BIN"
+command -v bash >/dev/null && run bash
@@ -15,19 +15,48 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <fcntl.h> // for open flags
+#include <signal.h> // for sig_atomic_t
 
 // 常量定义
 #define MAX_CMD_LEN 1024 // 最大命令长度
 #define MAX_ARGS 64      // 最大参数数量
 #define HIST_SIZE 20     // 添加一个宏，用于定义命令历史记录大小
 
+struct node; // 语法树节点，定义见下方
+struct spawn_attrs; // run 前缀的设置，定义在 runattrs.c
+
+// 进程替换 <(list) / >(list)。参数和重定向目标中用占位符 SUBST_MARK + 序号表示，
+// 执行时启动子 Shell，占位符换成连接它的管道 /dev/fd/N
+#define SUBST_MARK '\001'
+typedef struct proc_subst {
+    struct node* body;
+    int is_output;          // >(list)：命令写入，list 从标准输入读
+    struct proc_subst* next;
+} proc_subst_t;
+
+// 同一条命令写了多个 > / >> 时（MULTIOS），第二个及之后的输出目标
+typedef struct output_target {
+    char* file;
+    int append;             // 是否为 >>
+    struct output_target* next;
+} output_target_t;
+
 // 命令结构体，用于存储解析后的命令
 // 这一步对于实现管道和重定向至关重要
+// 解析器产出的 command_t 中 args 保存的是“原始词”(带引号和 $ 变量)，
+// 执行前由 expand_command() 展开成一份新的 command_t 再交给 execute_*。
 typedef struct {
     char* args[MAX_ARGS];   // 参数列表，以 NULL 结尾
     char* input_file;       // 输入重定向文件
     char* output_file;      // 输出重定向文件
+    int append_output;      // 输出重定向是否为追加 (>>)
+    output_target_t* more_outputs; // 其余的输出目标，输出同时写入所有目标（可为 NULL）
+    proc_subst_t* substs;   // 进程替换，按占位符的序号排列（可为 NULL）
     int is_background;      // 是否后台执行
+    int meter_output;       // 到下一段的管道是否用 |> 测速
+    char** assigns;         // 命令前的 NAME=value 赋值，以 NULL 结尾（可为 NULL）
+    struct node* compound;  // 非 NULL 时，这一段是复合命令（子shell、循环等）
+    struct spawn_attrs* attrs; // run 前缀的设置（仅展开后的命令使用）
 } command_t;
 
 
@@ -38,33 +67,262 @@ typedef struct Alias {
     struct Alias* next;
 } Alias;
 
+// =================================================================
+// == 语法树 (AST)
+// =================================================================
+
+// 语法树节点类型
+typedef enum {
+    NODE_PIPELINE,  // 由 | 连接的一条或多条命令
+    NODE_SEQUENCE,  // a ; b
+    NODE_AND,       // a && b
+    NODE_OR,        // a || b
+    NODE_NOT,       // ! pipeline
+    NODE_SUBSHELL,  // ( list )
+    NODE_GROUP,     // { list; }
+    NODE_IF,        // if cond; then ...; [elif/else ...;] fi
+    NODE_WHILE,     // while cond; do ...; done
+    NODE_UNTIL,     // until cond; do ...; done
+    NODE_FOR,       // for name [in words]; do ...; done
+    NODE_CASE,      // case word in pat) ...;; esac
+    NODE_FUNCDEF,   // name() compound
+    NODE_ARITH,     // (( expr ))
+    NODE_ARITH_FOR  // for ((init; cond; step)); do ...; done
+} node_type_t;
+
+// case 语句中的一个分支
+typedef struct case_item {
+    char** patterns;        // 以 NULL 结尾的模式列表
+    struct node* body;      // 分支体，可为 NULL
+    struct case_item* next;
+} case_item_t;
+
+// 语法树节点。不同类型使用不同字段：
+//   PIPELINE: cmds/cmd_count
+//   SEQUENCE/AND/OR: left, right
+//   NOT/SUBSHELL/GROUP: left
+//   IF: left=条件, right=then 分支, else_part=else/elif 分支
+//   WHILE/UNTIL: left=条件, right=循环体
+//   FOR: name=循环变量, words=词列表(NULL 表示 "$@"), right=循环体
+//   CASE: name=被匹配的词, items=分支链表
+//   FUNCDEF: name=函数名, left=函数体
+//   ARITH: name=表达式原文
+//   ARITH_FOR: words=初始化、条件、步进三个表达式（可以是空串）, right=循环体
+typedef struct node {
+    node_type_t type;
+    int refcount;           // 函数定义会保留函数体的引用
+    struct node* left;
+    struct node* right;
+    struct node* else_part;
+    command_t* cmds;
+    int cmd_count;
+    char* name;
+    char** words;
+    case_item_t* items;
+    int is_background;      // 以 & 结尾
+    int timed;              // 以 time 开头，执行后报告耗时
+} node_t;
+
+// parse_next() 的返回值
+#define PARSE_OK         0  // 解析出一条完整命令
+#define PARSE_EOF        1  // 输入已经结束
+#define PARSE_ERROR      2  // 语法错误（已打印错误信息）
+#define PARSE_INCOMPLETE 3  // 输入在一条命令中间结束，需要更多输入（如缺少 fi）
+
 
 // 函数原型
 // parser.c
-int parse_command(char* line, command_t* cmd);
-int parse_pipe_commands(char* line, command_t* cmds, int* cmd_count);
+int parse_next(const char* src, size_t* pos, node_t** out);
+void free_node(node_t* node);
+
+// expand.c
+int expand_command(const command_t* raw, command_t* out);
+void free_expanded_command(command_t* cmd);
+void free_output_targets(output_target_t* targets);
+char* expand_word_string(const char* word);
+char** expand_word_list(char** words, int* count);
+
+// arith.c
+int arith_evaluate(const char* expr, long long* result);
+long arith_find_end(const char* s);
+
+// variables.c
+const char* get_var(const char* name);
+void set_var(const char* name, const char* value);
+void unset_var(const char* name);
+void export_var(const char* name);
+int is_valid_name(const char* s, size_t len);
+void set_positional_params(int argc, char** argv);
+void push_positional_params(int argc, char** argv);
+void pop_positional_params();
+int get_positional_count();
+const char* get_positional(int n);
+int shift_positional_params(int n);
+void adopt_positional_params(char** values, int count);
+void define_function(const char* name, node_t* body);
+node_t* lookup_function(const char* name);
+int remove_function(const char* name);
+void start_var_tracking();
+int stop_var_tracking(char*** names, char*** values);
+void for_each_var(void (*fn)(const char* name, const char* value, int exported, void* ctx), void* ctx);
+void for_each_function(void (*fn)(const char* name, node_t* body, void* ctx), void* ctx);
 
 // execute.c
-void execute_command(command_t* cmd);
-void execute_pipeline(command_t* cmds, int cmd_count);
+extern int last_exit_status;   // $?
+extern int side_effect_count;  // 产生过外部可见效果的命令数（fork、有输出的内建命令）
+int execute_command(command_t* cmd);
+int execute_pipeline(command_t* cmds, int cmd_count);
+int execute_node(node_t* node);
+int execute_string(const char* src);
+int wait_status_to_exit(int status);
+#define INTERRUPTED_STATUS 130 // 被 Ctrl+C 打断时的退出码（128 + SIGINT）
+extern volatile sig_atomic_t interrupted; // 交互模式下执行命令期间按下了 Ctrl+C
+void catch_interrupts();
+void reset_interrupt_handler();
+void note_interrupt();
+
+// meter.c
+pid_t start_pipe_meter(int in_fd, int* out_fd, int edge, const char* from, const char* to);
+
+// fanout.c
+pid_t start_output_fanout(const int* target_fds, int count, int* write_fd);
+
+// waiter.c
+#define TIMEOUT_KILL_GRACE 2.0 // 超时发 SIGTERM 之后，默认再等多久发 SIGKILL（秒）
+typedef struct {
+    double seconds; // 时限
+    double grace;   // SIGTERM 之后的宽限期，0 表示不发 SIGKILL
+} timeout_t;
+int parse_duration(const char* s, double* out);
+int default_timeout(timeout_t* out);
+int shell_owns_terminal();
+void set_terminal_pgrp(pid_t pgid);
+int wait_children(const pid_t* pids, const int* via_zygote, int count, int* statuses,
+                  const timeout_t* limit, pid_t pgid, const char** names);
+extern int wait_got_sigint;
+
+// runattrs.c
+// run 前缀的用法，runattrs.c 解析出错和单独执行 run 时共用
+#define RUN_USAGE "run [--cpus LIST] [--nice N] [--rlimit NAME=VALUE] [--pipe-size SIZE] " \
+                  "[--timeout DURATION] [--kill-after DURATION] [--] command"
+int parse_size(const char* s, unsigned long long* out);
+int parse_run_prefix(command_t* cmd);
+struct spawn_attrs* copy_spawn_attrs(const struct spawn_attrs* attrs);
+void apply_spawn_attrs(const struct spawn_attrs* attrs);
+void apply_pipe_size(const struct spawn_attrs* attrs, int fd);
+int spawn_timeout(const struct spawn_attrs* attrs, timeout_t* out);
+
+// zygote.c
+int start_zygote();
+int zygote_enabled();
+pid_t zygote_spawn(char** argv, char** assigns, int fds[3]);
+int zygote_wait(pid_t pid);
+void zygote_children_times(double* user, double* sys);
+
+// eventloop.c
+typedef void (*loop_callback_t)(int fd, void* ctx); // 定时器和 loop_defer 的回调收到 fd = -1
+int event_loop_init(void (*on_interrupt)());
+void loop_set_prompt(const char* prompt, void (*handler)(char* line));
+void loop_run_once();
+int loop_watch_fd(int fd, loop_callback_t callback, void* ctx);
+void loop_unwatch_fd(int fd);
+int loop_add_timer(int ms, loop_callback_t callback, void* ctx);
+void loop_defer(loop_callback_t callback, void* ctx);
+void loop_print(const char* fmt, ...);
+void add_background_job(pid_t pid, int via_zygote, int notify);
+
+// suggest.c
+int suggest_commands(const char* typed, const char** out);
+void warm_command_index(int fd, void* ctx);
+void report_command_not_found(const char* name);
+
+// joblog.c
+int job_capture_begin();
+void job_capture_end(int write_fd, pid_t pid, const char* label);
+
+// record.c
+typedef enum {
+    RECORD_WAIT,     // 显示提示符到收到输入
+    RECORD_PROMPT,   // 生成并显示提示符
+    RECORD_COMPLETE, // Tab 补全
+    RECORD_PARSE,    // 历史展开、别名展开和语法分析
+    RECORD_EXEC,     // 执行
+    RECORD_PHASES
+} record_phase_t;
+int record_open(const char* path);
+int record_enabled();
+void record_begin(record_phase_t phase);
+void record_end(record_phase_t phase);
+void record_completion(const char* line, int point);
+void record_input(char type, const char* text, double received);
+double record_clock();
+
+// flagcomp.c
+char** lookup_command_flags(const char* command, int* count);
+
+// frecency.c
+void dirs_init();
+void dirs_record_cwd();
+int dirs_jump(char** fragments);
+void print_dirs_stats();
+
+// rcfile.c
+void load_rc_file();
+void print_startup_stats(double elapsed_ms);
 
 // builtins.c
+extern const char* builtin_str[];
+int num_builtins();
 int handle_builtin_command(command_t* cmd);
-void builtin_cd(char** args);
-void builtin_echo(char** args);
-void builtin_type(char** args);
+int is_builtin(const char* name);
+int is_pure_builtin(const char* name);
+int run_builtin(char** args);
+int builtin_cd(char** args);
+int builtin_echo(char** args);
+int builtin_type(char** args);
 
-void builtin_alias(char** args);
-void builtin_unalias(char** args);  // 新增
+int builtin_alias(char** args);
+int builtin_unalias(char** args);  // 新增
 char* expand_alias(char* line);     // 新增，这个函数非常关键
+const Alias* get_alias_list();
+void define_alias(const char* name, const char* command);
 
 // 添加和修改以下history函数原型
 void add_to_history(const char* cmd); // 新增
-void builtin_history(char** args);    // 修改，确保参数统一
+int builtin_history(char** args);    // 修改，确保参数统一
 // history system getters
 int get_history_count();
 const char* get_history_entry(int index);
 
+// 流程控制与变量相关的内建命令
+int builtin_true(char** args);
+int builtin_false(char** args);
+int builtin_test(char** args);
+int builtin_break(char** args);
+int builtin_continue(char** args);
+int builtin_return(char** args);
+int builtin_shift(char** args);
+int builtin_exit(char** args);
+int builtin_export(char** args);
+int builtin_unset(char** args);
+int builtin_run(char** args);
+int builtin_memo(char** args); // 定义在 memo.c
+int builtin_jobs(char** args);   // 定义在 joblog.c
+int builtin_joblog(char** args); // 定义在 joblog.c
+int builtin_read(char** args);
+int builtin_mapfile(char** args);
+int builtin_coproc(char** args); // 定义在 coproc.c
+int builtin_cosend(char** args); // 定义在 coproc.c
+int builtin_coread(char** args); // 定义在 coproc.c
+void invalidate_read_buffers();
+
+// 循环与函数的控制流状态（由 break/continue/return 内建命令设置）
+extern int loop_depth;        // 当前所在循环的嵌套层数
+extern int pending_break;     // 还需要跳出的循环层数
+extern int pending_continue;  // 还需要 continue 的循环层数
+extern int function_depth;    // 当前所在函数的嵌套层数
+extern int pending_return;    // 是否正在从函数返回
+
 // 添加新函数的原型completion.c
 void initialize_completion();
 char** completion_callback(const char* text, int start, int end);
@@ -73,4 +331,4 @@ char** completion_callback(const char* text, int start, int end);
 void main_loop();
 void display_prompt();
 
-#endif // SHELL_H
\ No newline at end of file
+#endif // SHELL_H
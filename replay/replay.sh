@@ -0,0 +1,236 @@
+#!/usr/bin/env bash
+# @Descripttion: 回放测试-把 myshell --record 录下的会话在伪终端里重新输入一遍，统计提示符、补全、解析、
+#                执行和整行（按下回车到下一个提示符）延迟的分布，与保存的基线比较，发现变慢就判定失败
+# 用法: replay/replay.sh [--baseline 文件 | --save-baseline 文件] [--runs N] [--tolerance 比例] myshell 录制文件
+# 环境变量:
+#   REPLAY_TIMEOUT  每行输入等待下一个提示符的秒数（默认 10），超时后发送 Ctrl+C 继续
+#   REPLAY_FLOOR_US 比较时给每个耗时加上的微秒数（默认 50），避免几微秒的阶段被噪声放大成很大的比例
+#
+# 回放在临时目录中进行：HOME 和当前目录都在里面，PATH 只包含一个存根目录。会话中出现的、
+# 在真实 PATH 里能找到的命令名都在存根目录中链接到 true，/bin/xxx 这样的绝对路径也改写成
+# 存根，所以回放不会真的运行 rm、make、vim 之类的命令，"执行"阶段测到的是 Shell 自己
+# 启动一个外部命令的开销。这只是避免误操作，不是安全边界：重定向到绝对路径的文件仍然会写入。
+#
+# 各阶段的耗时来自回放时 Shell 自己录下的记录（--record），整行延迟由这个脚本测量。
+# 会话回放 N 遍，每个输入在每个阶段得到 N 个样本，基线保存它们的中位数。比较时逐个输入
+# 计算 (中位数 + FLOOR) / (基线 + FLOOR)，一个阶段所有输入的几何平均超过 1 + tolerance 时
+# 报告退化，退出码为 1。只比较整体分布的 p50/p90 不够稳定：内建命令和外部命令的执行时间
+# 相差两个数量级，p50 落在哪一类上会随机跳动。
+
+BASELINE=
+SAVE=
+RUNS=5
+TOLERANCE=0.25
+while [ $# -gt 2 ]; do
+    case "$1" in
+        --baseline) BASELINE=$2; shift 2 ;;
+        --save-baseline) SAVE=$2; shift 2 ;;
+        --runs) RUNS=$2; shift 2 ;;
+        --tolerance) TOLERANCE=$2; shift 2 ;;
+        *) echo "replay: $1: invalid option" >&2; exit 2 ;;
+    esac
+done
+if [ $# -ne 2 ]; then
+    echo "usage: replay/replay.sh [--baseline FILE | --save-baseline FILE] [--runs N] [--tolerance X] myshell session.rec" >&2
+    exit 2
+fi
+SHELL_BIN=$(realpath "$1")
+SESSION=$2
+
+command -v python3 >/dev/null || { echo "replay: python3 not found, skipped"; exit 0; }
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+python3 - "$SHELL_BIN" "$SESSION" "$TMP" "$RUNS" "$TOLERANCE" "$BASELINE" "$SAVE" <<'PY'
+import math, os, pty, re, select, shutil, signal, sys, time
+
+shell, session, tmp, runs, tolerance, baseline, save = sys.argv[1:8]
+runs, tolerance = int(runs), float(tolerance)
+timeout = float(os.environ.get("REPLAY_TIMEOUT", "10"))
+floor = float(os.environ.get("REPLAY_FLOOR_US", "50"))
+PHASES = ["prompt", "complete", "parse", "exec", "line"]
+PROMPT_MARK = b"\x1b[?2004h"  # readline 每次显示提示符时打开 bracketed paste
+
+def unescape(s):
+    return re.sub(r"\\(.)", lambda m: {"t": "\t", "n": "\n", "r": "\r"}.get(m.group(1), m.group(1)), s)
+
+def read_records(path):
+    records = []
+    with open(path, errors="replace") as f:
+        for raw in f:
+            if raw.startswith("#"):
+                continue
+            fields = raw.rstrip("\n").split("\t")
+            if fields[0] == "C" and len(fields) >= 4:
+                records.append(("C", float(fields[2]), unescape("\t".join(fields[3:]))))
+            elif fields[0] in ("L", "P") and len(fields) >= 9:
+                us = dict(zip(["wait", "prompt", "complete", "parse", "exec"], map(float, fields[2:7])))
+                records.append((fields[0], us, unescape("\t".join(fields[8:]))))
+    return records
+
+# ---- 沙箱：临时 HOME、当前目录和只有存根的 PATH ----
+stubs, home, work = (os.path.join(tmp, d) for d in ("bin", "home", "work"))
+for d in (stubs, home, work):
+    os.makedirs(d)
+true_bin = shutil.which("true")
+absolute = re.compile(r"(?<![\w/.])/(?:usr/)?(?:local/)?s?bin/([\w.+-]+)")
+
+def sandboxed(text):
+    text = absolute.sub(r"\1", text)
+    for word in set(re.findall(r"[\w.+-]+", text)):
+        stub = os.path.join(stubs, word)
+        if not os.path.exists(stub) and not word.startswith(".") and shutil.which(word):
+            os.symlink(true_bin, stub)
+    return text
+
+inputs = [(kind, sandboxed(text)) for kind, _, text in read_records(session)]
+if not inputs:
+    sys.exit("replay: %s: no input records" % session)
+
+env = {"HOME": home, "PATH": stubs, "TERM": os.environ.get("TERM", "xterm"),
+       "USER": os.environ.get("USER", "user"), "LANG": os.environ.get("LANG", "C")}
+
+def replay_once(record_path):
+    """回放一遍，返回每个输入的整行延迟（微秒，补全和超时的输入为 None）和超时的行数"""
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.chdir(work)
+        os.execve(shell, [shell, "--norc", "--record", record_path], env)
+
+    buf = b""
+    def wait_for(pred, seconds):
+        nonlocal buf
+        end = time.monotonic() + seconds
+        while not pred():
+            left = end - time.monotonic()
+            if left <= 0:
+                return False
+            if select.select([fd], [], [], left)[0]:
+                try:
+                    buf += os.read(fd, 65536)
+                except OSError:  # Shell 已退出
+                    return False
+        return True
+
+    def record_count(kind):
+        with open(record_path, errors="replace") as f:
+            return sum(1 for line in f if line.startswith(kind + "\t"))
+
+    lines, timeouts = [], 0
+    wait_for(lambda: PROMPT_MARK in buf, timeout)
+    for kind, text in inputs:
+        buf = b""
+        if kind == "C":
+            # 输入光标前的内容后按 Tab，等 Shell 记下这次补全，再用 Ctrl+A Ctrl+K 清空输入行
+            before = record_count("C")
+            os.write(fd, text.replace("\t", " ").encode() + b"\t")
+            end = time.monotonic() + timeout
+            while record_count("C") == before and time.monotonic() < end:
+                wait_for(lambda: False, 0.002)
+            os.write(fd, b"\x01\x0b")
+            lines.append(None)
+            continue
+        if kind == "P":
+            data = b"\x1b[200~" + text.encode() + b"\x1b[201~"
+        else:
+            data = text.replace("\t", " ").encode() + b"\r"
+        start = time.monotonic()
+        os.write(fd, data)
+        if wait_for(lambda: PROMPT_MARK in buf, timeout):
+            lines.append((time.monotonic() - start) * 1e6)
+        else:
+            lines.append(None)
+            timeouts += 1
+            os.write(fd, b"\x03")
+            wait_for(lambda: PROMPT_MARK in buf, 1)
+    os.write(fd, b"exit\r")
+    wait_for(lambda: False, 1)
+    try:
+        os.kill(pid, signal.SIGKILL)
+    except ProcessLookupError:
+        pass
+    os.waitpid(pid, 0)
+    os.close(fd)
+    return lines, timeouts
+
+# per_input[i][phase] 是第 i 个输入在这个阶段的样本
+per_input = [{p: [] for p in PHASES} for _ in inputs]
+timeouts, skipped = 0, 0
+for run in range(runs):
+    record_path = os.path.join(tmp, "replay%d.rec" % run)
+    lines, t = replay_once(record_path)
+    timeouts += t
+    records = read_records(record_path)
+    if [r[0] for r in records] != [kind for kind, _ in inputs]:
+        skipped += 1  # 有输入超时或被中断，记录和输入对不上
+        continue
+    for i, (kind, us, _) in enumerate(records):
+        if kind == "C":
+            per_input[i]["complete"].append(us)
+            continue
+        per_input[i]["prompt"].append(us["prompt"])
+        per_input[i]["parse"].append(us["parse"])
+        if us["exec"] > 0:  # 续行不执行
+            per_input[i]["exec"].append(us["exec"])
+        if lines[i] is not None:
+            per_input[i]["line"].append(lines[i])
+if skipped == runs:
+    sys.exit("replay: no run matched the recorded inputs")
+
+def percentile(values, q):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+medians = [{p: percentile(v, 0.5) for p, v in phases.items() if v} for phases in per_input]
+
+base = None
+if baseline:
+    if os.path.exists(baseline):
+        base = []
+        with open(baseline) as f:
+            for line in f:
+                if not line.startswith("#"):
+                    fields = line.split()
+                    base.append({p: float(v) for p, v in zip(PHASES, fields[2:]) if v != "-"})
+        if len(base) != len(inputs):
+            sys.exit("replay: %s: baseline has %d inputs, session has %d" % (baseline, len(base), len(inputs)))
+    else:
+        print("replay: %s: no baseline yet, use --save-baseline to create one" % baseline)
+
+print("%d inputs x %d runs in %s (us)" % (len(inputs), runs - skipped, session))
+print("%-9s %6s %9s %9s %9s %9s   %s" % ("phase", "n", "p50", "p90", "p99", "max", "vs baseline"))
+regressions = []
+for p in PHASES:
+    samples = [x for phases in per_input for x in phases[p]]
+    if not samples:
+        continue
+    note = ""
+    if base is not None:
+        ratios = [(m[p] + floor) / (b[p] + floor) for m, b in zip(medians, base) if p in m and p in b]
+        if ratios:
+            change = math.exp(sum(map(math.log, ratios)) / len(ratios))
+            note = "%+6.1f%%" % ((change - 1) * 100)
+            if change > 1 + tolerance:
+                note += "  SLOWER"
+                worst = max((m[p] - b[p], i) for i, (m, b) in enumerate(zip(medians, base)) if p in m and p in b)
+                regressions.append("%s %+.0f%% (worst: input %d %r %.1fus -> %.1fus)" % (
+                    p, (change - 1) * 100, worst[1] + 1, inputs[worst[1]][1][:40],
+                    base[worst[1]][p], medians[worst[1]][p]))
+    print("%-9s %6d %9.1f %9.1f %9.1f %9.1f   %s" % (p, len(samples), percentile(samples, 0.5),
+          percentile(samples, 0.9), percentile(samples, 0.99), max(samples), note))
+if timeouts:
+    print("replay: %d inputs did not return to the prompt within %gs" % (timeouts, timeout))
+
+if save:
+    with open(save, "w") as f:
+        f.write("# myshell replay baseline: %s, %d runs, %s\n" % (session, runs - skipped, time.strftime("%Y-%m-%d %H:%M")))
+        f.write("# input kind %s (median us, - = none)\n" % " ".join(PHASES))
+        for i, m in enumerate(medians):
+            f.write("%d %s %s\n" % (i + 1, inputs[i][0], " ".join("%.1f" % m[p] if p in m else "-" for p in PHASES)))
+    print("replay: baseline saved to %s" % save)
+
+if regressions:
+    print("replay: FAIL: " + "; ".join(regressions))
+    sys.exit(1)
+PY
@@ -0,0 +1,137 @@
+#!/usr/bin/env bash
+# @Descripttion: 压力测试-让一个交互模式的 Shell 连续执行数百万条随机生成的命令，
+#                每秒采样它的打开 fd 数、RSS 和系统的进程创建速率，发现持续增长就判定失败
+# 用法: soak/soak.sh [myshell 路径]
+# 环境变量:
+#   SOAK_COMMANDS  命令条数（默认 1000000）
+#   SOAK_NOFILE    Shell 的 fd 上限（默认 48）。成批的后台任务会占住 pidfd，让 pipe() 失败走错误路径
+#   SOAK_FD_SLACK  最后一段时间的 fd 数下限允许比预热后高出的个数（默认 4）
+#   SOAK_RSS_SLACK 最后一段时间的 RSS 下限允许比预热后增长的比例（默认 0.10）
+
+SHELL_BIN=${1:-./myshell}
+COMMANDS=${SOAK_COMMANDS:-1000000}
+NOFILE=${SOAK_NOFILE:-48}
+FD_SLACK=${SOAK_FD_SLACK:-4}
+RSS_SLACK=${SOAK_RSS_SLACK:-0.10}
+
+TMP=$(mktemp -d)
+trap 'kill $SHELL_PID 2>/dev/null; rm -rf "$TMP"' EXIT
+mkfifo "$TMP/input"
+
+# ASan/LSan 版本：Shell 退出时检查泄漏，报告写到 $TMP/asan.*
+# 限制释放内存的隔离区大小，否则 ASan 自己的 RSS 会一直涨到隔离区上限（默认 256MB）
+export ASAN_OPTIONS="detect_leaks=1:quarantine_size_mb=8:log_path=$TMP/asan"
+export UBSAN_OPTIONS="print_stacktrace=1:log_path=$TMP/ubsan"
+export HOME="$TMP" # 不读用户的 ~/.myshellrc，memo 缓存也放在临时目录
+
+# 命令生成器：普通命令、管道、重定向（包括多个输出目标）、进程替换、复合命令、别名、函数、各种错误，以及成批的后台任务
+generate() {
+    awk -v n="$COMMANDS" -v tmp="$TMP" 'BEGIN {
+        srand(42)
+        for (i = 0; i < n; i++) {
+            r = int(rand() * 26)
+            if      (r == 0)  print "true"
+            else if (r == 1)  print "x=" i "; echo $x > /dev/null"
+            else if (r == 2)  print "/bin/true"
+            else if (r == 3)  print "echo a b c | cat | cat > /dev/null"
+            else if (r == 4)  print "echo " i " > " tmp "/f; cat < " tmp "/f >> " tmp "/g"
+            else if (r == 5)  print "cat < " tmp "/does_not_exist"
+            else if (r == 6)  print "echo x > " tmp "/no_such_dir/f"
+            else if (r == 7)  print "no_such_command_" (i % 7)
+            else if (r == 8)  print "fi"
+            else if (r == 9)  print "echo a | | cat"
+            else if (r == 10) print "if true; then echo y; else echo n; fi > /dev/null"
+            else if (r == 11) print "for k in 1 2 3; do echo $k; done | cat > /dev/null"
+            else if (r == 12) print "alias ll" (i % 5) "=\x27echo alias\x27; ll" (i % 5) " > /dev/null"
+            else if (r == 13) print "unalias ll" (i % 5)
+            else if (r == 14) print "f" (i % 3) "() { echo $1; }; f" (i % 3) " arg > /dev/null"
+            else if (r == 15) print "case " i " in 1*) true ;; *) false ;; esac"
+            else if (r == 16) print "( echo sub ) | cat > /dev/null"
+            else if (r == 17) print "{ echo group; } > /dev/null"
+            else if (r == 18) print "echo \"quoted $x\" \x27single\x27 ~ > /dev/null"
+            else if (r == 19) print "export SOAK_" (i % 10) "=" i "; unset SOAK_" ((i + 5) % 10)
+            else if (r == 20) print "echo a |> cat > /dev/null"
+            else if (r == 21) print "history 3 > /dev/null"
+            else if (r == 23) print "echo " i " > " tmp "/m1 > " tmp "/m2 | cat"
+            else if (r == 24) print "cat <(echo " i ") > >(cat > /dev/null)"
+            else if (r == 22 && i % 200 == 0) {
+                # 一批后台任务：交互模式下每个任务占一个 pidfd，可能把 fd 用完
+                for (k = 0; k < 40; k++) printf "sleep 0.%d &\n", k % 10
+            }
+            else print "test " i " -gt 5"
+        }
+        print "exit"
+    }'
+}
+
+generate > "$TMP/input" &
+GEN_PID=$!
+(ulimit -n "$NOFILE"; exec "$SHELL_BIN" --norc < "$TMP/input" > /dev/null 2> "$TMP/stderr") &
+SHELL_PID=$!
+
+# 每秒采样: 时间 fd数 RSS(KB) 系统累计创建的进程数
+start=$(date +%s)
+last_report=0
+while kill -0 "$SHELL_PID" 2>/dev/null; do
+    fds=$(ls "/proc/$SHELL_PID/fd" 2>/dev/null | wc -l)
+    rss=$(awk '/^VmRSS/ { print $2 }' "/proc/$SHELL_PID/status" 2>/dev/null)
+    forks=$(awk '/^processes/ { print $2 }' /proc/stat)
+    now=$(date +%s)
+    [ -n "$rss" ] && echo "$((now - start)) $fds $rss $forks" >> "$TMP/samples"
+    if [ $((now - last_report)) -ge 10 ] && [ -n "$rss" ]; then
+        echo "soak: t=$((now - start))s fds=$fds rss=${rss}KB"
+        last_report=$now
+    fi
+    sleep 1
+done
+wait "$SHELL_PID"
+status=$?
+wait "$GEN_PID" 2>/dev/null
+
+echo "soak: shell exited with status $status after $(($(date +%s) - start))s, $COMMANDS commands"
+fail=0
+if [ "$status" -ge 128 ]; then
+    echo "soak: FAIL: shell was killed by signal $((status - 128))"
+    tail -5 "$TMP/stderr"
+    fail=1
+fi
+
+# 趋势判断：后台任务在运行时 fd 数和 RSS 会正常波动，所以比较的是每一段时间里的最小值（底线）。
+# 跳过前 1/4 的预热期，把剩下的样本分成 3 段，最后一段的底线不能比第一段高出太多
+if [ -s "$TMP/samples" ]; then
+    awk -v fd_slack="$FD_SLACK" -v rss_slack="$RSS_SLACK" '
+        { t[NR] = $1; fd[NR] = $2; rss[NR] = $3; forks[NR] = $4 }
+        function floor_of(a, from, to,    i, m) {
+            m = a[from]
+            for (i = from; i <= to; i++) if (a[i] < m) m = a[i]
+            return m
+        }
+        END {
+            n = NR
+            w = int(n / 4) + 1
+            seg = int((n - w + 1) / 3); if (seg < 1) seg = 1
+            first_end = w + seg - 1; if (first_end > n) first_end = n
+            last_start = n - seg + 1; if (last_start < w) last_start = w
+            fd0 = floor_of(fd, w, first_end); fd1 = floor_of(fd, last_start, n)
+            rss0 = floor_of(rss, w, first_end); rss1 = floor_of(rss, last_start, n)
+            growth = (rss1 - rss0) / rss0
+            rate_first = (forks[first_end] - forks[w]) / (t[first_end] - t[w] + 1e-9)
+            rate_last = (forks[n] - forks[last_start]) / (t[n] - t[last_start] + 1e-9)
+            printf "soak: fd floor %d -> %d, rss floor %d KB -> %d KB (%+.1f%%), spawn rate %.0f/s -> %.0f/s\n",
+                   fd0, fd1, rss0, rss1, growth * 100, rate_first, rate_last
+            bad = 0
+            if (fd1 > fd0 + fd_slack) { print "soak: FAIL: open fd count keeps growing"; bad = 1 }
+            if (growth > rss_slack) { print "soak: FAIL: RSS keeps growing"; bad = 1 }
+            if (n >= 12 && rate_last < rate_first * 0.5) { print "soak: FAIL: spawn rate degraded"; bad = 1 }
+            exit bad
+        }' "$TMP/samples" || fail=1
+fi
+
+if ls "$TMP"/asan.* "$TMP"/ubsan.* >/dev/null 2>&1; then
+    echo "soak: FAIL: sanitizer reports:"
+    cat "$TMP"/asan.* "$TMP"/ubsan.* 2>/dev/null | head -60
+    fail=1
+fi
+
+[ "$fail" -eq 0 ] && echo "soak: PASS"
+exit "$fail"
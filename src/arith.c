@@ -0,0 +1,824 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-29 09:12:40
+ * @FilePath: /linux-shell/src/arith.c
+ * @Descripttion: 算术模块-$(( )) 展开和 (( )) 命令，64 位整数上的 C 运算符，表达式编译成字节码并缓存
+ */
+
+// 支持的运算符（优先级从高到低，和 bash 相同）:
+//   id++ id--   ++id --id   + - ! ~ (一元)   **   * / %   + -   << >>   < <= > >=   == !=
+//   &   ^   |   &&   ||   ?:   = += -= *= /= %= <<= >>= &= ^= |=   ,
+// 数字可以写成 10、0x1f、017（八进制）或 base#digits（2 到 64 进制）。
+// 变量可以写成 name、$name 或 ${name}；未设置或为空时是 0，值本身不是数字时按表达式再求一次值。
+//
+// 表达式第一次出现时编译成一段紧凑的字节码（栈式虚拟机），按源文本缓存。
+// 循环体里的 ((i++)) 之后每次只需要查一次哈希表、跑几条指令，不用重新分词和解析。
+// 含有 $1、$?、引号等需要 Shell 展开的表达式先展开再编译，缓存键是展开后的文本。
+
+#include "shell.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+
+#define ARITH_CACHE_BUCKETS 256
+#define ARITH_CACHE_MAX 1024   // 缓存的表达式数超过这个值时整体清空
+#define ARITH_MAX_NEST 256     // 括号和一元运算符的最大嵌套层数
+#define ARITH_MAX_RECURSION 32 // 变量的值又是表达式时，最多递归求值几层
+#define ARITH_STACK_INLINE 64  // 求值栈不超过这个深度时放在 C 栈上
+
+// 字节码指令。操作数紧跟在操作码后面：PUSH 带 8 字节立即数，
+// 变量指令带 2 字节的变量名下标，跳转指令带 4 字节的目标地址
+typedef enum {
+    OP_END,
+    OP_PUSH,
+    OP_LOAD,
+    OP_STORE,       // 弹出值写入变量，再把值压回去
+    OP_PREINC, OP_PREDEC, OP_POSTINC, OP_POSTDEC,
+    OP_NEG, OP_NOT, OP_BNOT, OP_BOOL,
+    OP_POW, OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB, OP_SHL, OP_SHR,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE, OP_BAND, OP_BXOR, OP_BOR,
+    OP_POP,
+    OP_JMP,
+    OP_JZ,          // 弹出，为 0 时跳转
+    OP_JZ_KEEP,     // 栈顶为 0 时保留它并跳转，否则弹出（&&）
+    OP_JNZ_KEEP     // 栈顶非 0 时保留它并跳转，否则弹出（||）
+} opcode_t;
+
+typedef struct arith_expr {
+    char* source;
+    unsigned int hash;
+    uint8_t* code;
+    size_t len;
+    size_t cap;
+    char** names;       // 表达式引用的变量名，指令里用下标引用
+    int name_count;
+    int max_stack;      // 求值栈的最大深度
+    struct arith_expr* next;
+} arith_expr_t;
+
+static arith_expr_t* cache[ARITH_CACHE_BUCKETS];
+static int cache_count = 0;
+
+// =================================================================
+// == 词法分析
+// =================================================================
+
+typedef enum {
+    TK_END, TK_NUM, TK_NAME, TK_LPAREN, TK_RPAREN, TK_QUEST, TK_COLON, TK_COMMA,
+    TK_INC, TK_DEC, TK_NOT, TK_BNOT,
+    // 二元运算符
+    TK_POW, TK_MUL, TK_DIV, TK_MOD, TK_ADD, TK_SUB, TK_SHL, TK_SHR,
+    TK_LT, TK_LE, TK_GT, TK_GE, TK_EQ, TK_NE, TK_BAND, TK_BXOR, TK_BOR, TK_AND, TK_OR,
+    // 赋值运算符
+    TK_ASSIGN, TK_MUL_ASSIGN, TK_DIV_ASSIGN, TK_MOD_ASSIGN, TK_ADD_ASSIGN, TK_SUB_ASSIGN,
+    TK_SHL_ASSIGN, TK_SHR_ASSIGN, TK_BAND_ASSIGN, TK_BXOR_ASSIGN, TK_BOR_ASSIGN,
+    TK_BAD,
+    TK_BAD_NUMBER       // 数字对它的进制无效，比如 08
+} token_kind_t;
+
+// 按长度从长到短排列，保证最长匹配
+static const struct {
+    const char* text;
+    token_kind_t kind;
+} operators[] = {
+    {"<<=", TK_SHL_ASSIGN}, {">>=", TK_SHR_ASSIGN},
+    {"**", TK_POW}, {"<<", TK_SHL}, {">>", TK_SHR}, {"<=", TK_LE}, {">=", TK_GE},
+    {"==", TK_EQ}, {"!=", TK_NE}, {"&&", TK_AND}, {"||", TK_OR}, {"++", TK_INC}, {"--", TK_DEC},
+    {"*=", TK_MUL_ASSIGN}, {"/=", TK_DIV_ASSIGN}, {"%=", TK_MOD_ASSIGN}, {"+=", TK_ADD_ASSIGN},
+    {"-=", TK_SUB_ASSIGN}, {"&=", TK_BAND_ASSIGN}, {"^=", TK_BXOR_ASSIGN}, {"|=", TK_BOR_ASSIGN},
+    {"*", TK_MUL}, {"/", TK_DIV}, {"%", TK_MOD}, {"+", TK_ADD}, {"-", TK_SUB},
+    {"<", TK_LT}, {">", TK_GT}, {"&", TK_BAND}, {"^", TK_BXOR}, {"|", TK_BOR},
+    {"=", TK_ASSIGN}, {"!", TK_NOT}, {"~", TK_BNOT}, {"(", TK_LPAREN}, {")", TK_RPAREN},
+    {"?", TK_QUEST}, {":", TK_COLON}, {",", TK_COMMA},
+};
+
+// 二元运算符的优先级（越大越紧）和对应的指令，下标是 token_kind_t - TK_POW
+static const struct {
+    int prec;
+    opcode_t op;
+} binary_ops[] = {
+    {11, OP_POW}, {10, OP_MUL}, {10, OP_DIV}, {10, OP_MOD}, {9, OP_ADD}, {9, OP_SUB},
+    {8, OP_SHL}, {8, OP_SHR}, {7, OP_LT}, {7, OP_LE}, {7, OP_GT}, {7, OP_GE},
+    {6, OP_EQ}, {6, OP_NE}, {5, OP_BAND}, {4, OP_BXOR}, {3, OP_BOR}, {2, OP_END}, {1, OP_END},
+};
+
+static int is_binary(token_kind_t kind) {
+    return kind >= TK_POW && kind <= TK_OR;
+}
+
+static int is_assign(token_kind_t kind) {
+    return kind >= TK_ASSIGN && kind <= TK_BOR_ASSIGN;
+}
+
+// 复合赋值 op= 对应的二元指令
+static opcode_t assign_op(token_kind_t kind) {
+    switch (kind) {
+    case TK_MUL_ASSIGN: return OP_MUL;
+    case TK_DIV_ASSIGN: return OP_DIV;
+    case TK_MOD_ASSIGN: return OP_MOD;
+    case TK_ADD_ASSIGN: return OP_ADD;
+    case TK_SUB_ASSIGN: return OP_SUB;
+    case TK_SHL_ASSIGN: return OP_SHL;
+    case TK_SHR_ASSIGN: return OP_SHR;
+    case TK_BAND_ASSIGN: return OP_BAND;
+    case TK_BXOR_ASSIGN: return OP_BXOR;
+    case TK_BOR_ASSIGN: return OP_BOR;
+    default: return OP_END;
+    }
+}
+
+// base#digits 中一位数字的值：10 到 35 是字母（36 进制以内不分大小写），之后是大写字母、@、_
+static int digit_value(char c, int base) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z') return base <= 36 ? c - 'A' + 10 : c - 'A' + 36;
+    if (c == '@') return 62;
+    if (c == '_') return 63;
+    return 64;
+}
+
+/**
+ * @description: 读取一个整数常量（不含符号），溢出时按 64 位回绕
+ * @param {size_t*} len - 输出：常量占用的字符数
+ * @return {int} - 成功返回 0，数字对这个进制无效返回 -1
+ */
+static int parse_number(const char* s, size_t* len, long long* out) {
+    size_t i = 0;
+    unsigned long long value = 0;
+    int base = 10;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        i = 2;
+    } else if (s[0] == '0') {
+        base = 8;
+    } else {
+        // 可能是 base#digits
+        size_t j = 0;
+        int b = 0;
+        while (isdigit((unsigned char)s[j]) && b <= 64) b = b * 10 + (s[j++] - '0');
+        if (s[j] == '#') {
+            if (b < 2 || b > 64) return -1;
+            base = b;
+            i = j + 1;
+        }
+    }
+
+    size_t start = i;
+    while (isalnum((unsigned char)s[i]) || s[i] == '@' || s[i] == '_') {
+        int d = digit_value(s[i], base);
+        if (d >= base) return -1;
+        value = value * base + d;
+        i++;
+    }
+    if (i == start && base != 8) return -1; // 0x、10# 后面没有数字
+    *len = i;
+    *out = (long long)value;
+    return 0;
+}
+
+typedef struct {
+    const char* src;
+    size_t pos;             // 下一个未读字符
+    size_t tok_start;       // 当前词法单元的起点（用于报错）
+    token_kind_t tok;
+    long long num;          // TK_NUM 的值
+    const char* name;       // TK_NAME 的名字（不以 '\0' 结尾）
+    size_t name_len;
+    arith_expr_t* expr;     // 正在生成的字节码
+    int depth;              // 当前栈深度
+    int nest;               // 当前嵌套层数
+    int error;
+} compiler_t;
+
+// 读取下一个词法单元到 c->tok
+static void lex(compiler_t* c) {
+    const char* s = c->src;
+    while (isspace((unsigned char)s[c->pos])) c->pos++;
+    c->tok_start = c->pos;
+
+    char ch = s[c->pos];
+    if (ch == '\0') {
+        c->tok = TK_END;
+        return;
+    }
+    if (isdigit((unsigned char)ch)) {
+        size_t len;
+        if (parse_number(s + c->pos, &len, &c->num) < 0) {
+            c->tok = TK_BAD_NUMBER;
+            return;
+        }
+        c->pos += len;
+        c->tok = TK_NUM;
+        return;
+    }
+
+    // name、$name 或 ${name}
+    size_t p = c->pos;
+    int braced = 0;
+    if (ch == '$') {
+        p++;
+        if (s[p] == '{') {
+            braced = 1;
+            p++;
+        }
+    }
+    if (isalpha((unsigned char)s[p]) || s[p] == '_') {
+        size_t end = p;
+        while (isalnum((unsigned char)s[end]) || s[end] == '_') end++;
+        if (braced && s[end] != '}') {
+            c->tok = TK_BAD;
+            return;
+        }
+        c->name = s + p;
+        c->name_len = end - p;
+        c->pos = end + braced;
+        c->tok = TK_NAME;
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+        size_t len = strlen(operators[i].text);
+        if (strncmp(s + c->pos, operators[i].text, len) == 0) {
+            c->pos += len;
+            c->tok = operators[i].kind;
+            return;
+        }
+    }
+    c->tok = TK_BAD;
+}
+
+// 不消费当前词法单元，看看下一个是什么
+static token_kind_t lex_peek_next(compiler_t* c) {
+    compiler_t saved = *c;
+    lex(c);
+    token_kind_t next = c->tok;
+    *c = saved;
+    return next;
+}
+
+static void syntax_error(compiler_t* c) {
+    if (c->error) return;
+    c->error = 1;
+    if (c->tok == TK_END) {
+        fprintf(stderr, "myshell: %s: syntax error: operand expected\n", c->src);
+    } else if (c->tok == TK_BAD_NUMBER) {
+        fprintf(stderr, "myshell: %s: value too great for base (error token is \"%s\")\n",
+                c->src, c->src + c->tok_start);
+    } else {
+        fprintf(stderr, "myshell: %s: syntax error in expression (error token is \"%s\")\n",
+                c->src, c->src + c->tok_start);
+    }
+}
+
+// =================================================================
+// == 生成字节码
+// =================================================================
+
+// 每条指令对栈深度的影响（跳转指令按不跳转的路径计算）
+static int stack_effect(opcode_t op) {
+    switch (op) {
+    case OP_PUSH: case OP_LOAD:
+    case OP_PREINC: case OP_PREDEC: case OP_POSTINC: case OP_POSTDEC:
+        return 1;
+    case OP_END: case OP_STORE: case OP_NEG: case OP_NOT: case OP_BNOT: case OP_BOOL: case OP_JMP:
+        return 0;
+    default:
+        return -1; // 二元运算、POP、条件跳转
+    }
+}
+
+static void emit_bytes(compiler_t* c, const void* data, size_t n) {
+    arith_expr_t* ex = c->expr;
+    if (ex->len + n > ex->cap) {
+        ex->cap = ex->cap ? ex->cap * 2 : 32;
+        if (ex->cap < ex->len + n) ex->cap = ex->len + n;
+        ex->code = (uint8_t*)realloc(ex->code, ex->cap);
+    }
+    memcpy(ex->code + ex->len, data, n);
+    ex->len += n;
+}
+
+static void emit(compiler_t* c, opcode_t op) {
+    uint8_t byte = (uint8_t)op;
+    emit_bytes(c, &byte, 1);
+    c->depth += stack_effect(op);
+    if (c->depth > c->expr->max_stack) c->expr->max_stack = c->depth;
+}
+
+static void emit_push(compiler_t* c, long long value) {
+    emit(c, OP_PUSH);
+    emit_bytes(c, &value, sizeof(value));
+}
+
+// 变量名在表达式内去重，指令里只存下标
+static void emit_var(compiler_t* c, opcode_t op, const char* name, size_t len) {
+    arith_expr_t* ex = c->expr;
+    int index = 0;
+    while (index < ex->name_count &&
+           !(strncmp(ex->names[index], name, len) == 0 && ex->names[index][len] == '\0')) {
+        index++;
+    }
+    if (index == ex->name_count) {
+        if (index >= UINT16_MAX) {
+            c->error = 1;
+            return;
+        }
+        ex->names = (char**)realloc(ex->names, sizeof(char*) * (index + 1));
+        ex->names[index] = strndup(name, len);
+        ex->name_count++;
+    }
+    uint16_t operand = (uint16_t)index;
+    emit(c, op);
+    emit_bytes(c, &operand, sizeof(operand));
+}
+
+// 生成一条跳转指令，返回目标地址所在的位置，等目标确定后再用 patch_jump 回填
+static size_t emit_jump(compiler_t* c, opcode_t op) {
+    uint32_t target = 0;
+    emit(c, op);
+    size_t at = c->expr->len;
+    emit_bytes(c, &target, sizeof(target));
+    return at;
+}
+
+static void patch_jump(compiler_t* c, size_t at) {
+    uint32_t target = (uint32_t)c->expr->len;
+    memcpy(c->expr->code + at, &target, sizeof(target));
+}
+
+// =================================================================
+// == 语法分析（按优先级递归下降，边解析边生成字节码）
+// =================================================================
+
+static void parse_comma(compiler_t* c);
+static void parse_assign(compiler_t* c);
+static void parse_unary(compiler_t* c);
+
+static int enter(compiler_t* c) {
+    if (++c->nest > ARITH_MAX_NEST) {
+        if (!c->error) fprintf(stderr, "myshell: %s: expression nested too deeply\n", c->src);
+        c->error = 1;
+    }
+    return !c->error;
+}
+
+static void parse_primary(compiler_t* c) {
+    if (c->tok == TK_NUM) {
+        emit_push(c, c->num);
+        lex(c);
+    } else if (c->tok == TK_NAME) {
+        const char* name = c->name;
+        size_t len = c->name_len;
+        lex(c);
+        if (c->tok == TK_INC || c->tok == TK_DEC) {
+            emit_var(c, c->tok == TK_INC ? OP_POSTINC : OP_POSTDEC, name, len);
+            lex(c);
+        } else {
+            emit_var(c, OP_LOAD, name, len);
+        }
+    } else if (c->tok == TK_LPAREN) {
+        lex(c);
+        parse_comma(c);
+        if (c->error) return;
+        if (c->tok != TK_RPAREN) {
+            syntax_error(c);
+            return;
+        }
+        lex(c);
+    } else {
+        syntax_error(c);
+    }
+}
+
+static void parse_unary(compiler_t* c) {
+    if (!enter(c)) return;
+    token_kind_t tok = c->tok;
+    if ((tok == TK_INC || tok == TK_DEC) && lex_peek_next(c) == TK_NAME) {
+        lex(c);
+        emit_var(c, tok == TK_INC ? OP_PREINC : OP_PREDEC, c->name, c->name_len);
+        lex(c);
+    } else if (tok == TK_ADD || tok == TK_INC) {
+        // 后面不是变量的 ++ 就是两个一元加号
+        lex(c);
+        parse_unary(c);
+    } else if (tok == TK_SUB) {
+        lex(c);
+        parse_unary(c);
+        emit(c, OP_NEG);
+    } else if (tok == TK_DEC) {
+        lex(c);
+        parse_unary(c); // 负负得正
+    } else if (tok == TK_NOT || tok == TK_BNOT) {
+        lex(c);
+        parse_unary(c);
+        emit(c, tok == TK_NOT ? OP_NOT : OP_BNOT);
+    } else {
+        parse_primary(c);
+    }
+    c->nest--;
+}
+
+// 二元运算符：min_prec 以上的运算符在这一层处理
+static void parse_binary(compiler_t* c, int min_prec) {
+    parse_unary(c);
+    while (!c->error && is_binary(c->tok)) {
+        token_kind_t tok = c->tok;
+        int prec = binary_ops[tok - TK_POW].prec;
+        if (prec < min_prec) break;
+        lex(c);
+
+        if (tok == TK_AND || tok == TK_OR) {
+            // 短路：左边已经决定结果时跳过右边
+            emit(c, OP_BOOL);
+            size_t skip = emit_jump(c, tok == TK_AND ? OP_JZ_KEEP : OP_JNZ_KEEP);
+            parse_binary(c, prec + 1);
+            emit(c, OP_BOOL);
+            patch_jump(c, skip);
+        } else {
+            parse_binary(c, tok == TK_POW ? prec : prec + 1); // ** 右结合
+            emit(c, binary_ops[tok - TK_POW].op);
+        }
+    }
+}
+
+static void parse_ternary(compiler_t* c) {
+    parse_binary(c, 1);
+    if (c->error || c->tok != TK_QUEST) return;
+    if (!enter(c)) return;
+    lex(c);
+    size_t to_else = emit_jump(c, OP_JZ);
+    parse_comma(c);
+    size_t to_end = emit_jump(c, OP_JMP);
+    c->depth--; // 两个分支各压入一个值，只算一次
+    if (c->error) return;
+    if (c->tok != TK_COLON) {
+        syntax_error(c);
+        return;
+    }
+    lex(c);
+    patch_jump(c, to_else);
+    parse_assign(c);
+    patch_jump(c, to_end);
+    c->nest--;
+}
+
+static void parse_assign(compiler_t* c) {
+    if (!enter(c)) return;
+    size_t start = c->expr->len;
+    parse_ternary(c);
+    if (!c->error && is_assign(c->tok)) {
+        // 左边必须只是一个变量：它刚被编译成一条 LOAD 指令，撤回这条指令改成赋值
+        uint16_t index;
+        if (c->expr->len != start + 1 + sizeof(index) || c->expr->code[start] != OP_LOAD) {
+            fprintf(stderr, "myshell: %s: attempted assignment to non-variable\n", c->src);
+            c->error = 1;
+            return;
+        }
+        memcpy(&index, c->expr->code + start + 1, sizeof(index));
+        c->expr->len = start;
+        c->depth--;
+
+        token_kind_t tok = c->tok;
+        const char* name = c->expr->names[index];
+        lex(c);
+        if (tok != TK_ASSIGN) emit_var(c, OP_LOAD, name, strlen(name));
+        parse_assign(c); // 右结合：a = b = 1
+        if (tok != TK_ASSIGN) emit(c, assign_op(tok));
+        emit_var(c, OP_STORE, name, strlen(name));
+    }
+    c->nest--;
+}
+
+static void parse_comma(compiler_t* c) {
+    parse_assign(c);
+    while (!c->error && c->tok == TK_COMMA) {
+        lex(c);
+        emit(c, OP_POP);
+        parse_assign(c);
+    }
+}
+
+static void free_expr(arith_expr_t* ex) {
+    for (int i = 0; i < ex->name_count; i++) free(ex->names[i]);
+    free(ex->names);
+    free(ex->code);
+    free(ex->source);
+    free(ex);
+}
+
+/**
+ * @description: 把表达式编译成字节码。空表达式的值是 0
+ * @return {arith_expr_t*} - 编译结果；语法错误时打印信息并返回 NULL
+ */
+static arith_expr_t* compile(const char* src) {
+    arith_expr_t* ex = (arith_expr_t*)calloc(1, sizeof(arith_expr_t));
+    ex->source = strdup(src);
+    compiler_t c = {0};
+    c.src = ex->source;
+    c.expr = ex;
+
+    lex(&c);
+    if (c.tok == TK_END) {
+        emit_push(&c, 0);
+    } else {
+        parse_comma(&c);
+        if (!c.error && c.tok != TK_END) syntax_error(&c);
+    }
+    emit(&c, OP_END);
+    if (c.error) {
+        free_expr(ex);
+        return NULL;
+    }
+    return ex;
+}
+
+// =================================================================
+// == 求值
+// =================================================================
+
+static int evaluate(const char* src, long long* result, int level);
+
+/**
+ * @description: 读取变量的数值。值是整数时直接使用，否则把值当作表达式求值
+ * @return {int} - 成功返回 0，出错返回 -1（已打印错误信息）
+ */
+static int var_value(const char* name, long long* out, int level) {
+    const char* value = get_var(name);
+    if (value == NULL) {
+        *out = 0;
+        return 0;
+    }
+    const char* s = value;
+    while (isspace((unsigned char)*s)) s++;
+    int negative = (*s == '-');
+    if (*s == '-' || *s == '+') s++;
+    size_t len;
+    long long n;
+    if (isdigit((unsigned char)*s) && parse_number(s, &len, &n) == 0) {
+        const char* rest = s + len;
+        while (isspace((unsigned char)*rest)) rest++;
+        if (*rest == '\0') {
+            *out = negative ? (long long)(0ULL - (unsigned long long)n) : n;
+            return 0;
+        }
+    }
+    if (*s == '\0') {
+        *out = 0;
+        return 0;
+    }
+    if (level >= ARITH_MAX_RECURSION) {
+        fprintf(stderr, "myshell: %s: expression recursion level exceeded\n", value);
+        return -1;
+    }
+    return evaluate(value, out, level + 1);
+}
+
+static int store_var(const char* name, long long value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", value);
+    set_var(name, buf);
+    return 0;
+}
+
+// 64 位有符号整数的运算按补码回绕，不触发未定义行为
+static long long wrap_add(long long a, long long b) {
+    return (long long)((unsigned long long)a + (unsigned long long)b);
+}
+
+static long long wrap_sub(long long a, long long b) {
+    return (long long)((unsigned long long)a - (unsigned long long)b);
+}
+
+static long long wrap_mul(long long a, long long b) {
+    return (long long)((unsigned long long)a * (unsigned long long)b);
+}
+
+static long long power(long long base, long long exp) {
+    unsigned long long result = 1, b = (unsigned long long)base;
+    while (exp > 0) {
+        if (exp & 1) result *= b;
+        b *= b;
+        exp >>= 1;
+    }
+    return (long long)result;
+}
+
+/**
+ * @description: 在栈式虚拟机上执行一段字节码
+ * @return {int} - 成功返回 0，运行时错误（除以 0 等）返回 -1
+ */
+static int run(const arith_expr_t* ex, long long* result, int level) {
+    long long inline_stack[ARITH_STACK_INLINE];
+    long long* stack = inline_stack;
+    if (ex->max_stack > ARITH_STACK_INLINE) {
+        stack = (long long*)malloc(sizeof(long long) * ex->max_stack);
+    }
+    int sp = 0;         // 下一个空位
+    size_t pc = 0;
+    int status = 0;
+    const uint8_t* code = ex->code;
+
+    for (;;) {
+        opcode_t op = (opcode_t)code[pc++];
+        uint16_t var;
+        uint32_t target;
+        long long a, b, v;
+
+        switch (op) {
+        case OP_END:
+            *result = stack[sp - 1];
+            goto done;
+        case OP_PUSH:
+            memcpy(&stack[sp++], code + pc, sizeof(long long));
+            pc += sizeof(long long);
+            break;
+        case OP_LOAD:
+            memcpy(&var, code + pc, sizeof(var));
+            pc += sizeof(var);
+            if (var_value(ex->names[var], &stack[sp++], level) < 0) goto fail;
+            break;
+        case OP_STORE:
+            memcpy(&var, code + pc, sizeof(var));
+            pc += sizeof(var);
+            store_var(ex->names[var], stack[sp - 1]);
+            break;
+        case OP_PREINC: case OP_PREDEC: case OP_POSTINC: case OP_POSTDEC:
+            memcpy(&var, code + pc, sizeof(var));
+            pc += sizeof(var);
+            if (var_value(ex->names[var], &v, level) < 0) goto fail;
+            a = wrap_add(v, (op == OP_PREINC || op == OP_POSTINC) ? 1 : -1);
+            store_var(ex->names[var], a);
+            stack[sp++] = (op == OP_PREINC || op == OP_PREDEC) ? a : v;
+            break;
+        case OP_NEG: stack[sp - 1] = wrap_sub(0, stack[sp - 1]); break;
+        case OP_NOT: stack[sp - 1] = !stack[sp - 1]; break;
+        case OP_BNOT: stack[sp - 1] = ~stack[sp - 1]; break;
+        case OP_BOOL: stack[sp - 1] = stack[sp - 1] != 0; break;
+        case OP_POP: sp--; break;
+        case OP_JMP:
+            memcpy(&target, code + pc, sizeof(target));
+            pc = target;
+            break;
+        case OP_JZ:
+            memcpy(&target, code + pc, sizeof(target));
+            pc = (stack[--sp] == 0) ? target : pc + sizeof(target);
+            break;
+        case OP_JZ_KEEP:
+        case OP_JNZ_KEEP:
+            memcpy(&target, code + pc, sizeof(target));
+            if ((stack[sp - 1] == 0) == (op == OP_JZ_KEEP)) {
+                pc = target;
+            } else {
+                sp--;
+                pc += sizeof(target);
+            }
+            break;
+        default:
+            // 二元运算
+            b = stack[--sp];
+            a = stack[sp - 1];
+            switch (op) {
+            case OP_POW:
+                if (b < 0) {
+                    fprintf(stderr, "myshell: %s: exponent less than 0\n", ex->source);
+                    goto fail;
+                }
+                v = power(a, b);
+                break;
+            case OP_MUL: v = wrap_mul(a, b); break;
+            case OP_DIV:
+            case OP_MOD:
+                if (b == 0) {
+                    fprintf(stderr, "myshell: %s: division by zero\n", ex->source);
+                    goto fail;
+                }
+                if (b == -1) v = (op == OP_DIV) ? wrap_sub(0, a) : 0; // LLONG_MIN / -1 会溢出
+                else v = (op == OP_DIV) ? a / b : a % b;
+                break;
+            case OP_ADD: v = wrap_add(a, b); break;
+            case OP_SUB: v = wrap_sub(a, b); break;
+            case OP_SHL: v = (long long)((unsigned long long)a << (b & 63)); break;
+            case OP_SHR: v = a >> (b & 63); break;
+            case OP_LT: v = a < b; break;
+            case OP_LE: v = a <= b; break;
+            case OP_GT: v = a > b; break;
+            case OP_GE: v = a >= b; break;
+            case OP_EQ: v = a == b; break;
+            case OP_NE: v = a != b; break;
+            case OP_BAND: v = a & b; break;
+            case OP_BXOR: v = a ^ b; break;
+            case OP_BOR: v = a | b; break;
+            default: v = 0; break;
+            }
+            stack[sp - 1] = v;
+            break;
+        }
+    }
+
+fail:
+    status = -1;
+done:
+    if (stack != inline_stack) free(stack);
+    return status;
+}
+
+// =================================================================
+// == 编译缓存
+// =================================================================
+
+static unsigned int hash_source(const char* s) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void clear_cache() {
+    for (int i = 0; i < ARITH_CACHE_BUCKETS; i++) {
+        while (cache[i] != NULL) {
+            arith_expr_t* next = cache[i]->next;
+            free_expr(cache[i]);
+            cache[i] = next;
+        }
+    }
+    cache_count = 0;
+}
+
+/**
+ * @description: 编译并求值一个（已经展开过的）表达式
+ * @param {int} level - 递归层数。变量的值被当作表达式求值时 level > 0，
+ *                      这时外层表达式的字节码正在执行，缓存满了也不能清空
+ */
+static int evaluate(const char* src, long long* result, int level) {
+    unsigned int h = hash_source(src);
+    arith_expr_t** bucket = &cache[h % ARITH_CACHE_BUCKETS];
+    for (arith_expr_t** link = bucket; *link != NULL; link = &(*link)->next) {
+        arith_expr_t* ex = *link;
+        if (ex->hash == h && strcmp(ex->source, src) == 0) {
+            // 移到链表头，常用的表达式查得更快
+            *link = ex->next;
+            ex->next = *bucket;
+            *bucket = ex;
+            return run(ex, result, level);
+        }
+    }
+
+    arith_expr_t* ex = compile(src);
+    if (ex == NULL) return -1;
+    ex->hash = h;
+    if (cache_count >= ARITH_CACHE_MAX) {
+        if (level > 0) {
+            int status = run(ex, result, level);
+            free_expr(ex);
+            return status;
+        }
+        clear_cache();
+    }
+    ex->next = *bucket;
+    *bucket = ex;
+    cache_count++;
+    return run(ex, result, level);
+}
+
+// 表达式里是否有需要 Shell 先展开的部分（$name 和 ${name} 由算术模块自己处理）
+static int needs_expansion(const char* s) {
+    for (; *s; s++) {
+        if (*s == '\'' || *s == '\"' || *s == '\\' || *s == '`') return 1;
+        if (*s == '$' && !(isalpha((unsigned char)s[1]) || s[1] == '_' || s[1] == '{')) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @description: 求一个算术表达式的值（$(( )) 和 (( )) 的括号内部）
+ * @param {const char*} expr - 表达式原文，可以含有 $1、"..." 等，先按双引号规则展开
+ * @param {long long*} result - 输出：表达式的值
+ * @return {int} - 成功返回 0，语法错误或运行时错误返回 -1（已打印错误信息）
+ */
+int arith_evaluate(const char* expr, long long* result) {
+    if (!needs_expansion(expr)) return evaluate(expr, result, 0);
+    char* expanded = expand_word_string(expr);
+    int status = evaluate(expanded, result, 0);
+    free(expanded);
+    return status;
+}
+
+/**
+ * @description: 从 $(( 或 (( 之后开始，找到配对的 ))
+ * @param {const char*} s - 表达式的第一个字符
+ * @return {long} - 第一个 ')' 相对 s 的位置；输入在中途结束返回 -1；
+ *                  括号不是以 )) 结束（比如 $( (a) ) 这样的嵌套子 Shell）返回 -2
+ */
+long arith_find_end(const char* s) {
+    int depth = 0;
+    for (long i = 0; s[i] != '\0'; i++) {
+        if (s[i] == '(') {
+            depth++;
+        } else if (s[i] == ')') {
+            if (depth > 0) depth--;
+            else if (s[i + 1] == ')') return i;
+            else return s[i + 1] == '\0' ? -1 : -2;
+        }
+    }
+    return -1;
+}
@@ -4,7 +4,12 @@
  * @FilePath: /linux-shell/src/builtins.c
  * @Descripttion: 内建命令实现模块
  */
+#define _GNU_SOURCE
 #include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 #include <string.h> // 需用到 strcmp, strdup 等函数
 #include <sys/stat.h> // for `type` command
 #include <unistd.h>   // for `access` in `type` command
@@ -23,39 +28,113 @@ const char* builtin_str[] = {
     "type",  // 查看文件类型
     "alias", // alias创建重命名
     "unalias", // unalias删除重命名
+    "true", // 返回成功
+    "false", // 返回失败
+    ":", // 空命令，返回成功
+    "test", // 条件测试
+    "[", // test 的另一种写法
+    "break", // 跳出循环
+    "continue", // 进入下一次循环
+    "return", // 从函数返回
+    "shift", // 左移位置参数
+    "export", // 导出环境变量
+    "unset", // 删除变量或函数
+    "run", // 设置 CPU 亲和性、优先级等后执行命令
+    "memo", // 缓存命令输出
+    "jobs", // 列出捕获了输出的后台任务
+    "joblog", // 查看并跟随后台任务的输出
+    "read", // 从标准输入读一行到变量
+    "mapfile", // 把输入的所有行读到位置参数
+    "coproc", // 启动常驻的协同进程
+    "cosend", // 给协同进程发一条请求
+    "coread", // 读协同进程的一条回复
     "exit" // 退出程序
 };
 
 // 内建命令对应的函数指针数组
-void (*builtin_func[])(char**) = {
+int (*builtin_func[])(char**) = {
     &builtin_cd,
     &builtin_echo,
     &builtin_history,
     &builtin_type,
     &builtin_alias,
     &builtin_unalias,
-    // exit 是特殊情况，直接在 handle 中处理
+    &builtin_true,
+    &builtin_false,
+    &builtin_true,
+    &builtin_test,
+    &builtin_test,
+    &builtin_break,
+    &builtin_continue,
+    &builtin_return,
+    &builtin_shift,
+    &builtin_export,
+    &builtin_unset,
+    &builtin_run,
+    &builtin_memo,
+    &builtin_jobs,
+    &builtin_joblog,
+    &builtin_read,
+    &builtin_mapfile,
+    &builtin_coproc,
+    &builtin_cosend,
+    &builtin_coread,
+    &builtin_exit,
 };
 
 int num_builtins() {
     return sizeof(builtin_str) / sizeof(char*);
 }
 
-// 总处理器，检查命令是否是内建命令并执行
-int handle_builtin_command(command_t* cmd) {
-    if (strcmp(cmd->args[0], "exit") == 0) {
-        exit(EXIT_SUCCESS);
+/**
+ * @description: 判断一个名字是不是内建命令
+ */
+int is_builtin(const char* name) {
+    for (int i = 0; i < num_builtins(); i++) {
+        if (strcmp(name, builtin_str[i]) == 0) {
+            return 1;
+        }
     }
+    return 0;
+}
 
+/**
+ * @description: 判断内建命令是否只修改 Shell 内部状态（没有输出、不影响文件系统和工作目录）。
+ * 只执行过这类命令的 rc 文件可以用启动快照代替
+ */
+int is_pure_builtin(const char* name) {
+    static const char* pure[] = {
+        "alias", "unalias", "export", "unset", "true", "false", ":", "test", "[",
+        "shift", "break", "continue", "return", NULL
+    };
+    for (int i = 0; pure[i] != NULL; i++) {
+        if (strcmp(name, pure[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @description: 执行一个内建命令（调用前需确认 is_builtin）
+ * @return {int} - 内建命令的退出码
+ */
+int run_builtin(char** args) {
     for (int i = 0; i < num_builtins(); i++) {
-        if (strcmp(cmd->args[0], builtin_str[i]) == 0) {
-            (*builtin_func[i])(cmd->args);
-            // ‼️
-            return 1; // 找到了并执行了内建命令
+        if (strcmp(args[0], builtin_str[i]) == 0) {
+            return (*builtin_func[i])(args);
         }
     }
+    return 127;
+}
+
+// 总处理器，检查命令是否是内建命令并执行
+int handle_builtin_command(command_t* cmd) {
+    if (!is_builtin(cmd->args[0])) {
+        // ‼️
+        return 0; // 不是内建命令
+    }
+    last_exit_status = run_builtin(cmd->args);
     // ‼️
-    return 0; // 不是内建命令
+    return 1; // 找到了并执行了内建命令
 }
 
 
@@ -63,37 +142,44 @@ int handle_builtin_command(command_t* cmd) {
 // =================================================================
 // == cd和echo的具体实现
 // =================================================================
-void builtin_cd(char** args) {
+int builtin_cd(char** args) {
+    if (args[1] != NULL && strcmp(args[1], "-j") == 0) {
+        return dirs_jump(args + 2); // 按访问记录跳转，见 frecency.c
+    }
     if (args[1] == NULL) {
         // 如果没有参数，则切换到 HOME 目录
-        char* home = getenv("HOME");
+        const char* home = get_var("HOME");
         if (home == NULL) {
             fprintf(stderr, "cd: HOME not set\n");
+            return 1;
         } else if (chdir(home) != 0) {
             perror("cd");
+            return 1;
         }
     } else {
         if (chdir(args[1]) != 0) {
             perror("cd");
+            return 1;
         }
     }
+    dirs_record_cwd();
+    return 0;
 }
 
-void builtin_echo(char** args) {
+// $VAR 已经在执行前由 expand.c 展开，这里只负责输出
+int builtin_echo(char** args) {
     int i = 1;
-    while (args[i] != NULL) {
-        // 处理环境变量
-        if (args[i][0] == '$') {
-            char* var = getenv(args[i] + 1);
-            if (var) {
-                printf("%s ", var);
-            }
-        } else {
-            printf("%s ", args[i]);
-        }
+    int newline = 1;
+    if (args[1] != NULL && strcmp(args[1], "-n") == 0) {
+        newline = 0;
         i++;
     }
-    printf("\n");
+    for (int first = i; args[i] != NULL; i++) {
+        if (i > first) putchar(' ');
+        fputs(args[i], stdout);
+    }
+    if (newline) putchar('\n');
+    return 0;
 }
 
 // =================================================================
@@ -136,7 +222,7 @@ void add_to_history(const char* cmd) {
  * 3. `history -c` - 清空当前会话的历史记录
  * @param {char**} args - 命令的参数列表
  */
-void builtin_history(char** args) {
+int builtin_history(char** args) {
     // --- 情况1: `history -c` (清空历史) ---
     if (args[1] != NULL && strcmp(args[1], "-c") == 0) {
         
@@ -156,7 +242,7 @@ void builtin_history(char** args) {
         // 可以选择打印一条提示信息
         // printf("History has been cleared.\n"); 
         
-        return; // 完成操作，直接返回
+        return 0; // 完成操作，直接返回
     }
 
     // --- 情况2: `history n` (显示最近n条) ---
@@ -165,7 +251,7 @@ void builtin_history(char** args) {
         n_to_display = atoi(args[1]); // atoi 会将非数字字符串转为0
         if (n_to_display <= 0) {
             fprintf(stderr, "myshell: history: %s: numeric argument required\n", args[1]);
-            return;
+            return 1;
         }
     }
 
@@ -184,6 +270,7 @@ void builtin_history(char** args) {
     for (int i = start_point; i < history_count; i++) {
         printf("%5d  %s\n", i + 1, history[i % HIST_SIZE]);
     }
+    return 0;
 }
 
 // =================================================================
@@ -234,13 +321,24 @@ static void set_alias(const char* name, const char* command) {
     alias_list_head = new_alias;
 }
 
+/**
+ * @description: 对外提供的别名接口，供启动快照保存和恢复别名表
+ */
+const Alias* get_alias_list() {
+    return alias_list_head;
+}
+
+void define_alias(const char* name, const char* command) {
+    set_alias(name, command);
+}
+
 /**
  * @description: 取消一个别名
  */
-void builtin_unalias(char** args) {
+int builtin_unalias(char** args) {
     if (args[1] == NULL) {
         fprintf(stderr, "unalias: usage: unalias name\n");
-        return;
+        return 2;
     }
 
     Alias* current = alias_list_head;
@@ -256,31 +354,37 @@ void builtin_unalias(char** args) {
             free(current->name);
             free(current->command);
             free(current);
-            return;
+            return 0;
         }
         prev = current;
         current = current->next;
     }
+    fprintf(stderr, "myshell: unalias: %s: not found\n", args[1]);
+    return 1;
 }
 
 /**
  * @description: `alias` 命令的具体实现
  */
-void builtin_alias(char** args) {
+int builtin_alias(char** args) {
     if (args[1] == NULL) {
         // 情况1: 只输入 `alias`，打印所有别名
         for (Alias* current = alias_list_head; current != NULL; current = current->next) {
             printf("alias %s='%s'\n", current->name, current->command);
         }
-        return;
+        return 0;
     }
 
     // --- 新增的修复逻辑：将所有参数重新拼接成一个字符串 ---
     char full_arg[MAX_CMD_LEN] = {0}; // 使用一个足够大的缓冲区
-    strcpy(full_arg, args[1]);
-    for (int i = 2; args[i] != NULL; i++) {
-        strcat(full_arg, " "); // 用空格重新连接
-        strcat(full_arg, args[i]);
+    size_t len = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        // 超长的参数会被截断，不能写出缓冲区
+        len += snprintf(full_arg + len, sizeof(full_arg) - len, i > 1 ? " %s" : "%s", args[i]);
+        if (len >= sizeof(full_arg)) {
+            fprintf(stderr, "myshell: alias: definition too long\n");
+            return 1;
+        }
     }
     // 此时，full_arg 的内容是 "ll='ls -alF'"，正是我们需要的！
     // -----------------------------------------------------
@@ -306,8 +410,10 @@ void builtin_alias(char** args) {
             printf("alias %s='%s'\n", args[1], existing_command);
         } else {
             fprintf(stderr, "myshell: alias: %s: not found\n", args[1]);
+            return 1;
         }
     }
+    return 0;
 }
 
 /**
@@ -373,9 +479,9 @@ char* expand_alias(char* line) {
 // =================================================================
 // == type的具体实现
 // =================================================================
-void builtin_type(char** args) {
+int builtin_type(char** args) {
     if (args[1] == NULL) {
-        return; // 参数不足
+        return 0; // 参数不足
     }
 
     char* cmd_name = args[1];
@@ -384,23 +490,26 @@ void builtin_type(char** args) {
     char* alias_cmd = lookup_alias(cmd_name);
     if (alias_cmd) {
         printf("%s is an alias for '%s'\n", cmd_name, alias_cmd);
-        return;
+        return 0;
     }
 
-    // 2. 检查是不是内建命令 (需要在列表中加入 unalias)
-    const char* local_builtin_str[] = {"cd", "echo", "history", "type", "alias", "exit", "unalias"};
-    for (int i = 0; i < sizeof(local_builtin_str)/sizeof(char*); i++) {
-        if (strcmp(cmd_name, local_builtin_str[i]) == 0) {
-            printf("%s is a shell builtin\n", cmd_name);
-            return;
-        }
+    // 2. 检查是不是函数
+    if (lookup_function(cmd_name) != NULL) {
+        printf("%s is a function\n", cmd_name);
+        return 0;
+    }
+
+    // 3. 检查是不是内建命令
+    if (is_builtin(cmd_name)) {
+        printf("%s is a shell builtin\n", cmd_name);
+        return 0;
     }
 
-    // 3. 检查是不是外部命令 (在 PATH 中查找)
+    // 4. 检查是不是外部命令 (在 PATH 中查找)
     char* path_env = getenv("PATH");
     if (path_env == NULL) {
         fprintf(stderr, "type: %s: not found\n", cmd_name);
-        return;
+        return 1;
     }
 
     char* path_copy = strdup(path_env);
@@ -413,13 +522,15 @@ void builtin_type(char** args) {
         if (access(full_path, X_OK) == 0) {
             printf("%s is %s\n", cmd_name, full_path);
             free(path_copy);
-            return;
+            return 0;
         }
         dir = strtok(NULL, ":");
     }
     
     free(path_copy);
     fprintf(stderr, "type: %s: not found\n", cmd_name);
+    report_command_not_found(cmd_name); // 拼写建议
+    return 1;
 }
 
 
@@ -447,3 +558,696 @@ const char* get_history_entry(int index) {
     // 使用取余运算从环形缓冲区中获取正确的条目
     return history[index % HIST_SIZE];
 }
+
+
+
+// =================================================================
+// == 流程控制相关的内建命令: true/false/test/break/continue/return/shift/exit
+// =================================================================
+
+int builtin_true(char** args) {
+    return 0;
+}
+
+int builtin_false(char** args) {
+    return 1;
+}
+
+// 解析 break/continue/return/exit/shift 的可选数字参数
+static int numeric_arg(char** args, int default_value, int* out) {
+    if (args[1] == NULL) {
+        *out = default_value;
+        return 0;
+    }
+    char* end;
+    long value = strtol(args[1], &end, 10);
+    if (*args[1] == '\0' || *end != '\0') {
+        fprintf(stderr, "myshell: %s: %s: numeric argument required\n", args[0], args[1]);
+        return -1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+// test 的一元文件测试
+static int test_file(const char* op, const char* path) {
+    struct stat st;
+    if (strcmp(op, "-r") == 0) return access(path, R_OK) == 0;
+    if (strcmp(op, "-w") == 0) return access(path, W_OK) == 0;
+    if (strcmp(op, "-x") == 0) return access(path, X_OK) == 0;
+    if (stat(path, &st) != 0) return 0;
+    if (strcmp(op, "-e") == 0) return 1;
+    if (strcmp(op, "-f") == 0) return S_ISREG(st.st_mode);
+    if (strcmp(op, "-d") == 0) return S_ISDIR(st.st_mode);
+    if (strcmp(op, "-s") == 0) return st.st_size > 0;
+    return -1;
+}
+
+/**
+ * @description: 计算 test 表达式，支持 ! 取反、一元文件/字符串测试和二元比较
+ * @return {int} - 1 为真，0 为假，-1 为语法错误
+ */
+static int eval_test(char** argv, int argc) {
+    if (argc == 0) return 0;
+    if (strcmp(argv[0], "!") == 0) {
+        int r = eval_test(argv + 1, argc - 1);
+        return r < 0 ? r : !r;
+    }
+    if (argc == 1) return argv[0][0] != '\0';
+    if (argc == 2) {
+        if (strcmp(argv[0], "-n") == 0) return argv[1][0] != '\0';
+        if (strcmp(argv[0], "-z") == 0) return argv[1][0] == '\0';
+        return test_file(argv[0], argv[1]);
+    }
+    if (argc == 3) {
+        const char* op = argv[1];
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(argv[0], argv[2]) == 0;
+        if (strcmp(op, "!=") == 0) return strcmp(argv[0], argv[2]) != 0;
+
+        long a = strtol(argv[0], NULL, 10);
+        long b = strtol(argv[2], NULL, 10);
+        if (strcmp(op, "-eq") == 0) return a == b;
+        if (strcmp(op, "-ne") == 0) return a != b;
+        if (strcmp(op, "-lt") == 0) return a < b;
+        if (strcmp(op, "-le") == 0) return a <= b;
+        if (strcmp(op, "-gt") == 0) return a > b;
+        if (strcmp(op, "-ge") == 0) return a >= b;
+    }
+    return -1;
+}
+
+/**
+ * @description: `test expr` 和 `[ expr ]` 的实现
+ */
+int builtin_test(char** args) {
+    int argc = 0;
+    while (args[argc] != NULL) argc++;
+
+    if (strcmp(args[0], "[") == 0) {
+        if (strcmp(args[argc - 1], "]") != 0) {
+            fprintf(stderr, "myshell: [: missing `]'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    int r = eval_test(args + 1, argc - 1);
+    if (r < 0) {
+        fprintf(stderr, "myshell: %s: syntax error\n", args[0]);
+        return 2;
+    }
+    return r ? 0 : 1;
+}
+
+int builtin_break(char** args) {
+    int n;
+    if (numeric_arg(args, 1, &n) < 0 || n < 1) return 1;
+    if (loop_depth == 0) {
+        fprintf(stderr, "myshell: %s: only meaningful in a loop\n", args[0]);
+        return 0;
+    }
+    pending_break = (n > loop_depth) ? loop_depth : n;
+    return 0;
+}
+
+int builtin_continue(char** args) {
+    int n;
+    if (numeric_arg(args, 1, &n) < 0 || n < 1) return 1;
+    if (loop_depth == 0) {
+        fprintf(stderr, "myshell: %s: only meaningful in a loop\n", args[0]);
+        return 0;
+    }
+    pending_continue = (n > loop_depth) ? loop_depth : n;
+    return 0;
+}
+
+int builtin_return(char** args) {
+    int n;
+    if (numeric_arg(args, last_exit_status, &n) < 0) return 2;
+    if (function_depth == 0) {
+        fprintf(stderr, "myshell: return: can only `return' from a function\n");
+        return 1;
+    }
+    pending_return = 1;
+    return n & 0xff;
+}
+
+int builtin_shift(char** args) {
+    int n;
+    if (numeric_arg(args, 1, &n) < 0) return 1;
+    if (shift_positional_params(n) < 0) {
+        fprintf(stderr, "myshell: shift: %s: shift count out of range\n", args[1] ? args[1] : "1");
+        return 1;
+    }
+    return 0;
+}
+
+int builtin_exit(char** args) {
+    int n;
+    if (numeric_arg(args, last_exit_status, &n) < 0) n = 2;
+    fflush(stdout);
+    exit(n & 0xff);
+}
+
+// =================================================================
+// == 变量相关的内建命令: export/unset
+// =================================================================
+
+/**
+ * @description: `export NAME[=value] ...`，不带参数时列出所有环境变量
+ */
+int builtin_export(char** args) {
+    extern char** environ;
+    if (args[1] == NULL) {
+        for (char** env = environ; *env != NULL; env++) {
+            printf("export %s\n", *env);
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        char* eq = strchr(args[i], '=');
+        size_t len = eq ? (size_t)(eq - args[i]) : strlen(args[i]);
+        if (!is_valid_name(args[i], len)) {
+            fprintf(stderr, "myshell: export: `%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        if (eq) {
+            *eq = '\0';
+            set_var(args[i], eq + 1);
+            export_var(args[i]);
+            *eq = '=';
+        } else {
+            export_var(args[i]);
+        }
+    }
+    return status;
+}
+
+/**
+ * @description: `unset [-f|-v] name ...`
+ */
+int builtin_unset(char** args) {
+    int i = 1;
+    int functions_only = 0, vars_only = 0;
+    if (args[1] != NULL && strcmp(args[1], "-f") == 0) { functions_only = 1; i++; }
+    else if (args[1] != NULL && strcmp(args[1], "-v") == 0) { vars_only = 1; i++; }
+
+    for (; args[i] != NULL; i++) {
+        if (!functions_only && (vars_only || get_var(args[i]) != NULL || lookup_function(args[i]) == NULL)) {
+            unset_var(args[i]);
+        } else {
+            remove_function(args[i]);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @description: `run` 前缀由执行器在 fork 前处理（见 runattrs.c），
+ * 只有在没有跟命令时才会走到这里
+ */
+int builtin_run(char** args) {
+    fprintf(stderr, "myshell: run: usage: " RUN_USAGE "\n");
+    return 2;
+}
+
+// =================================================================
+// == read 和 mapfile：带预读缓冲区的按行读取
+// =================================================================
+
+// 读一行时不能读过头：多读的数据如果留在 Shell 里，之后启动的子进程（或下一次重定向）
+// 就读不到它们了。bash 在管道上因此每次只读一个字节。这里每个 fd 有一个预读缓冲区：
+//   普通文件：用 pread 一次读 64K，命令结束前把文件偏移 lseek 到实际用掉的位置；
+//   管道：用 tee() 把管道里的数据复制到一个私有管道再读出来，原管道中的数据不被消费，
+//         命令结束前再从原管道读走用掉的那部分（不依赖 MSG_PEEK，它只对套接字有效）；
+//   终端、套接字等：每次读一个字节。
+// 所以每条 read/mapfile 结束时 fd 的位置和逐字节读取时完全一致。
+// 子进程可能在两次 read 之间读走数据，fork、孵化器启动命令和输入重定向都会让缓冲区失效；
+// 失效后普通文件只要偏移没变就继续使用缓冲区，管道丢掉预读的数据（它们还在管道里，重新 tee 即可）。
+
+#define READ_BUF_SIZE 65536
+#define READ_MAX_FD 256         // 更大的 fd 不做预读，逐字节读取
+#define READ_TIMEOUT_STATUS 142 // -t 超时的退出码（128 + SIGALRM，和 bash 相同）
+
+typedef enum { RB_OTHER, RB_FILE, RB_PIPE } read_kind_t;
+
+typedef struct {
+    read_kind_t kind;
+    char* data;
+    size_t start;           // 下一个未消费的字节
+    size_t end;             // 有效数据的结尾
+    off_t file_pos;         // RB_FILE：data[0] 在文件中的偏移
+    off_t synced_pos;       // RB_FILE：上次 lseek 到的位置
+    dev_t dev;              // RB_FILE：缓冲区对应的文件
+    ino_t ino;
+    size_t drained;         // RB_PIPE：data 中已经从原管道读走的字节数
+    int peek[2];            // RB_PIPE：tee 的目标管道
+    unsigned int generation;
+} read_buf_t;
+
+static read_buf_t* read_bufs[READ_MAX_FD];
+static unsigned int read_generation = 1;
+
+/**
+ * @description: 让所有预读缓冲区失效。fd 可能被别的进程读过或者换成了别的文件时调用
+ */
+void invalidate_read_buffers() {
+    read_generation++;
+}
+
+/**
+ * @description: 取 fd 的预读缓冲区，失效的缓冲区在这里重新检查
+ * @return {read_buf_t*} - 不能预读的 fd（终端、套接字等）返回 NULL
+ */
+static read_buf_t* get_read_buf(int fd) {
+    static int atfork_registered = 0;
+    if (!atfork_registered) {
+        // 任何 fork 之后子进程都可能读这个 fd
+        pthread_atfork(invalidate_read_buffers, NULL, NULL);
+        atfork_registered = 1;
+    }
+    if (fd < 0 || fd >= READ_MAX_FD) return NULL;
+
+    read_buf_t* rb = read_bufs[fd];
+    if (rb == NULL) {
+        rb = (read_buf_t*)calloc(1, sizeof(read_buf_t));
+        rb->peek[0] = rb->peek[1] = -1;
+        read_bufs[fd] = rb;
+    }
+    if (rb->generation == read_generation) return rb->kind == RB_OTHER ? NULL : rb;
+    rb->generation = read_generation;
+
+    struct stat st;
+    read_kind_t kind = RB_OTHER;
+    off_t pos = -1;
+    if (fstat(fd, &st) == 0) {
+        if (S_ISREG(st.st_mode) && (pos = lseek(fd, 0, SEEK_CUR)) >= 0) kind = RB_FILE;
+        else if (S_ISFIFO(st.st_mode)) kind = RB_PIPE;
+    }
+
+    // 同一个文件、偏移正好停在上次用到的位置：缓冲区里的数据仍然有效
+    int keep = kind == RB_FILE && rb->kind == RB_FILE && rb->dev == st.st_dev &&
+               rb->ino == st.st_ino && pos == rb->file_pos + (off_t)rb->start;
+    if (!keep) {
+        rb->start = rb->end = rb->drained = 0;
+        rb->file_pos = rb->synced_pos = pos;
+        rb->dev = st.st_dev;
+        rb->ino = st.st_ino;
+    }
+    if (kind != RB_PIPE && rb->peek[0] >= 0) {
+        close(rb->peek[0]);
+        close(rb->peek[1]);
+        rb->peek[0] = rb->peek[1] = -1;
+    }
+    if (kind == RB_PIPE && rb->peek[0] < 0 && pipe2(rb->peek, O_CLOEXEC) < 0) kind = RB_OTHER;
+    if (kind != RB_OTHER && rb->data == NULL) rb->data = (char*)malloc(READ_BUF_SIZE);
+    rb->kind = kind;
+    return kind == RB_OTHER ? NULL : rb;
+}
+
+/**
+ * @description: 让 fd 的位置和已经消费的数据一致：文件 lseek 到逻辑位置，管道读走用掉的字节
+ * @return {int} - 成功返回 0，出错返回 -1
+ */
+static int sync_read_buf(read_buf_t* rb, int fd) {
+    if (rb == NULL) return 0;
+    if (rb->kind == RB_FILE) {
+        off_t pos = rb->file_pos + rb->start;
+        if (pos == rb->synced_pos) return 0;
+        if (lseek(fd, pos, SEEK_SET) < 0) return -1;
+        rb->synced_pos = pos;
+        return 0;
+    }
+    while (rb->drained < rb->start) {
+        // 读回到原来的位置，内容和 tee 复制出来的相同
+        ssize_t n = read(fd, rb->data + rb->drained, rb->start - rb->drained);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        rb->drained += n;
+    }
+    return 0;
+}
+
+// 等待 fd 可读，deadline 为 0 表示不限时。超时返回 0，按下 Ctrl+C 返回 -1
+static int wait_readable(int fd, double deadline) {
+    if (deadline <= 0) return 1;
+    for (;;) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double left = deadline - (now.tv_sec + now.tv_nsec / 1e9);
+        if (left <= 0) return 0;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int r = poll(&pfd, 1, (int)(left * 1000) + 1);
+        if (r > 0) return 1;
+        if (r < 0 && errno == EINTR && interrupted) return -1;
+        if (r < 0 && errno != EINTR) return 1; // 交给 read 报告错误
+    }
+}
+
+/**
+ * @description: 缓冲区用完后再预读一块（调用时 start == end）
+ * @return {ssize_t} - 读到的字节数，0 表示输入结束，-1 表示出错，-2 表示超时，-3 表示按下了 Ctrl+C
+ */
+static ssize_t fill_read_buf(read_buf_t* rb, int fd, double deadline) {
+    ssize_t n;
+    if (rb->kind == RB_FILE) {
+        rb->file_pos += rb->end;
+        rb->start = rb->end = 0;
+        while ((n = pread(fd, rb->data, READ_BUF_SIZE, rb->file_pos)) < 0 && errno == EINTR) {}
+        if (n > 0) rb->end = n;
+        return n;
+    }
+
+    // 管道：先读走已经用掉的数据，原管道的开头就是下一个未消费的字节
+    if (sync_read_buf(rb, fd) < 0) return -1;
+    rb->start = rb->end = rb->drained = 0;
+    int ready = wait_readable(fd, deadline);
+    if (ready <= 0) return ready == 0 ? -2 : -3;
+    while ((n = tee(fd, rb->peek[1], READ_BUF_SIZE, 0)) < 0 && errno == EINTR && !interrupted) {}
+    if (n < 0 && errno == EINTR) return -3;
+    if (n <= 0) return n;
+    size_t got = 0;
+    while (got < (size_t)n) {
+        ssize_t r = read(rb->peek[0], rb->data + got, n - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        got += r;
+    }
+    rb->end = n;
+    return n;
+}
+
+// 读到的一条记录。escaped[i] 标记 data[i] 是否由反斜杠转义（转义的字符不参与分词）
+typedef struct {
+    char* data;
+    char* escaped;
+    size_t len;
+    size_t cap;
+} record_t;
+
+static void record_put(record_t* rec, const char* s, size_t n, int escaped) {
+    if (rec->len + n + 1 > rec->cap) {
+        while (rec->len + n + 1 > rec->cap) rec->cap = rec->cap ? rec->cap * 2 : 256;
+        rec->data = (char*)realloc(rec->data, rec->cap);
+        rec->escaped = (char*)realloc(rec->escaped, rec->cap);
+    }
+    memcpy(rec->data + rec->len, s, n);
+    memset(rec->escaped + rec->len, escaped, n);
+    rec->len += n;
+    rec->data[rec->len] = '\0';
+}
+
+// read/mapfile 的选项
+typedef struct {
+    int fd;
+    int delim;          // 记录的分隔符
+    int raw;            // -r：反斜杠没有特殊含义
+    long max_chars;     // -n：最多读几个字符，-1 表示不限
+    double deadline;    // -t：截止时间（CLOCK_MONOTONIC 秒），0 表示不限时
+} read_opts_t;
+
+/**
+ * @description: 从 fd 读一条以 delim 结尾的记录（不含 delim）。没有 -r 时 \x 得到 x，\ 加换行是续行
+ * @return {int} - 读到分隔符返回 0，输入结束返回 1，超时返回 -2，出错返回 -1，按下 Ctrl+C 返回 -3
+ */
+static int read_record(read_buf_t* rb, const read_opts_t* o, record_t* rec) {
+    rec->len = 0;
+    long chars = 0;
+    int pending_escape = 0;
+
+    for (;;) {
+        if (o->max_chars >= 0 && chars >= o->max_chars) return 0;
+
+        // 取一个字节：有缓冲区时从缓冲区取，否则直接读一个字节
+        char c;
+        if (rb != NULL) {
+            if (rb->start == rb->end) {
+                ssize_t n = fill_read_buf(rb, o->fd, o->deadline);
+                if (n == 0) return 1;
+                if (n < 0) return (int)n;
+            }
+            // 快速路径：-r 且不限字符数时整段复制到分隔符为止
+            if (o->raw && o->max_chars < 0) {
+                char* begin = rb->data + rb->start;
+                char* hit = (char*)memchr(begin, o->delim, rb->end - rb->start);
+                size_t n = hit ? (size_t)(hit - begin) : rb->end - rb->start;
+                record_put(rec, begin, n, 0);
+                rb->start += n + (hit != NULL);
+                if (hit) return 0;
+                continue;
+            }
+            c = rb->data[rb->start++];
+        } else {
+            int ready = wait_readable(o->fd, o->deadline);
+            if (ready <= 0) return ready == 0 ? -2 : -3;
+            ssize_t n;
+            while ((n = read(o->fd, &c, 1)) < 0 && errno == EINTR && !interrupted) {}
+            if (n == 0) return 1;
+            if (n < 0) return errno == EINTR ? -3 : -1;
+        }
+
+        if (pending_escape) {
+            pending_escape = 0;
+            if (c == '\n') continue; // 续行
+            record_put(rec, &c, 1, 1);
+            chars++;
+        } else if (c == (char)o->delim) {
+            return 0;
+        } else if (c == '\\' && !o->raw) {
+            pending_escape = 1;
+        } else {
+            record_put(rec, &c, 1, 0);
+            chars++;
+        }
+    }
+}
+
+static int is_ifs_char(const char* ifs, const record_t* rec, size_t i) {
+    return !rec->escaped[i] && rec->data[i] != '\0' && strchr(ifs, rec->data[i]) != NULL;
+}
+
+static int is_ifs_space(const char* ifs, const record_t* rec, size_t i) {
+    char c = rec->data[i];
+    return (c == ' ' || c == '\t' || c == '\n') && is_ifs_char(ifs, rec, i);
+}
+
+/**
+ * @description: 按 IFS 把记录分给各个变量，最后一个变量得到剩下的全部内容
+ */
+static void assign_fields(char** names, int count, const record_t* rec) {
+    const char* ifs = get_var("IFS");
+    if (ifs == NULL) ifs = " \t\n";
+    size_t i = 0, len = rec->len;
+
+    while (i < len && is_ifs_space(ifs, rec, i)) i++;
+    for (int k = 0; k < count; k++) {
+        size_t start = i;
+        if (k == count - 1) {
+            size_t end = len;
+            while (end > start && is_ifs_space(ifs, rec, end - 1)) end--;
+            char* value = strndup(rec->data + start, end - start);
+            set_var(names[k], value);
+            free(value);
+            break;
+        }
+        while (i < len && !is_ifs_char(ifs, rec, i)) i++;
+        char* value = strndup(rec->data + start, i - start);
+        set_var(names[k], value);
+        free(value);
+
+        // 分隔符：空白，最多一个非空白的 IFS 字符，再跟空白
+        while (i < len && is_ifs_space(ifs, rec, i)) i++;
+        if (i < len && is_ifs_char(ifs, rec, i)) {
+            i++;
+            while (i < len && is_ifs_space(ifs, rec, i)) i++;
+        }
+    }
+}
+
+// 选项的参数：紧跟在选项字母后面，或者是下一个参数
+static const char* option_value(char** args, int* i, const char* rest, const char* cmd, char opt) {
+    if (*rest != '\0') return rest;
+    if (args[*i + 1] == NULL) {
+        fprintf(stderr, "myshell: %s: -%c: option requires an argument\n", cmd, opt);
+        return NULL;
+    }
+    return args[++*i];
+}
+
+static int parse_count(const char* s, long* out) {
+    char* end;
+    long value = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || value < 0) return -1;
+    *out = value;
+    return 0;
+}
+
+/**
+ * @description: 解析 read/mapfile 共有的选项，accept 是这个命令接受的选项字母
+ * @param {long*} count - mapfile 的 -n（读几行）；read 的 -n 写入 o->max_chars
+ * @param {int*} first_name - 输出：第一个非选项参数的下标
+ * @return {int} - 成功返回 0，用法错误返回 -1（已打印）
+ */
+static int parse_read_options(char** args, const char* accept, read_opts_t* o, long* count,
+                              long* skip, int* strip, double* timeout, int* first_name) {
+    const char* cmd = args[0];
+    int i = 1;
+    for (; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char* p = args[i] + 1; *p != '\0'; p++) {
+            char opt = *p;
+            if (strchr(accept, opt) == NULL) {
+                fprintf(stderr, "myshell: %s: -%c: invalid option\n", cmd, opt);
+                return -1;
+            }
+            if (opt == 'r') { o->raw = 1; continue; }
+            if (opt == 't' && strip != NULL) { *strip = 1; continue; } // mapfile -t
+            const char* value = option_value(args, &i, p + 1, cmd, opt);
+            if (value == NULL) return -1;
+            long n;
+            switch (opt) {
+            case 'd':
+                o->delim = (unsigned char)value[0]; // -d '' 表示以 NUL 分隔
+                break;
+            case 'n':
+            case 's':
+                if (parse_count(value, &n) < 0) {
+                    fprintf(stderr, "myshell: %s: %s: invalid number\n", cmd, value);
+                    return -1;
+                }
+                if (opt == 's') *skip = n;
+                else if (count != NULL) *count = n;
+                else o->max_chars = n;
+                break;
+            case 't':
+                if (parse_duration(value, timeout) < 0) {
+                    fprintf(stderr, "myshell: %s: %s: invalid timeout specification\n", cmd, value);
+                    return -1;
+                }
+                break;
+            case 'u':
+                if (parse_count(value, &n) < 0 || fcntl((int)n, F_GETFD) < 0) {
+                    fprintf(stderr, "myshell: %s: %s: invalid file descriptor\n", cmd, value);
+                    return -1;
+                }
+                o->fd = (int)n;
+                break;
+            }
+            break; // 带参数的选项占用了这个参数剩下的部分
+        }
+    }
+    *first_name = i;
+    return 0;
+}
+
+static double deadline_after(double seconds) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9 + seconds;
+}
+
+/**
+ * @description: `read [-r] [-d 分隔符] [-n 字符数] [-t 时限] [-u fd] [变量名 ...]`
+ * 没有变量名时整行（不去掉空白）存入 REPLY
+ * @return {int} - 读到分隔符返回 0；输入结束返回 1（读到的部分仍然赋值）；超时返回 142；
+ * 按下 Ctrl+C 返回 130，变量不变
+ */
+int builtin_read(char** args) {
+    read_opts_t o = {STDIN_FILENO, '\n', 0, -1, 0};
+    double timeout = -1;
+    int first;
+    if (parse_read_options(args, "rdntu", &o, NULL, NULL, NULL, &timeout, &first) < 0) return 2;
+
+    char* reply[] = {"REPLY", NULL};
+    char** names = args[first] != NULL ? args + first : reply;
+    int count = 0;
+    for (; names[count] != NULL; count++) {
+        if (!is_valid_name(names[count], strlen(names[count]))) {
+            fprintf(stderr, "myshell: read: `%s': not a valid identifier\n", names[count]);
+            return 1;
+        }
+    }
+
+    read_buf_t* rb = get_read_buf(o.fd);
+    if (timeout == 0) {
+        // -t 0 只检查有没有输入可读，不读取
+        if (rb != NULL && (rb->start < rb->end || rb->kind == RB_FILE)) return 0;
+        struct pollfd pfd = {o.fd, POLLIN, 0};
+        return poll(&pfd, 1, 0) > 0 ? 0 : 1;
+    }
+    if (timeout > 0) o.deadline = deadline_after(timeout);
+
+    fflush(stdout);
+    record_t rec = {0};
+    record_put(&rec, "", 0, 0);
+    int r = read_record(rb, &o, &rec);
+    if (sync_read_buf(rb, o.fd) < 0 && r >= 0) r = -1;
+    if (r == -1) fprintf(stderr, "myshell: read: read error: %s\n", strerror(errno));
+    if (r == -3) {
+        free(rec.data);
+        free(rec.escaped);
+        return INTERRUPTED_STATUS;
+    }
+
+    if (names == reply) set_var("REPLY", rec.data);
+    else assign_fields(names, count, &rec);
+    free(rec.data);
+    free(rec.escaped);
+
+    if (r == -2) return READ_TIMEOUT_STATUS;
+    return r == 0 ? 0 : 1;
+}
+
+/**
+ * @description: `mapfile [-d 分隔符] [-n 行数] [-s 跳过行数] [-t] [-u fd]`
+ * Shell 没有数组，读到的每一行依次成为位置参数 $1、$2 ...（$# 是行数），
+ * 之后可以用 `for line; do ...; done` 或 shift 逐行处理。-t 去掉每行结尾的分隔符
+ */
+int builtin_mapfile(char** args) {
+    read_opts_t o = {STDIN_FILENO, '\n', 1, -1, 0};
+    long count = 0, skip = 0;
+    int strip = 0, first;
+    double timeout = -1;
+    if (parse_read_options(args, "dnstu", &o, &count, &skip, &strip, &timeout, &first) < 0) return 2;
+    if (args[first] != NULL) {
+        fprintf(stderr, "myshell: mapfile: lines are stored in the positional parameters, not in `%s'\n",
+                args[first]);
+        return 2;
+    }
+
+    read_buf_t* rb = get_read_buf(o.fd);
+    size_t cap = 1024, n = 0;
+    char** lines = (char**)malloc(sizeof(char*) * cap);
+    record_t rec = {0};
+    int r = 0;
+    for (long line = 0; count == 0 || n < (size_t)count; line++) {
+        r = read_record(rb, &o, &rec);
+        if (r < 0 || (r == 1 && rec.len == 0)) break;
+        if (line < skip) continue;
+        if (!strip && r == 0) {
+            char d = (char)o.delim;
+            record_put(&rec, &d, 1, 0);
+        }
+        if (n + 1 >= cap) {
+            cap *= 2;
+            lines = (char**)realloc(lines, sizeof(char*) * cap);
+        }
+        lines[n++] = rec.data ? strndup(rec.data, rec.len) : strdup("");
+        if (r == 1) break;
+    }
+    if (sync_read_buf(rb, o.fd) < 0) r = -1;
+    if (r == -1) fprintf(stderr, "myshell: mapfile: read error: %s\n", strerror(errno));
+    free(rec.data);
+    free(rec.escaped);
+
+    lines[n] = NULL;
+    adopt_positional_params(lines, (int)n);
+    if (r == -3) return INTERRUPTED_STATUS;
+    return r == -1 ? 1 : 0;
+}
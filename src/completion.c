@@ -20,14 +20,58 @@
 #include "shell.h"
 #include <readline/readline.h>
 #include <dirent.h>
+#include <ctype.h>
 
 // 函数原型
 static char* command_generator(const char* text, int state);
+static char* flag_generator(const char* text, int state);
 char** completion_callback(const char* text, int start, int end);
 
 // 全局变量，用于在生成器中跟踪状态
 static int list_index;
 static char** command_list = NULL; // 用于存储所有匹配项
+static char** flag_list = NULL;    // 正在补全的命令的选项表（属于 flagcomp.c）
+static int flag_count = 0;
+
+// 复合命令和 time 之后才是真正的命令名
+static const char* command_prefixes[] = {"if", "then", "else", "elif", "do", "while", "until", "time", "!", NULL};
+
+/**
+ * @description: 找出光标所在的这条简单命令的命令名（跳过变量赋值和 if/do 之类的关键字，展开一层别名）
+ * @param {const char*} line - 输入行
+ * @param {int} start - 正在补全的词的起始位置
+ * @return {char*} - 命令名（需要 free），光标前没有命令名时返回 NULL
+ */
+static char* current_command_name(const char* line, int start) {
+    int pos = start;
+    while (pos > 0 && strchr("|;&(){}`\n", line[pos - 1]) == NULL) pos--;
+
+    for (;;) {
+        while (pos < start && isspace((unsigned char)line[pos])) pos++;
+        int end = pos;
+        while (end < start && !isspace((unsigned char)line[end])) end++;
+        if (end >= start) return NULL; // 正在补全的就是命令名本身
+
+        char* word = strndup(line + pos, end - pos);
+        int skip = strchr(word, '=') != NULL && (isalpha((unsigned char)word[0]) || word[0] == '_');
+        for (int i = 0; !skip && command_prefixes[i] != NULL; i++) {
+            skip = strcmp(word, command_prefixes[i]) == 0;
+        }
+        if (!skip) {
+            for (const Alias* a = get_alias_list(); a != NULL; a = a->next) {
+                if (strcmp(a->name, word) == 0) {
+                    const char* cmd = a->command;
+                    while (isspace((unsigned char)*cmd)) cmd++;
+                    free(word);
+                    return strndup(cmd, strcspn(cmd, " \t"));
+                }
+            }
+            return word;
+        }
+        free(word);
+        pos = end;
+    }
+}
 
 /**
  * @description: readline 的主回调函数，当用户按 Tab 时被调用
@@ -35,16 +79,27 @@ static char** command_list = NULL; // 用于存储所有匹配项
 char** completion_callback(const char* text, int start, int end) {
     // 关闭 readline 默认的文件名补全，我们自己来处理
     rl_attempted_completion_over = 1;
-    
+    record_begin(RECORD_COMPLETE);
+
+    char** matches = NULL;
     // 如果是命令的第一个词（start=0），则进行命令补全
     if (start == 0) {
         // 利用readline 提供的命令补全函数“rl_completion_matches”，调用生成器函数，生成所有可能的匹配项
         // 显示: readline 接收到我们返回的匹配列表后，由它负责完成后续所有工作：如果只有一个匹配项，就自动补全；如果有多个，就显示列表给用户。
-        return rl_completion_matches(text, command_generator);
+        matches = rl_completion_matches(text, command_generator);
+    } else if (text[0] == '-') {
+        // 命令名之后以 - 开头的词：补全这个命令的选项（来自它的 --help 输出，见 flagcomp.c）
+        char* command = current_command_name(rl_line_buffer, start);
+        if (command != NULL) {
+            flag_list = lookup_command_flags(command, &flag_count);
+            free(command);
+            if (flag_list != NULL) matches = rl_completion_matches(text, flag_generator);
+        }
     }
-    
+
     // （计划扩展）否则，可以进行文件名或路径补全
-    return NULL;
+    record_completion(rl_line_buffer, end);
+    return matches;
 }
 
 /**
@@ -100,4 +155,18 @@ char* command_generator(const char* text, int state) {
         command_list = NULL;
     }
     return NULL;
-}
\ No newline at end of file
+}
+
+/**
+ * @description: 选项的生成器，从 flag_list 中依次返回以 text 开头的选项
+ */
+static char* flag_generator(const char* text, int state) {
+    static int index;
+    if (state == 0) index = 0;
+    size_t len = strlen(text);
+    while (index < flag_count) {
+        const char* flag = flag_list[index++];
+        if (strncmp(flag, text, len) == 0) return strdup(flag);
+    }
+    return NULL;
+}
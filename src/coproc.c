@@ -0,0 +1,606 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-09-08 14:26:03
+ * @FilePath: /linux-shell/src/coproc.c
+ * @Descripttion: 协同进程模块-启动常驻的工作进程，用双向管道反复交给它一行输入、读回它的回复，省掉每次启动解释器的开销
+ */
+
+// 用法:
+//   coproc [-n N] NAME 命令 [参数 ...]      启动 N 个（默认 1 个）运行同一命令的工作进程，$NAME_PID 是它们的 pid
+//   cosend [-d 分隔符] NAME [单词 ...]      把单词用空格连起来、加上分隔符（默认换行）作为一条请求发出去
+//   coread [-d 分隔符] [-t 时限] NAME [变量] 读一条回复（不含分隔符）存入变量，默认 REPLY。
+//                                           不加 -t 时最多等 $COPROC_TIMEOUT（默认 10 秒，0 表示不限时）
+//   coproc                                  列出协同进程
+//   coproc -k NAME                          关闭输入，等工作进程退出
+//
+// 有多个工作进程时，请求轮流发给各个进程；每发一条就把接收者记进待回复队列，coread 总是读队首那个进程的
+// 下一条回复，所以回复的顺序和请求的顺序相同。协议约定每条请求恰好得到一条回复，工作进程必须
+// 及时刷新输出（python3 -u、awk 的 fflush()、jq --unbuffered 等），否则回复会一直留在它的缓冲区里；
+// mawk 还会攒满一整块输入才开始处理，要加 -W interactive。
+// 可以先连续 cosend 多条再逐条 coread，让几个进程同时工作。
+//
+// 写请求的一端是非阻塞的：管道满了说明工作进程可能正卡在写回复上（它的输出管道也满了），
+// 这时先把它的输出读进这里的缓冲区再继续写，发送大量请求之后才读回复也不会互相等待。
+// 工作进程在自己的进程组里，前台命令的 Ctrl+C 不会结束它们；交互模式下它们登记为后台任务，
+// 意外退出时由事件循环回收，之后的 cosend 报告 broken pipe，coread 读到输入结束。
+// 请求只写了一部分（写的途中按下 Ctrl+C）或写时遇到 broken pipe 的进程不再接收请求：关闭它的输入，
+// 之后的 cosend 跳过它，它已经在待回复队列里的请求仍然按顺序读回复。
+// 等待工作进程时屏蔽 SIGINT，通过 signalfd 得知 Ctrl+C（和 joblog 相同）：cosend/coread 返回 130，Shell 不会被杀死。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <time.h>
+
+#define COPROC_MAX_WORKERS 64
+#define COPROC_READ_CHUNK 65536
+#define COPROC_TIMEOUT_STATUS 142 // coread -t 超时的退出码，和 read 相同
+#define COPROC_CLOSE_TIMEOUT 5.0  // coproc -k 关闭输入后等待多久发 SIGTERM（秒）
+#define COPROC_READ_TIMEOUT 10.0  // coread 不加 -t、也没有设置 COPROC_TIMEOUT 时的时限（秒）
+
+// 一个工作进程
+typedef struct {
+    pid_t pid;
+    int to;                 // 工作进程 stdin 的写端（非阻塞）；-1 表示不再给它发请求
+    int from;               // 工作进程 stdout 的读端
+    char* buf;              // 已经读到、还没被 coread 取走的输出
+    size_t start;           // 下一个未取走的字节
+    size_t end;
+    size_t cap;
+    int eof;                // 输出已经结束
+} worker_t;
+
+// 一组运行同一命令的工作进程
+typedef struct coproc {
+    char* name;
+    char* command;          // 用于列表显示
+    int count;
+    worker_t* workers;
+    int turn;               // 下一条请求发给谁
+    int last;               // 最近一次发给了谁（待回复队列为空时 coread 读它）
+    int* pending;           // 待回复队列（环形）：已发送、回复还没读的请求各发给了哪个进程
+    size_t head;
+    size_t queued;
+    size_t qcap;
+    struct coproc* next;
+} coproc_t;
+
+static coproc_t* coprocs = NULL;
+
+static coproc_t* find_coproc(const char* name) {
+    for (coproc_t* cp = coprocs; cp != NULL; cp = cp->next) {
+        if (strcmp(cp->name, name) == 0) return cp;
+    }
+    return NULL;
+}
+
+static coproc_t* lookup_or_complain(const char* cmd, const char* name) {
+    coproc_t* cp = find_coproc(name);
+    if (cp == NULL) fprintf(stderr, "myshell: %s: %s: no such coprocess\n", cmd, name);
+    return cp;
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 等待工作进程期间屏蔽 SIGINT，按下 Ctrl+C 时 signalfd 可读
+typedef struct {
+    int fd;
+    sigset_t old_mask;
+} interrupt_t;
+
+static void watch_interrupt(interrupt_t* in) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &in->old_mask);
+    in->fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+}
+
+static void unwatch_interrupt(interrupt_t* in) {
+    if (in->fd >= 0) close(in->fd);
+    sigprocmask(SIG_SETMASK, &in->old_mask, NULL);
+}
+
+/**
+ * @description: poll 等待工作进程的 fd，同时等待 Ctrl+C
+ * @param {struct pollfd*} pfds - 最多 2 个
+ * @return {int} - poll 的返回值；按下了 Ctrl+C 返回 -2
+ */
+static int poll_interruptible(struct pollfd* pfds, int n, int timeout_ms, const interrupt_t* in) {
+    struct pollfd all[3];
+    memcpy(all, pfds, sizeof(struct pollfd) * n);
+    all[n].fd = in->fd;
+    all[n].events = POLLIN;
+    all[n].revents = 0;
+    int r = poll(all, in->fd >= 0 ? n + 1 : n, timeout_ms);
+    if (r > 0 && in->fd >= 0 && (all[n].revents & POLLIN)) {
+        struct signalfd_siginfo info;
+        while (read(in->fd, &info, sizeof(info)) == sizeof(info)) {}
+        return -2;
+    }
+    memcpy(pfds, all, sizeof(struct pollfd) * n);
+    return r;
+}
+
+// =================================================================
+// == 启动与关闭
+// =================================================================
+
+/**
+ * @description: 启动一个工作进程，stdin 和 stdout 各接一个管道
+ * @return {int} - 成功返回 0，失败返回 -1（已打印原因）
+ */
+static int start_worker(char** argv, worker_t* w) {
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) < 0) {
+        perror("coproc: pipe");
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) < 0) {
+        perror("coproc: pipe");
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("coproc: fork");
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // 自己的进程组：终端的 Ctrl+C 只发给前台命令
+        setpgid(0, 0);
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        // dup2 得到的 fd 不带 O_CLOEXEC；其余管道端（包括其他协同进程的）在 exec 时关闭
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        execvp(argv[0], argv);
+        if (errno == ENOENT && strchr(argv[0], '/') == NULL) {
+            fprintf(stderr, "myshell: %s: command not found\n", argv[0]);
+        } else {
+            perror(argv[0]);
+        }
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+    memset(w, 0, sizeof(*w));
+    w->pid = pid;
+    w->to = in[1];
+    w->from = out[0];
+    add_background_job(pid, 0, 0);
+    return 0;
+}
+
+// 关闭一组工作进程的管道，等它们退出，返回第一个非零的退出码
+static int close_workers(coproc_t* cp) {
+    pid_t pids[cp->count];
+    int via_zygote[cp->count];
+    int statuses[cp->count];
+    const char* names[cp->count];
+    for (int i = 0; i < cp->count; i++) {
+        worker_t* w = &cp->workers[i];
+        if (w->to >= 0) close(w->to);
+        if (w->from >= 0) close(w->from);
+        free(w->buf);
+        pids[i] = w->pid;
+        via_zygote[i] = 0;
+        names[i] = cp->name;
+    }
+    // 输入关闭后工作进程应当自己退出；超时后发 SIGTERM，再等一会儿发 SIGKILL
+    timeout_t limit = {COPROC_CLOSE_TIMEOUT, TIMEOUT_KILL_GRACE};
+    wait_children(pids, via_zygote, cp->count, statuses, &limit, 0, names);
+    for (int i = 0; i < cp->count; i++) {
+        int code = wait_status_to_exit(statuses[i]);
+        if (code != 0) return code;
+    }
+    return 0;
+}
+
+static int kill_coproc(const char* name) {
+    coproc_t* cp = lookup_or_complain("coproc", name);
+    if (cp == NULL) return 1;
+    for (coproc_t** link = &coprocs; *link != NULL; link = &(*link)->next) {
+        if (*link == cp) {
+            *link = cp->next;
+            break;
+        }
+    }
+    int status = close_workers(cp);
+
+    char var[strlen(cp->name) + 5];
+    snprintf(var, sizeof(var), "%s_PID", cp->name);
+    unset_var(var);
+    free(cp->name);
+    free(cp->command);
+    free(cp->workers);
+    free(cp->pending);
+    free(cp);
+    return status;
+}
+
+static void list_coprocs() {
+    for (coproc_t* cp = coprocs; cp != NULL; cp = cp->next) {
+        printf("%-12s %2d worker%s  %4zu pending  %s\n", cp->name, cp->count, cp->count > 1 ? "s" : " ",
+               cp->queued, cp->command);
+    }
+}
+
+/**
+ * @description: `coproc [-n N] NAME 命令 [参数 ...]`、`coproc -k NAME`、`coproc`
+ * @return {int} - 成功返回 0；-k 返回工作进程的退出码
+ */
+int builtin_coproc(char** args) {
+    long count = 1;
+    int i = 1;
+    if (args[1] == NULL) {
+        list_coprocs();
+        return 0;
+    }
+    if (strcmp(args[1], "-k") == 0) {
+        if (args[2] == NULL || args[3] != NULL) {
+            fprintf(stderr, "myshell: coproc: usage: coproc -k NAME\n");
+            return 2;
+        }
+        return kill_coproc(args[2]);
+    }
+    if (strncmp(args[1], "-n", 2) == 0) {
+        const char* value = args[1][2] != '\0' ? args[1] + 2 : args[++i];
+        char* end;
+        count = value != NULL ? strtol(value, &end, 10) : 0;
+        if (value == NULL || *value == '\0' || *end != '\0' || count < 1 || count > COPROC_MAX_WORKERS) {
+            fprintf(stderr, "myshell: coproc: -n: expected a worker count from 1 to %d\n", COPROC_MAX_WORKERS);
+            return 2;
+        }
+        i++;
+    }
+    if (args[i] == NULL || args[i + 1] == NULL) {
+        fprintf(stderr, "myshell: coproc: usage: coproc [-n N] NAME command [args ...] | coproc -k NAME\n");
+        return 2;
+    }
+    const char* name = args[i];
+    if (!is_valid_name(name, strlen(name))) {
+        fprintf(stderr, "myshell: coproc: `%s': not a valid identifier\n", name);
+        return 2;
+    }
+    if (find_coproc(name) != NULL) {
+        fprintf(stderr, "myshell: coproc: %s: already running, stop it with coproc -k %s\n", name, name);
+        return 1;
+    }
+
+    coproc_t* cp = (coproc_t*)calloc(1, sizeof(coproc_t));
+    cp->workers = (worker_t*)calloc(count, sizeof(worker_t));
+    for (; cp->count < count; cp->count++) {
+        if (start_worker(args + i + 1, &cp->workers[cp->count]) < 0) break;
+    }
+    cp->name = strdup(name);
+    if (cp->count < count) {
+        close_workers(cp);
+        free(cp->name);
+        free(cp->workers);
+        free(cp);
+        return 1;
+    }
+
+    size_t len = 0;
+    for (int j = i + 1; args[j] != NULL; j++) len += strlen(args[j]) + 1;
+    cp->command = (char*)malloc(len);
+    cp->command[0] = '\0';
+    for (int j = i + 1; args[j] != NULL; j++) {
+        if (j > i + 1) strcat(cp->command, " ");
+        strcat(cp->command, args[j]);
+    }
+    cp->next = coprocs;
+    coprocs = cp;
+
+    char pids[count * 12 + 1];
+    pids[0] = '\0';
+    for (int k = 0; k < cp->count; k++) {
+        snprintf(pids + strlen(pids), sizeof(pids) - strlen(pids), k ? " %d" : "%d", (int)cp->workers[k].pid);
+    }
+    char var[strlen(name) + 5];
+    snprintf(var, sizeof(var), "%s_PID", name);
+    set_var(var, pids);
+    return 0;
+}
+
+// =================================================================
+// == 请求与回复
+// =================================================================
+
+/**
+ * @description: 从工作进程读一次输出，追加到它的缓冲区
+ * @return {ssize_t} - 读到的字节数，0 表示输出结束，-1 表示暂时没有数据或出错
+ */
+static ssize_t fill_worker(worker_t* w) {
+    if (w->start == w->end) {
+        w->start = w->end = 0;
+    } else if (w->start > 0 && w->cap - w->end < COPROC_READ_CHUNK) {
+        memmove(w->buf, w->buf + w->start, w->end - w->start);
+        w->end -= w->start;
+        w->start = 0;
+    }
+    if (w->cap - w->end < COPROC_READ_CHUNK) {
+        w->cap = w->cap ? w->cap * 2 : COPROC_READ_CHUNK;
+        while (w->cap - w->end < COPROC_READ_CHUNK) w->cap *= 2;
+        w->buf = (char*)realloc(w->buf, w->cap);
+    }
+    ssize_t n;
+    while ((n = read(w->from, w->buf + w->end, COPROC_READ_CHUNK)) < 0 && errno == EINTR) {}
+    if (n > 0) w->end += n;
+    if (n == 0) w->eof = 1;
+    return n;
+}
+
+/**
+ * @description: 把一条请求完整写给工作进程。管道满时一边等一边读走它的输出
+ * @param {size_t*} written - 输出：实际写入的字节数
+ * @return {int} - 成功返回 0，工作进程已经退出（EPIPE）或出错返回 -1，按下 Ctrl+C 返回 -2
+ */
+static int write_request(worker_t* w, const char* data, size_t len, const interrupt_t* in, size_t* written) {
+    // 写到已关闭的管道时得到 EPIPE，而不是让 Shell 被 SIGPIPE 结束
+    sigset_t pipe_set, old_mask;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &old_mask);
+
+    int result = 0;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(w->to, data + done, len - done);
+        if (n > 0) {
+            done += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN) {
+            result = -1;
+            break;
+        }
+        struct pollfd pfd[2] = {{w->to, POLLOUT, 0}, {w->eof ? -1 : w->from, POLLIN, 0}};
+        int r = poll_interruptible(pfd, 2, -1, in);
+        if (r == -2 || (r < 0 && errno != EINTR)) {
+            result = r == -2 ? -2 : -1;
+            break;
+        }
+        if (pfd[1].revents & (POLLIN | POLLHUP)) fill_worker(w);
+    }
+
+    if (result == -1 && errno == EPIPE) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe_set, NULL, &zero);
+        errno = EPIPE;
+    }
+    int saved = errno;
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    errno = saved;
+    *written = done;
+    return result;
+}
+
+/**
+ * @description: 下一个还接收请求的工作进程，从 turn 开始轮流找
+ * @return {int} - 下标；全部不再接收请求时返回 -1
+ */
+static int next_worker(const coproc_t* cp) {
+    for (int j = 0; j < cp->count; j++) {
+        int k = (cp->turn + j) % cp->count;
+        if (cp->workers[k].to >= 0) return k;
+    }
+    return -1;
+}
+
+// 不再给这个工作进程发请求：关闭输入后它读到输入结束，通常会自己退出
+static void retire_worker(worker_t* w) {
+    close(w->to);
+    w->to = -1;
+}
+
+/**
+ * @description: `cosend [-d 分隔符] NAME [单词 ...]`，发给轮到的工作进程
+ * @return {int} - 成功返回 0，工作进程已经退出返回 1
+ */
+int builtin_cosend(char** args) {
+    char delim = '\n';
+    int i = 1;
+    if (args[1] != NULL && strncmp(args[1], "-d", 2) == 0) {
+        const char* value = args[1][2] != '\0' ? args[1] + 2 : args[++i];
+        if (value == NULL) {
+            fprintf(stderr, "myshell: cosend: -d: option requires an argument\n");
+            return 2;
+        }
+        delim = value[0]; // -d '' 表示以 NUL 分隔
+        i++;
+    }
+    if (args[i] == NULL) {
+        fprintf(stderr, "myshell: cosend: usage: cosend [-d delim] NAME [word ...]\n");
+        return 2;
+    }
+    coproc_t* cp = lookup_or_complain("cosend", args[i]);
+    if (cp == NULL) return 1;
+
+    size_t len = 1;
+    for (int j = i + 1; args[j] != NULL; j++) len += strlen(args[j]) + 1;
+    char data[len];
+    size_t pos = 0;
+    for (int j = i + 1; args[j] != NULL; j++) {
+        if (j > i + 1) data[pos++] = ' ';
+        size_t n = strlen(args[j]);
+        memcpy(data + pos, args[j], n);
+        pos += n;
+    }
+    data[pos++] = delim;
+
+    int k = next_worker(cp);
+    if (k < 0) {
+        fprintf(stderr, "myshell: cosend: %s: no worker accepts requests any more\n", cp->name);
+        return 1;
+    }
+    worker_t* w = &cp->workers[k];
+    interrupt_t in;
+    watch_interrupt(&in);
+    size_t written;
+    int r = write_request(w, data, pos, &in, &written);
+    unwatch_interrupt(&in);
+    // 只有完整写出的请求才轮到下一个进程、记进待回复队列
+    if (r == -2) {
+        fprintf(stderr, "\nmyshell: cosend: %s[%d] (pid %d): interrupted\n", cp->name, k, (int)w->pid);
+        if (written > 0) {
+            // 输入里留下了半条请求，它之后的回复无法和请求对应
+            fprintf(stderr, "myshell: cosend: %s[%d] (pid %d): request partially written; no more requests go "
+                            "to this worker\n", cp->name, k, (int)w->pid);
+            retire_worker(w);
+        }
+        note_interrupt();
+        return INTERRUPTED_STATUS;
+    }
+    if (r < 0) {
+        fprintf(stderr, "myshell: cosend: %s[%d] (pid %d): %s\n", cp->name, k, (int)w->pid, strerror(errno));
+        retire_worker(w);
+        return 1;
+    }
+    cp->turn = (k + 1) % cp->count;
+    cp->last = k;
+
+    if (cp->queued == cp->qcap) {
+        // 扩容时把环形队列展开成从 0 开始
+        size_t cap = cp->qcap ? cp->qcap * 2 : 64;
+        int* q = (int*)malloc(sizeof(int) * cap);
+        for (size_t j = 0; j < cp->queued; j++) q[j] = cp->pending[(cp->head + j) % cp->qcap];
+        free(cp->pending);
+        cp->pending = q;
+        cp->head = 0;
+        cp->qcap = cap;
+    }
+    cp->pending[(cp->head + cp->queued) % cp->qcap] = k;
+    cp->queued++;
+    return 0;
+}
+
+/**
+ * @description: 从工作进程读一条以 delim 结尾的回复
+ * @param {double} deadline - 截止时刻（CLOCK_MONOTONIC 秒），0 表示不限时
+ * @param {char**} out - 输出：回复内容（不含分隔符），由调用者释放
+ * @return {int} - 读到分隔符返回 0，输出结束返回 1（剩下的部分仍然输出），超时返回 -2，按下 Ctrl+C 返回 -3
+ */
+static int read_reply(worker_t* w, char delim, double deadline, const interrupt_t* in, char** out) {
+    size_t scanned = 0; // 从 start 开始已经找过的字节数（fill_worker 可能把数据挪到缓冲区开头）
+    for (;;) {
+        size_t avail = w->end - w->start;
+        char* hit = scanned < avail ? (char*)memchr(w->buf + w->start + scanned, delim, avail - scanned) : NULL;
+        if (hit != NULL || w->eof) {
+            size_t end = hit ? (size_t)(hit - w->buf) : w->end;
+            *out = strndup(w->buf + w->start, end - w->start);
+            w->start = hit ? end + 1 : end;
+            return hit ? 0 : 1;
+        }
+        scanned = avail;
+
+        int timeout_ms = -1;
+        if (deadline > 0) {
+            double left = deadline - now_seconds();
+            if (left <= 0) return -2;
+            timeout_ms = (int)(left * 1000) + 1;
+        }
+        struct pollfd pfd = {w->from, POLLIN, 0};
+        int r = poll_interruptible(&pfd, 1, timeout_ms, in);
+        if (r == -2) return -3;
+        if (r < 0 && errno != EINTR) w->eof = 1;
+        if (r > 0 && fill_worker(w) < 0 && errno != EAGAIN && errno != EINTR) w->eof = 1;
+    }
+}
+
+/**
+ * @description: `coread [-d 分隔符] [-t 时限] NAME [变量]`，读最早一条还没读的请求的回复
+ * @return {int} - 成功返回 0；工作进程的输出已经结束返回 1；超时返回 142，这条回复留给下一次 coread；
+ * 按下 Ctrl+C 返回 130
+ */
+int builtin_coread(char** args) {
+    char delim = '\n';
+    double seconds = -1;
+    int i = 1;
+    for (; args[i] != NULL && args[i][0] == '-' && (args[i][1] == 'd' || args[i][1] == 't'); i++) {
+        char opt = args[i][1];
+        const char* value = args[i][2] != '\0' ? args[i] + 2 : args[++i];
+        if (value == NULL) {
+            fprintf(stderr, "myshell: coread: -%c: option requires an argument\n", opt);
+            return 2;
+        }
+        if (opt == 'd') {
+            delim = value[0];
+            continue;
+        }
+        if (parse_duration(value, &seconds) < 0) {
+            fprintf(stderr, "myshell: coread: %s: invalid timeout specification\n", value);
+            return 2;
+        }
+    }
+    if (args[i] == NULL || (args[i + 1] != NULL && args[i + 2] != NULL)) {
+        fprintf(stderr, "myshell: coread: usage: coread [-d delim] [-t timeout] NAME [VAR]\n");
+        return 2;
+    }
+    const char* var = args[i + 1] != NULL ? args[i + 1] : "REPLY";
+    if (!is_valid_name(var, strlen(var))) {
+        fprintf(stderr, "myshell: coread: `%s': not a valid identifier\n", var);
+        return 2;
+    }
+    coproc_t* cp = lookup_or_complain("coread", args[i]);
+    if (cp == NULL) return 1;
+
+    // 不加 -t 时也有时限：工作进程没有刷新输出时回复永远不会来
+    int explicit_timeout = seconds >= 0;
+    if (!explicit_timeout) {
+        const char* value = get_var("COPROC_TIMEOUT");
+        if (value == NULL || parse_duration(value, &seconds) < 0) seconds = COPROC_READ_TIMEOUT;
+    }
+    double deadline = seconds > 0 ? now_seconds() + seconds : 0;
+
+    int k = cp->queued > 0 ? cp->pending[cp->head] : cp->last;
+    worker_t* w = &cp->workers[k];
+    char* reply = NULL;
+    interrupt_t in;
+    watch_interrupt(&in);
+    int r = read_reply(w, delim, deadline, &in, &reply);
+    unwatch_interrupt(&in);
+    if (r == -3) {
+        fprintf(stderr, "\nmyshell: coread: %s[%d] (pid %d): interrupted while waiting for a reply\n", cp->name, k,
+                (int)w->pid);
+        note_interrupt();
+        return INTERRUPTED_STATUS;
+    }
+    if (r == -2) {
+        if (!explicit_timeout) {
+            fprintf(stderr, "myshell: coread: %s[%d] (pid %d): no reply within %gs; the worker must flush "
+                            "each reply (python3 -u, awk fflush(), mawk -W interactive)\n",
+                    cp->name, k, (int)w->pid, seconds);
+        }
+        return COPROC_TIMEOUT_STATUS;
+    }
+    if (cp->queued > 0) {
+        cp->head = (cp->head + 1) % cp->qcap;
+        cp->queued--;
+    }
+    set_var(var, reply);
+    free(reply);
+    return r;
+}
@@ -0,0 +1,368 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-08 10:03:51
+ * @FilePath: /linux-shell/src/eventloop.c
+ * @Descripttion: 事件循环模块-交互模式下用 epoll 同时等待键盘输入、信号、后台任务和定时器
+ */
+
+// 交互模式不再阻塞在 readline() 里，而是使用 readline 的回调接口:
+//   epoll 等到 stdin 可读 -> rl_callback_read_char() 处理一个按键 -> 读完一行时回调 main.c
+// 同一个 epoll 还监视:
+//   - signalfd: 提示符下的 SIGINT（清空当前输入）和 SIGWINCH（终端大小变化）
+//   - pidfd:    每个后台任务一个，任务结束时立刻回收并打印通知，不用等到下一条命令
+//   - eventfd:  loop_defer() 排队的回调，用于把其他模块的异步结果交回主循环
+//   - timerfd:  loop_add_timer() 的一次性定时器
+// 通知打印在当前输入行的上方，用户正在输入的内容会原样重绘。
+// 非交互模式（脚本、-c）不启动事件循环，后台任务的行为不变。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <readline/readline.h>
+
+#define MAX_EVENTS 32
+
+// 一个被监视的 fd
+typedef struct Watch {
+    int fd;
+    loop_callback_t callback;
+    void* ctx;
+    int oneshot;            // 触发一次后自动移除并关闭（定时器）
+    struct Watch* next;
+} Watch;
+
+// 一个还没结束的后台进程
+typedef struct BackgroundJob {
+    pid_t pid;
+    int pidfd;
+    int via_zygote;         // 由孵化器启动，退出状态从孵化器获取
+    int notify;             // 结束时是否打印通知（管道中只有最后一段打印）
+    struct BackgroundJob* next;
+} BackgroundJob;
+
+// loop_defer() 排队的回调
+typedef struct Deferred {
+    loop_callback_t callback;
+    void* ctx;
+    struct Deferred* next;
+} Deferred;
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static int wake_fd = -1;
+static sigset_t loop_signals;
+static Watch* watches = NULL;
+static BackgroundJob* jobs = NULL;
+static Deferred* deferred_head = NULL;
+static Deferred** deferred_tail = &deferred_head;
+static int prompt_active = 0;   // readline 回调是否已安装（决定通知如何输出）
+static int stdin_always_ready = 0; // 标准输入是普通文件：epoll 不接受它，但它总是可读
+static void (*interrupt_handler)() = NULL;
+
+// =================================================================
+// == fd 监视
+// =================================================================
+
+static Watch* find_watch(int fd) {
+    for (Watch* w = watches; w != NULL; w = w->next) {
+        if (w->fd == fd) return w;
+    }
+    return NULL;
+}
+
+/**
+ * @description: 监视一个 fd，可读时调用 callback(fd, ctx)
+ * @return {int} - 成功返回 0，失败返回 -1
+ */
+int loop_watch_fd(int fd, loop_callback_t callback, void* ctx) {
+    if (epoll_fd < 0) return -1;
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+
+    Watch* w = (Watch*)calloc(1, sizeof(Watch));
+    w->fd = fd;
+    w->callback = callback;
+    w->ctx = ctx;
+    w->next = watches;
+    watches = w;
+    return 0;
+}
+
+/**
+ * @description: 停止监视一个 fd（不会关闭它）
+ */
+void loop_unwatch_fd(int fd) {
+    for (Watch** link = &watches; *link != NULL; link = &(*link)->next) {
+        if ((*link)->fd == fd) {
+            Watch* w = *link;
+            *link = w->next;
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            free(w);
+            return;
+        }
+    }
+}
+
+/**
+ * @description: 添加一个一次性定时器，ms 毫秒后调用 callback(-1, ctx)
+ * @return {int} - 成功返回 0，失败返回 -1
+ */
+int loop_add_timer(int ms, loop_callback_t callback, void* ctx) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) return -1;
+    struct itimerspec its = {0};
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000L + (ms == 0); // 全 0 表示停止定时器
+    if (timerfd_settime(fd, 0, &its, NULL) < 0 || loop_watch_fd(fd, callback, ctx) < 0) {
+        close(fd);
+        return -1;
+    }
+    find_watch(fd)->oneshot = 1;
+    return 0;
+}
+
+/**
+ * @description: 把一个回调排到主循环的下一轮执行
+ */
+void loop_defer(loop_callback_t callback, void* ctx) {
+    Deferred* d = (Deferred*)malloc(sizeof(Deferred));
+    d->callback = callback;
+    d->ctx = ctx;
+    d->next = NULL;
+    *deferred_tail = d;
+    deferred_tail = &d->next;
+
+    uint64_t one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) perror("eventfd");
+}
+
+static void run_deferred(int fd, void* ctx) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("eventfd");
+
+    // 回调里可能再排队新的回调，先把当前队列摘下来
+    Deferred* list = deferred_head;
+    deferred_head = NULL;
+    deferred_tail = &deferred_head;
+    while (list != NULL) {
+        Deferred* next = list->next;
+        list->callback(-1, list->ctx);
+        free(list);
+        list = next;
+    }
+}
+
+// =================================================================
+// == 异步输出
+// =================================================================
+
+/**
+ * @description: 打印一条异步消息（任务结束通知等）。如果用户正在输入，
+ * 消息打印在输入行上方，然后重绘提示符和已经输入的内容
+ */
+void loop_print(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    if (prompt_active) {
+        rl_clear_visible_line();
+        vfprintf(stdout, fmt, ap);
+        fflush(stdout);
+        rl_forced_update_display();
+    } else {
+        vfprintf(stdout, fmt, ap);
+        fflush(stdout);
+    }
+    va_end(ap);
+}
+
+// =================================================================
+// == 后台任务
+// =================================================================
+
+static void report_job(BackgroundJob* job, int status) {
+    if (!job->notify) return;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        loop_print("[%d] Done\n", job->pid);
+    } else if (WIFEXITED(status)) {
+        loop_print("[%d] Exit %d\n", job->pid, WEXITSTATUS(status));
+    } else if (WIFSIGNALED(status)) {
+        loop_print("[%d] Killed by signal %d\n", job->pid, WTERMSIG(status));
+    }
+}
+
+static void remove_job(BackgroundJob* job) {
+    if (job->pidfd >= 0) {
+        loop_unwatch_fd(job->pidfd);
+        close(job->pidfd);
+    }
+    for (BackgroundJob** link = &jobs; *link != NULL; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            break;
+        }
+    }
+    free(job);
+}
+
+static void job_exited(int fd, void* ctx) {
+    BackgroundJob* job = (BackgroundJob*)ctx;
+    int status = 0;
+    if (job->via_zygote) {
+        status = zygote_wait(job->pid);
+    } else if (waitpid(job->pid, &status, WNOHANG) == 0) {
+        return; // pidfd 可读但进程还没退出，不应发生
+    }
+    report_job(job, status);
+    remove_job(job);
+}
+
+/**
+ * @description: 登记一个后台进程。事件循环运行时，进程结束后会被立即回收并打印通知
+ * @param {pid_t} pid - 进程号
+ * @param {int} via_zygote - 是否由孵化器启动
+ * @param {int} notify - 结束时是否打印通知
+ */
+void add_background_job(pid_t pid, int via_zygote, int notify) {
+    if (epoll_fd < 0) return;
+    BackgroundJob* job = (BackgroundJob*)calloc(1, sizeof(BackgroundJob));
+    job->pid = pid;
+    job->via_zygote = via_zygote;
+    job->notify = notify;
+    job->next = jobs;
+    jobs = job;
+
+    // 拿不到 pidfd 时（fd 用完、内核太旧），由 poll_unwatched_jobs 在每轮循环时检查
+    job->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (job->pidfd >= 0) {
+        fcntl(job->pidfd, F_SETFD, FD_CLOEXEC);
+        if (loop_watch_fd(job->pidfd, job_exited, job) < 0) {
+            close(job->pidfd);
+            job->pidfd = -1;
+        }
+    }
+}
+
+// 检查没有 pidfd 的后台任务是否已经结束
+static void poll_unwatched_jobs() {
+    BackgroundJob* job = jobs;
+    while (job != NULL) {
+        BackgroundJob* next = job->next;
+        int status;
+        if (job->pidfd < 0 && !job->via_zygote && waitpid(job->pid, &status, WNOHANG) == job->pid) {
+            report_job(job, status);
+            remove_job(job);
+        }
+        job = next;
+    }
+}
+
+// =================================================================
+// == 信号与主循环
+// =================================================================
+
+static void handle_signal(int fd, void* ctx) {
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGWINCH) {
+            rl_resize_terminal();
+        } else if (info.ssi_signo == SIGINT && interrupt_handler != NULL) {
+            interrupt_handler();
+        }
+    }
+}
+
+/**
+ * @description: 初始化事件循环：epoll、signalfd 和 eventfd
+ * @param {void (*)()} on_interrupt - 提示符下按 Ctrl+C 时调用
+ * @return {int} - 成功返回 0，失败返回 -1（调用者应退回阻塞的 readline）
+ */
+int event_loop_init(void (*on_interrupt)()) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return -1;
+
+    sigemptyset(&loop_signals);
+    sigaddset(&loop_signals, SIGINT);
+    sigaddset(&loop_signals, SIGWINCH);
+    signal_fd = signalfd(-1, &loop_signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (signal_fd < 0 || wake_fd < 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+        return -1;
+    }
+    if (loop_watch_fd(STDIN_FILENO, NULL, NULL) < 0) { // 按键由 loop_run_once 直接交给 readline
+        stdin_always_ready = (errno == EPERM);
+    }
+    loop_watch_fd(signal_fd, handle_signal, NULL);
+    loop_watch_fd(wake_fd, run_deferred, NULL);
+    interrupt_handler = on_interrupt;
+
+    // 信号改由 signalfd 处理，readline 不再安装自己的信号处理函数
+    rl_catch_signals = 0;
+    rl_catch_sigwinch = 0;
+    return 0;
+}
+
+/**
+ * @description: 安装或移除 readline 回调。执行命令前必须移除，让终端恢复正常模式
+ */
+void loop_set_prompt(const char* prompt, void (*handler)(char* line)) {
+    if (prompt != NULL) {
+        rl_callback_handler_install(prompt, handler);
+        prompt_active = 1;
+    } else if (prompt_active) {
+        rl_callback_handler_remove();
+        prompt_active = 0;
+    }
+}
+
+/**
+ * @description: 等待并处理一轮事件。SIGINT/SIGWINCH 只在等待期间屏蔽（由 signalfd 接收），
+ * 处理按键和回调时恢复，这样执行的命令和它们的子进程不会继承被屏蔽的信号
+ */
+void loop_run_once() {
+    struct epoll_event events[MAX_EVENTS];
+    sigset_t old_mask;
+
+    if (epoll_fd < 0) {
+        rl_callback_read_char(); // 没有 epoll 时退化成阻塞读取按键
+        return;
+    }
+
+    poll_unwatched_jobs();
+    sigprocmask(SIG_BLOCK, &loop_signals, &old_mask);
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, stdin_always_ready && prompt_active ? 0 : -1);
+    handle_signal(signal_fd, NULL); // 解除屏蔽前取走等待中的信号
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    // 先处理键盘输入，其他事件排在后面，按键不会被后台任务的通知拖慢
+    if (stdin_always_ready && prompt_active) rl_callback_read_char();
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == STDIN_FILENO && prompt_active) {
+            rl_callback_read_char();
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        Watch* w = find_watch(fd);
+        if (fd == STDIN_FILENO || fd == signal_fd || w == NULL) continue; // 可能已在前面的回调中被移除
+        loop_callback_t callback = w->callback;
+        void* ctx = w->ctx;
+        if (w->oneshot) {
+            loop_unwatch_fd(fd);
+            close(fd);
+            fd = -1;
+        }
+        callback(fd, ctx);
+    }
+}
@@ -2,109 +2,717 @@
  * @Author: Yuzhe Guo
  * @Date: 2025-07-07 14:57:50
  * @FilePath: /linux-shell/src/execute.c
- * @Descripttion: 命令执行模块-执行外部命令
+ * @Descripttion: 命令执行模块-遍历语法树，执行内建命令、函数和外部命令
  */
 #include "shell.h"
+#include <errno.h>
+#include <fnmatch.h> // for case 模式匹配
+#include <signal.h>
+#include <sys/resource.h>
+#include <time.h>
+
+int last_exit_status = 0;
+int side_effect_count = 0;
+
+// 循环与函数的控制流状态
+int loop_depth = 0;
+int pending_break = 0;
+int pending_continue = 0;
+int function_depth = 0;
+int pending_return = 0;
+
+// =================================================================
+// == Ctrl+C
+// =================================================================
+
+// 交互模式下执行命令期间，SIGINT 由 on_interrupt 接收：Shell 不会被杀死，只记下 interrupted，
+// execute_node 和各种循环看到它后不再往下执行，一直退回到提示符（和 break 一样逐层向外传递）。
+// 等待输入时 SIGINT 被屏蔽、由事件循环的 signalfd 接收，和这里互不干扰。
+// 处理函数会被 fork 继承，所以每个子进程都要先恢复默认处理（exec 也会恢复，但 fork 出来的子 Shell 不 exec）。
+volatile sig_atomic_t interrupted = 0;
+static int catching_interrupts = 0;
+
+static void on_interrupt(int sig) {
+    interrupted = 1;
+}
 
 /**
- * @description: 执行单个命令，支持I/O重定向和后台执行
+ * @description: 交互模式开始前调用：安装 SIGINT 处理函数。不带 SA_RESTART，
+ * 阻塞在 read 等系统调用里的内建命令会返回 EINTR，看到 interrupted 后退出
+ */
+void catch_interrupts() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    catching_interrupts = 1;
+}
+
+// fork 出来的子进程中调用：Ctrl+C 照常结束它
+void reset_interrupt_handler() {
+    if (!catching_interrupts) return;
+    signal(SIGINT, SIG_DFL);
+    catching_interrupts = 0;
+    interrupted = 0;
+}
+
+/**
+ * @description: 不经过 SIGINT 处理函数得知了 Ctrl+C（例如用 signalfd 等待的内建命令），
+ * 交互模式下同样停止执行剩下的命令
+ */
+void note_interrupt() {
+    if (catching_interrupts) interrupted = 1;
+}
+
+/**
+ * @description: 前台命令被 SIGINT 结束，或者等待期间 Shell 自己也收到了 SIGINT 之后调用
+ * （等待期间 SIGINT 被屏蔽后丢掉，处理函数收不到）。交互模式下和 bash 相同，停止执行剩下的循环和命令列表。
+ * 非交互的 Shell（脚本、子 Shell、管道中的循环）自己收到了这次 Ctrl+C 时，等命令结束后用 SIGINT 结束自己
+ * （和 dash 相同）。只看命令的退出状态不够：/bin/true 这样很快结束的命令常常在 SIGINT 到达之前就已经退出了，
+ * `while true; do /bin/true; done | cat` 会停不下来
+ */
+static void foreground_interrupted() {
+    if (catching_interrupts) {
+        interrupted = 1;
+        return;
+    }
+    if (!wait_got_sigint) return;
+    fflush(NULL);
+    signal(SIGINT, SIG_DFL);
+    raise(SIGINT);
+}
+
+/**
+ * @description: 把 waitpid 得到的状态转换成 Shell 的退出码（被信号杀死时为 128+信号）
+ */
+int wait_status_to_exit(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+// 子进程中：把 NAME=value 前缀赋值放进环境变量
+static void export_assignments(char** assigns) {
+    if (assigns == NULL) return;
+    for (int i = 0; assigns[i] != NULL; i++) {
+        putenv(assigns[i]);
+    }
+}
+
+// 正在启动的后台任务的输出管道（JOB_CAPTURE，见 joblog.c），-1 表示不捕获
+static int job_output_fd = -1;
+// 最近一个后台任务显示的 [pid]，用来登记捕获的输出
+static pid_t last_background_pid = 0;
+
+// 子进程中：把 stdout/stderr 接到后台任务的输出管道，之后的管道连接和 < > 重定向会覆盖它
+static void capture_job_output() {
+    if (job_output_fd < 0) return;
+    dup2(job_output_fd, STDOUT_FILENO);
+    dup2(job_output_fd, STDERR_FILENO);
+    close(job_output_fd);
+    job_output_fd = -1;
+}
+
+static void announce_background(pid_t pid) {
+    printf("[%d]\n", pid);
+    last_background_pid = pid;
+}
+
+// 父进程中：把 NAME=value 赋值保存为 Shell 变量
+static void apply_assignments(char** assigns) {
+    if (assigns == NULL) return;
+    for (int i = 0; assigns[i] != NULL; i++) {
+        char* eq = strchr(assigns[i], '=');
+        *eq = '\0';
+        set_var(assigns[i], eq + 1);
+        *eq = '=';
+    }
+}
+
+static int open_target(const char* file, int append) {
+    int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+    return open(file, flags, 0644);
+}
+
+static int open_output(command_t* cmd) {
+    return open_target(cmd->output_file, cmd->append_output);
+}
+
+// =================================================================
+// == 多个输出目标 (MULTIOS)
+// =================================================================
+
+// 命令有多个 > / >> 目标时，父进程打开所有目标并启动分发进程，
+// 命令的标准输出改为接到分发进程的管道（见 fanout.c）
+typedef struct {
+    int fd;    // 命令的标准输出，-1 表示只有一个目标，照常打开
+    pid_t pid; // 分发进程
+} fanout_t;
+
+/**
+ * @description: 打开所有输出目标并启动分发进程
+ * @return {int} - 成功返回 0；打开目标失败返回 -1（已打印错误，命令不应执行）
+ */
+static int start_fanout(command_t* cmd, fanout_t* fan) {
+    fan->fd = -1;
+    fan->pid = -1;
+    if (cmd->more_outputs == NULL) return 0;
+
+    int count = 1;
+    for (output_target_t* t = cmd->more_outputs; t != NULL; t = t->next) count++;
+    int fds[count];
+    int opened = 0;
+    const char* file = cmd->output_file;
+    int append = cmd->append_output;
+    for (output_target_t* t = cmd->more_outputs;; t = t->next) {
+        fds[opened] = open_target(file, append);
+        if (fds[opened] < 0) {
+            perror(file);
+            break;
+        }
+        fcntl(fds[opened++], F_SETFD, FD_CLOEXEC);
+        if (t == NULL) break;
+        file = t->file;
+        append = t->append;
+    }
+    if (opened == count) {
+        fan->pid = start_output_fanout(fds, count, &fan->fd);
+    }
+    for (int i = 0; i < opened; i++) close(fds[i]);
+    return fan->pid > 0 ? 0 : -1;
+}
+
+/**
+ * @description: 子进程中处理 I/O 重定向
+ * @param {fanout_t*} fan - 有多个输出目标时，标准输出接到分发进程的管道（可为 NULL）
+ * @return {int} - 成功返回 0，打开文件失败返回 -1
+ */
+static int redirect_in_child(command_t* cmd, fanout_t* fan) {
+    int fd_in, fd_out;
+
+    // 处理输入重定向--结构体定义
+    if (cmd->input_file) {
+        // 打开一个文件，获取一个“文件描述符”（File Descriptor），这是一个代表该文件的整数。
+        fd_in = open(cmd->input_file, O_RDONLY);
+        if (fd_in == -1) {
+            perror(cmd->input_file);
+            return -1;
+        }
+        // dup2(old_fd, new_fd)是重定向的核心。它会复制一个文件描述符，让 new_fd 指向和 old_fd 同一个文件。
+        // dup2(file_fd, STDOUT_FILENO) 就让“标准输出”（STDOUT_FILENO，通常是1）指向了我们用 open 打开的文件。
+        dup2(fd_in, STDIN_FILENO); // 把标准输入指到这个文件
+        close(fd_in);
+    }
+
+    // 处理输出重定向
+    if (fan != NULL && fan->fd >= 0) {
+        dup2(fan->fd, STDOUT_FILENO);
+        close(fan->fd);
+        fan->fd = -1;
+    } else if (cmd->output_file) {
+        fd_out = open_output(cmd);
+        if (fd_out == -1) {
+            perror(cmd->output_file);
+            return -1;
+        }
+        dup2(fd_out, STDOUT_FILENO); // 把标准输出指向这个文件
+        close(fd_out);
+    }
+    return 0;
+}
+
+// 内建命令和复合命令在 Shell 进程内执行时，重定向需要在执行后恢复
+typedef struct {
+    int saved_in;
+    int saved_out;
+    pid_t fanout_pid; // 多个输出目标时的分发进程
+} saved_fds_t;
+
+static int push_redirects(command_t* cmd, saved_fds_t* saved) {
+    saved->saved_in = saved->saved_out = -1;
+    saved->fanout_pid = -1;
+    if (cmd->input_file == NULL && cmd->output_file == NULL) return 0;
+
+    fflush(stdout);
+    fanout_t fan;
+    if (start_fanout(cmd, &fan) < 0) return -1;
+    saved->fanout_pid = fan.pid;
+    if (cmd->input_file) {
+        saved->saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        invalidate_read_buffers(); // 标准输入换成了别的文件
+    }
+    if (cmd->output_file) saved->saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    return redirect_in_child(cmd, &fan);
+}
+
+static void pop_redirects(saved_fds_t* saved) {
+    fflush(stdout);
+    if (saved->saved_in >= 0) {
+        dup2(saved->saved_in, STDIN_FILENO);
+        close(saved->saved_in);
+        invalidate_read_buffers();
+    }
+    if (saved->saved_out >= 0) {
+        dup2(saved->saved_out, STDOUT_FILENO);
+        close(saved->saved_out);
+    }
+    // 恢复标准输出后分发进程的管道没有写端了，等它把剩下的数据写完
+    if (saved->fanout_pid > 0) waitpid(saved->fanout_pid, NULL, 0);
+}
+
+/**
+ * @description: 调用 Shell 函数。函数体是已经解析好的语法树，直接遍历执行
+ */
+static int call_function(node_t* body, char** args) {
+    int argc = 0;
+    while (args[argc] != NULL) argc++;
+
+    // 执行期间持有函数体的引用，防止函数在执行中被重新定义后释放
+    body->refcount++;
+    push_positional_params(argc, args);
+    int saved_loop_depth = loop_depth;
+    loop_depth = 0;
+    function_depth++;
+
+    int status = execute_node(body);
+
+    function_depth--;
+    loop_depth = saved_loop_depth;
+    pending_return = 0;
+    pop_positional_params();
+    free_node(body);
+    return status;
+}
+
+/**
+ * @description: 在子进程中执行管道的一段：复合命令、函数、内建命令或外部命令。不会返回
  */
-void execute_command(command_t* cmd) {
+static void exec_in_child(command_t* cmd) {
+    apply_spawn_attrs(cmd->attrs);
+
+    if (cmd->compound) {
+        exit(execute_node(cmd->compound));
+    }
     if (cmd->args[0] == NULL) {
-        return; // 空命令
+        exit(EXIT_SUCCESS);
     }
 
-    pid_t pid = fork(); //第一步，克隆自己，创建子进程
+    node_t* func = lookup_function(cmd->args[0]);
+    if (func != NULL) {
+        int status = call_function(func, cmd->args);
+        fflush(stdout);
+        exit(status);
+    }
+    if (is_builtin(cmd->args[0])) {
+        int status = run_builtin(cmd->args);
+        fflush(stdout);
+        exit(status);
+    }
+
+    // 执行命令
+    // 第二步：让子进程“变身”成外部命令
+    execvp(cmd->args[0], cmd->args);
+    // 如果 execvp 成功，下面的代码不会被执行
+    // 如果 execvp 成功，子进程就已经是 ls 了，永远不会执行到这里
+    if (errno == ENOENT && strchr(cmd->args[0], '/') == NULL) {
+        fprintf(stderr, "myshell: %s: command not found\n", cmd->args[0]); // 拼写建议由父进程打印
+    } else {
+        perror(cmd->args[0]);
+    }
+    exit(127);
+}
+
+// 普通外部命令可以交给孵化器启动；内建命令、函数、复合命令、run 前缀和带进程替换的命令仍然 fork
+static int can_use_zygote(command_t* cmd) {
+    return zygote_enabled() && cmd->compound == NULL && cmd->attrs == NULL && cmd->substs == NULL && cmd->args[0] != NULL &&
+           lookup_function(cmd->args[0]) == NULL && !is_builtin(cmd->args[0]);
+}
+
+/**
+ * @description: 在父进程中打开重定向文件，连同 stdin/stdout 一起交给孵化器启动命令
+ * @param {int} in_fd - 没有 < 重定向时使用的标准输入
+ * @param {int} out_fd - 没有 > 重定向时使用的标准输出
+ * @param {fanout_t*} fan - 有多个输出目标时，使用分发进程的管道作为标准输出
+ * @return {pid_t} - 子进程 pid；失败返回 -1，调用者改用 fork（重定向错误由子进程照常报告）
+ */
+static pid_t spawn_via_zygote(command_t* cmd, int in_fd, int out_fd, fanout_t* fan) {
+    int fds[3] = {in_fd, out_fd, STDERR_FILENO};
+    if (job_output_fd >= 0) {
+        if (out_fd == STDOUT_FILENO) fds[1] = job_output_fd;
+        fds[2] = job_output_fd;
+    }
+    int own_out = cmd->output_file && fan->fd < 0;
+    if (fan->fd >= 0) fds[1] = fan->fd;
+    if (cmd->input_file && (fds[0] = open(cmd->input_file, O_RDONLY | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+    if (own_out && (fds[1] = open_output(cmd)) < 0) {
+        if (cmd->input_file) close(fds[0]);
+        return -1;
+    }
+    pid_t pid = zygote_spawn(cmd->args, cmd->assigns, fds);
+    if (cmd->input_file) close(fds[0]);
+    if (own_out) close(fds[1]);
+    return pid;
+}
+
+// =================================================================
+// == 进程替换 <(list) / >(list)
+// =================================================================
+
+// 一条命令启动的进程替换：父进程持有的管道端和子 Shell 的 pid
+typedef struct {
+    int count;
+    int fds[MAX_ARGS];
+    pid_t pids[MAX_ARGS];
+} subst_state_t;
+
+// 把占位符换成 /dev/fd/N
+static void bind_subst_word(char** word, subst_state_t* st) {
+    if (*word == NULL || (*word)[0] != SUBST_MARK) return;
+    int index = atoi(*word + 1);
+    if (index < 0 || index >= st->count) return;
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", st->fds[index]);
+    free(*word);
+    *word = strdup(path);
+}
+
+// 关闭父进程持有的管道端。命令 fork 之后立即关闭，之后启动的进程不会继承它们
+static void close_substitutions(subst_state_t* st) {
+    for (int i = 0; i < st->count; i++) {
+        if (st->fds[i] >= 0) close(st->fds[i]);
+        st->fds[i] = -1;
+    }
+}
+
+// 命令结束后回收进程替换的子 Shell；后台命令交给事件循环回收
+static void finish_substitutions(subst_state_t* st, int background) {
+    close_substitutions(st);
+    if (st->count == 0) return;
+    if (background) {
+        for (int i = 0; i < st->count; i++) add_background_job(st->pids[i], 0, 0);
+    } else {
+        int statuses[st->count];
+        int via_zygote[st->count];
+        memset(via_zygote, 0, sizeof(via_zygote));
+        wait_children(st->pids, via_zygote, st->count, statuses, NULL, 0, NULL);
+    }
+    st->count = 0;
+}
+
+/**
+ * @description: 为命令中的每个进程替换创建管道并启动子 Shell，
+ * 把参数和重定向目标中的占位符换成 /dev/fd/N。管道端不设 FD_CLOEXEC，由命令继承
+ * @param {int} stray_fd - 子 Shell 中要关闭的 fd（管道中上一段的读端），没有时为 -1
+ * @return {int} - 成功返回 0；失败返回 -1（已打印错误，已启动的子 Shell 已回收）
+ */
+static int start_substitutions(command_t* cmd, subst_state_t* st, int stray_fd) {
+    st->count = 0;
+    for (proc_subst_t* ps = cmd->substs; ps != NULL; ps = ps->next) {
+        int fds[2];
+        if (st->count >= MAX_ARGS) {
+            fprintf(stderr, "myshell: too many process substitutions\n");
+            finish_substitutions(st, 0);
+            return -1;
+        }
+        if (pipe(fds) < 0) {
+            perror("pipe");
+            finish_substitutions(st, 0);
+            return -1;
+        }
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            close(fds[0]);
+            close(fds[1]);
+            finish_substitutions(st, 0);
+            return -1;
+        }
+        if (pid == 0) {
+            // 子 Shell：<(list) 的输出接到管道写端，>(list) 的输入接到管道读端
+            reset_interrupt_handler();
+            for (int i = 0; i < st->count; i++) close(st->fds[i]);
+            if (stray_fd > STDERR_FILENO) close(stray_fd);
+            capture_job_output();
+            dup2(ps->is_output ? fds[0] : fds[1], ps->is_output ? STDIN_FILENO : STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            exit(execute_node(ps->body));
+        }
+        close(ps->is_output ? fds[0] : fds[1]);
+        st->fds[st->count] = ps->is_output ? fds[1] : fds[0];
+        st->pids[st->count++] = pid;
+    }
+    if (st->count == 0) return 0;
+
+    for (int i = 0; cmd->args[i] != NULL; i++) bind_subst_word(&cmd->args[i], st);
+    bind_subst_word(&cmd->input_file, st);
+    bind_subst_word(&cmd->output_file, st);
+    for (output_target_t* t = cmd->more_outputs; t != NULL; t = t->next) bind_subst_word(&t->file, st);
+    return 0;
+}
+
+// =================================================================
+// == 限时命令的进程组
+// =================================================================
+
+// 限时的命令放进自己的进程组，超时后整组结束（包括它再启动的子进程）。
+// 在这样的进程组里再启动的限时命令不另建进程组，超时时逐个结束，外层的时限照样覆盖它们。
+static int in_timeout_group = 0;
+
+typedef struct {
+    int timed;        // 是否限时
+    timeout_t limit;
+    int new_group;    // 是否为这些命令新建进程组
+    int own_tty;      // Shell 是终端的前台进程组，需要把终端交给新的进程组
+    pid_t pgid;       // 第一个子进程启动后确定
+} spawn_group_t;
+
+// fork 之前确定时限：timeout/run --timeout 前缀优先，其次是 TMOUT_CMD
+static void group_init(spawn_group_t* group, command_t* cmds, int cmd_count, int background) {
+    memset(group, 0, sizeof(*group));
+    if (background) return;
+    for (int i = 0; i < cmd_count; i++) {
+        timeout_t limit;
+        if (spawn_timeout(cmds[i].attrs, &limit) && (!group->timed || limit.seconds < group->limit.seconds)) {
+            group->limit = limit;
+            group->timed = 1;
+        }
+    }
+    if (!group->timed) group->timed = default_timeout(&group->limit);
+    group->new_group = group->timed && !in_timeout_group;
+    group->own_tty = group->new_group && shell_owns_terminal();
+}
+
+// 子进程中：加入进程组，第一个子进程同时拿到终端。父子进程都设置一次，不依赖谁先运行
+static void group_child(spawn_group_t* group) {
+    if (!group->new_group) return;
+    setpgid(0, group->pgid);
+    if (group->own_tty && group->pgid == 0) set_terminal_pgrp(getpgrp());
+    in_timeout_group = 1;
+}
+
+static void group_parent(spawn_group_t* group, pid_t pid) {
+    if (!group->new_group) return;
+    setpgid(pid, group->pgid ? group->pgid : pid);
+    if (group->pgid == 0) {
+        group->pgid = pid;
+        if (group->own_tty) set_terminal_pgrp(pid);
+    }
+}
+
+// 等待这些命令结束，然后把终端收回
+static int group_wait(spawn_group_t* group, pid_t* pids, int* via_zygote, int count, int* statuses,
+                      const char** names) {
+    int overrun = wait_children(pids, via_zygote, count, statuses, group->timed ? &group->limit : NULL,
+                                group->new_group ? group->pgid : 0, names);
+    if (group->own_tty && group->pgid != 0) set_terminal_pgrp(getpgrp());
+    int by_sigint = wait_got_sigint;
+    for (int i = 0; i < count; i++) {
+        if (WIFSIGNALED(statuses[i]) && WTERMSIG(statuses[i]) == SIGINT) by_sigint = 1;
+    }
+    if (by_sigint) foreground_interrupted();
+    return overrun;
+}
+
+// 测速和超时报告里使用的命令名
+static const char* stage_name(command_t* cmd) {
+    if (cmd->compound) return "(compound)";
+    return cmd->args[0] ? cmd->args[0] : "(empty)";
+}
+
+/**
+ * @description: 执行单个命令，支持I/O重定向和后台执行
+ * @return {int} - 命令的退出码（后台命令返回 0）
+ */
+int execute_command(command_t* cmd) {
+    if (cmd->args[0] == NULL && cmd->compound == NULL) {
+        return 0; // 空命令
+    }
+
+    fflush(NULL); // 避免子进程把父进程缓冲区里的内容再输出一遍
+    side_effect_count++;
+
+    spawn_group_t group;
+    group_init(&group, cmd, 1, cmd->is_background);
+
+    // 进程替换要在打开重定向目标之前启动，目标可能就是 >(list)
+    subst_state_t substs;
+    if (start_substitutions(cmd, &substs, -1) < 0) {
+        return 1;
+    }
+    fanout_t fan;
+    if (start_fanout(cmd, &fan) < 0) {
+        finish_substitutions(&substs, 0);
+        return 1;
+    }
+
+    pid_t pid = -1;
+    int via_zygote = 0;
+    if (!group.timed && can_use_zygote(cmd)) {
+        pid = spawn_via_zygote(cmd, STDIN_FILENO, STDOUT_FILENO, &fan);
+        via_zygote = (pid > 0);
+    }
+    if (!via_zygote) {
+        pid = fork(); //第一步，克隆自己，创建子进程
+    }
 
     if (pid < 0) {
         perror("fork");
-        return;
+        if (fan.fd >= 0) close(fan.fd);
+        if (fan.pid > 0) waitpid(fan.pid, NULL, 0);
+        finish_substitutions(&substs, 0);
+        return 1;
     }
 
-    if (pid == 0) {
+    if (!via_zygote && pid == 0) {
         // --- 子进程 ---
-        int fd_in, fd_out;
-
-        // 处理输入重定向--结构体定义
-        if (cmd->input_file) {
-            // 打开一个文件，获取一个“文件描述符”（File Descriptor），这是一个代表该文件的整数。
-            fd_in = open(cmd->input_file, O_RDONLY);
-            if (fd_in == -1) {
-                perror(cmd->input_file);
-                exit(EXIT_FAILURE);
-            }
-            // dup2(old_fd, new_fd)是重定向的核心。它会复制一个文件描述符，让 new_fd 指向和 old_fd 同一个文件。
-            // dup2(file_fd, STDOUT_FILENO) 就让“标准输出”（STDOUT_FILENO，通常是1）指向了我们用 open 打开的文件。
-            dup2(fd_in, STDIN_FILENO); // 把标准输入指到这个文件
-            close(fd_in);
+        reset_interrupt_handler();
+        group_child(&group);
+        capture_job_output();
+        export_assignments(cmd->assigns);
+        if (redirect_in_child(cmd, &fan) < 0) {
+            exit(EXIT_FAILURE);
         }
+        exec_in_child(cmd);
+    }
 
-        // 处理输出重定向
-        if (cmd->output_file) {
-            fd_out = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd_out == -1) {
-                perror(cmd->output_file);
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd_out, STDOUT_FILENO); // 把标准输出指向这个文件
-            close(fd_out);
-        }
-        
-        // 执行命令
-        // 第二步：让子进程“变身”成外部命令
-        execvp(cmd->args[0], cmd->args);
-        // 如果 execvp 成功，下面的代码不会被执行
-        // 如果 execvp 成功，子进程就已经是 ls 了，永远不会执行到这里
-        perror(cmd->args[0]);
-        exit(EXIT_FAILURE);
-    } else {
-        // --- 父进程 ---
+    // --- 父进程 ---
+    if (!via_zygote) group_parent(&group, pid);
+    if (fan.fd >= 0) close(fan.fd); // 写端只留给命令，命令结束时分发进程读到 EOF
+    close_substitutions(&substs);
 
-        // 第三步：父进程等待子进程结束
-        if (!cmd->is_background) {
-            // 如果不是前台任务，则等待
-            // 父进程用它来等待子进程结束。这是前后台执行的分水岭。
-            waitpid(pid, NULL, 0);
-        } else {
-            // 如果是后台任务，打印 PID 并且不等待
-            printf("[%d]\n", pid);
-        }
+    // 第三步：父进程等待子进程结束
+    if (!cmd->is_background) {
+        // 如果不是前台任务，则等待
+        // 父进程用它来等待子进程结束。这是前后台执行的分水岭。超时的命令退出码为 124
+        int status;
+        const char* name = stage_name(cmd);
+        int overrun = group_wait(&group, &pid, &via_zygote, 1, &status, &name);
+        if (fan.pid > 0) waitpid(fan.pid, NULL, 0);
+        finish_substitutions(&substs, 0);
+        if (overrun >= 0) return 124;
+        if (wait_status_to_exit(status) == 127 && cmd->compound == NULL) report_command_not_found(cmd->args[0]);
+        return wait_status_to_exit(status);
     }
+    // 如果是后台任务，打印 PID 并且不等待，交互模式下由事件循环回收
+    announce_background(pid);
+    add_background_job(pid, via_zygote, 1);
+    if (fan.pid > 0) add_background_job(fan.pid, 0, 0);
+    finish_substitutions(&substs, 1);
+    return 0;
 }
 
+/**
+ * @description: 管道中途 pipe/fork 失败时的清理：关闭手里的管道读端，
+ * 结束并回收已经启动的命令和测速中继，不留下打开的 fd 和僵尸进程
+ * @return {int} - 总是返回 1
+ */
+static int abort_pipeline(int in_fd, pid_t* pids, int* via_zygote, int started,
+                          pid_t* helper_pids, int helper_count, spawn_group_t* group) {
+    if (in_fd != STDIN_FILENO) close(in_fd);
+    for (int i = 0; i < started; i++) {
+        kill(pids[i], SIGTERM);
+    }
+    if (started > 0) {
+        int statuses[started];
+        group->timed = 0;
+        group_wait(group, pids, via_zygote, started, statuses, NULL);
+    }
+    for (int i = 0; i < helper_count; i++) {
+        waitpid(helper_pids[i], NULL, 0);
+    }
+    return 1;
+}
 
 /**
  * @description: 执行一个包含多个命令的管道
+ * @return {int} - 最后一个命令的退出码（后台管道返回 0）
  */
 
 // 以 ls | grep .c 为例
 // 解析: parser 将命令分割成两个 command_t 结构，一个给 ls，一个给 grep。
-void execute_pipeline(command_t* cmds, int cmd_count) {
+int execute_pipeline(command_t* cmds, int cmd_count) {
     int pipe_fds[2];
     int in_fd = STDIN_FILENO;
     pid_t pids[cmd_count];
+    int via_zygote[cmd_count];
+    // |> 测速中继、多目标输出的分发进程和进程替换的子 Shell，与管道一起回收
+    int subst_total = 0;
+    for (int i = 0; i < cmd_count; i++) {
+        for (proc_subst_t* ps = cmds[i].substs; ps != NULL; ps = ps->next) subst_total++;
+    }
+    pid_t helper_pids[cmd_count * 2 + subst_total];
+    int helper_count = 0;
+
+    fflush(NULL);
+    side_effect_count++;
 
+    // 整条管道共用一个时限和进程组
+    spawn_group_t group;
+    group_init(&group, cmds, cmd_count, cmds[cmd_count - 1].is_background);
 
-    // 循环多次 
+    // 循环多次
     for (int i = 0; i < cmd_count; i++) {
+        // 进程替换先于这一段的管道启动，子 Shell 不会拿着管道的写端
+        subst_state_t substs;
+        if (start_substitutions(&cmds[i], &substs, in_fd) < 0) {
+            return abort_pipeline(in_fd, pids, via_zygote, i, helper_pids, helper_count, &group);
+        }
+        for (int k = 0; k < substs.count; k++) helper_pids[helper_count++] = substs.pids[k];
+
         if (i < cmd_count - 1) {
             // pipe(): 创建一个管道，返回两个文件描述符，一个用于读，一个用于写。
             // 创建管道: 父进程调用 pipe(pipe_fds)，得到 pipe_fds[0]（读取端）和 pipe_fds[1]（写入端）。
             if (pipe(pipe_fds) < 0) {
                 perror("pipe");
-                return;
+                close_substitutions(&substs);
+                return abort_pipeline(in_fd, pids, via_zygote, i, helper_pids, helper_count, &group);
+            }
+            apply_pipe_size(cmds[i].attrs, pipe_fds[1]); // run --pipe-size
+        }
+
+        // 这一段有多个输出目标：先启动分发进程
+        fanout_t fan;
+        if (start_fanout(&cmds[i], &fan) < 0) {
+            close_substitutions(&substs);
+            if (i < cmd_count - 1) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
             }
+            return abort_pipeline(in_fd, pids, via_zygote, i, helper_pids, helper_count, &group);
+        }
+        if (fan.pid > 0) helper_pids[helper_count++] = fan.pid;
+
+        // 普通外部命令优先交给孵化器，管道两端作为它的 stdin/stdout 传过去
+        via_zygote[i] = 0;
+        if (!group.timed && can_use_zygote(&cmds[i])) {
+            pids[i] = spawn_via_zygote(&cmds[i], in_fd, i < cmd_count - 1 ? pipe_fds[1] : STDOUT_FILENO, &fan);
+            via_zygote[i] = (pids[i] > 0);
         }
 
         // fork(): 每次循环可以为管道中的每一个命令都创建一个子进程
-        pids[i] = fork();
+        if (!via_zygote[i]) {
+            pids[i] = fork();
+        }
         if (pids[i] < 0) {
             perror("fork");
-            return;
+            if (fan.fd >= 0) close(fan.fd);
+            close_substitutions(&substs);
+            if (i < cmd_count - 1) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+            }
+            return abort_pipeline(in_fd, pids, via_zygote, i, helper_pids, helper_count, &group);
         }
 
-        if (pids[i] == 0) { // --- 子进程 ---
-
+        if (!via_zygote[i] && pids[i] == 0) { // --- 子进程 ---
+            reset_interrupt_handler();
+            group_child(&group);
+            capture_job_output();
 
             // 如果这个命令不是第一个，那它就需要“把前一个命令的输出当作自己的输入”。
             // 而“前一个命令的输出”，在上一轮 pipe() 时保存在了 in_fd 中（读端）。
@@ -120,21 +728,39 @@ void execute_pipeline(command_t* cmds, int cmd_count) {
                 close(pipe_fds[0]);
                 close(pipe_fds[1]);
             }
-            
+
+            // 显式的 < > 重定向优先于管道
+            export_assignments(cmds[i].assigns);
+            if (redirect_in_child(&cmds[i], &fan) < 0) {
+                exit(EXIT_FAILURE);
+            }
+
             // 调用 execvp("ls", ...)
             // 最后调用 execvp("grep", ...)
-            execvp(cmds[i].args[0], cmds[i].args);
-            perror(cmds[i].args[0]);
-            exit(EXIT_FAILURE);
+            exec_in_child(&cmds[i]);
         }
 
         // --- 父进程 ---
+        if (!via_zygote[i]) group_parent(&group, pids[i]);
+        if (fan.fd >= 0) close(fan.fd);
+        close_substitutions(&substs);
         if (in_fd != STDIN_FILENO) {
             close(in_fd);  //把当前的 in_fd 关掉（已经给了子进程）
         }
         if (i < cmd_count - 1) {
             close(pipe_fds[1]);
             in_fd = pipe_fds[0];  // ‼️把新的管道读端传下去，给下一个子命令用
+
+            // |> ：在这条边上插入测速中继，下一个命令改为从中继的输出读
+            if (cmds[i].meter_output) {
+                int relay_fd;
+                pid_t pid = start_pipe_meter(in_fd, &relay_fd, i + 1, stage_name(&cmds[i]), stage_name(&cmds[i + 1]));
+                if (pid > 0) {
+                    close(in_fd);
+                    in_fd = relay_fd;
+                    helper_pids[helper_count++] = pid;
+                }
+            }
         }
     }
 
@@ -143,8 +769,463 @@ void execute_pipeline(command_t* cmds, int cmd_count) {
         close(in_fd);  //  最后一轮管道读端也要关闭
     }
 
-    // 等待所有子进程结束
+    if (cmds[cmd_count - 1].is_background) {
+        announce_background(pids[cmd_count - 1]);
+        for (int i = 0; i < cmd_count; i++) {
+            add_background_job(pids[i], via_zygote[i], i == cmd_count - 1);
+        }
+        for (int i = 0; i < helper_count; i++) {
+            add_background_job(helper_pids[i], 0, 0);
+        }
+        return 0;
+    }
+
+    // 同时等待所有子进程结束，管道的退出码取最后一个命令；超时的管道退出码为 124
+    int statuses[cmd_count];
+    const char* names[cmd_count];
     for (int i = 0; i < cmd_count; i++) {
-        waitpid(pids[i], NULL, 0);
+        names[i] = stage_name(&cmds[i]);
+    }
+    int overrun = group_wait(&group, pids, via_zygote, cmd_count, statuses, names);
+    for (int i = 0; i < helper_count; i++) {
+        waitpid(helper_pids[i], NULL, 0);
     }
-}
\ No newline at end of file
+    for (int i = 0; i < cmd_count && overrun < 0; i++) {
+        if (wait_status_to_exit(statuses[i]) == 127 && cmds[i].compound == NULL) report_command_not_found(cmds[i].args[0]);
+    }
+    return overrun >= 0 ? 124 : wait_status_to_exit(statuses[cmd_count - 1]);
+}
+
+// =================================================================
+// == 语法树的执行
+// =================================================================
+
+/**
+ * @description: 执行一条简单命令或复合命令（单独一段，不在管道中）
+ * 内建命令、函数和复合命令直接在 Shell 进程内执行，外部命令 fork 执行
+ */
+static int execute_simple(command_t* raw, int background) {
+    command_t cmd;
+    if (expand_command(raw, &cmd) < 0) {
+        return 1;
+    }
+
+    int status = 0;
+    saved_fds_t saved;
+    subst_state_t substs = {0};
+    node_t* func = NULL;
+
+    // run 前缀：设置要在子进程中生效，所以即使是内建命令也 fork 执行
+    int has_attrs = parse_run_prefix(&cmd);
+    if (has_attrs < 0) {
+        status = 2;
+    } else if (cmd.args[0] == NULL && cmd.compound == NULL) {
+        // 只有赋值和重定向，例如 `x=1` 或 `> file`
+        apply_assignments(cmd.assigns);
+        if (start_substitutions(&cmd, &substs, -1) < 0) {
+            status = 1;
+        } else {
+            if (push_redirects(&cmd, &saved) < 0) status = 1;
+            pop_redirects(&saved);
+        }
+    } else if (!background && !has_attrs && (cmd.compound != NULL ||
+               (func = lookup_function(cmd.args[0])) != NULL || is_builtin(cmd.args[0]))) {
+        // 【路径 A】在当前 Shell 进程内执行（cd 这样的命令必须如此）
+        apply_assignments(cmd.assigns);
+        if (start_substitutions(&cmd, &substs, -1) < 0) {
+            status = 1;
+        } else {
+            if (push_redirects(&cmd, &saved) < 0) {
+                status = 1;
+            } else if (cmd.compound != NULL) {
+                status = execute_node(cmd.compound);
+            } else if (func != NULL) {
+                status = call_function(func, cmd.args);
+            } else {
+                if (!is_pure_builtin(cmd.args[0])) side_effect_count++;
+                status = run_builtin(cmd.args);
+            }
+            pop_redirects(&saved);
+        }
+    } else {
+        //【路径 B】外部命令，或者需要放到后台的命令，fork 一个子进程执行
+        cmd.is_background = background;
+        status = execute_command(&cmd);
+    }
+    finish_substitutions(&substs, 0);
+
+    free_expanded_command(&cmd);
+    return status;
+}
+
+static int execute_pipeline_node(node_t* node, int background) {
+    if (node->cmd_count == 1) {
+        return execute_simple(&node->cmds[0], background);
+    }
+
+    command_t expanded[node->cmd_count];
+    int status = 1;
+    int n = 0;
+    for (; n < node->cmd_count; n++) {
+        if (expand_command(&node->cmds[n], &expanded[n]) < 0) break;
+        expanded[n].is_background = background;
+        if (parse_run_prefix(&expanded[n]) < 0) {
+            free_expanded_command(&expanded[n]);
+            break;
+        }
+        // 第一段的 run 设置作用于整条管道，除非某一段有自己的 run
+        if (n > 0 && expanded[n].attrs == NULL) {
+            expanded[n].attrs = copy_spawn_attrs(expanded[0].attrs);
+        }
+    }
+    if (n == node->cmd_count) {
+        status = execute_pipeline(expanded, n);
+    }
+    for (int i = 0; i < n; i++) {
+        free_expanded_command(&expanded[i]);
+    }
+    return status;
+}
+
+// 是否有 break/continue/return 或 Ctrl+C 正在向外传递
+static int control_pending() {
+    return pending_break || pending_continue || pending_return || interrupted;
+}
+
+/**
+ * @description: 执行 while/until 循环。循环体是语法树，每次迭代不需要重新解析
+ */
+static int execute_loop(node_t* node) {
+    int status = 0;
+    loop_depth++;
+    for (;;) {
+        int cond = execute_node(node->left);
+        if (control_pending()) {
+            if (pending_break) pending_break--;
+            else if (pending_continue && --pending_continue == 0) continue;
+            break;
+        }
+        if ((cond == 0) != (node->type == NODE_WHILE)) break;
+
+        status = execute_node(node->right);
+        if (pending_break) {
+            pending_break--;
+            break;
+        }
+        if (pending_continue) {
+            if (--pending_continue > 0) break; // continue 外层循环
+            continue;
+        }
+        if (pending_return || interrupted) break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int execute_for(node_t* node) {
+    int count = 0;
+    char** values;
+    if (node->words != NULL) {
+        values = expand_word_list(node->words, &count);
+    } else {
+        // 省略 in 时遍历位置参数
+        count = get_positional_count();
+        values = (char**)malloc(sizeof(char*) * (count + 1));
+        for (int i = 0; i < count; i++) values[i] = strdup(get_positional(i + 1));
+        values[count] = NULL;
+    }
+
+    int status = 0;
+    loop_depth++;
+    for (int i = 0; i < count; i++) {
+        set_var(node->name, values[i]);
+        status = execute_node(node->right);
+        if (pending_break) {
+            pending_break--;
+            break;
+        }
+        if (pending_continue) {
+            if (--pending_continue > 0) break;
+            continue;
+        }
+        if (pending_return || interrupted) break;
+    }
+    loop_depth--;
+
+    for (int i = 0; i < count; i++) free(values[i]);
+    free(values);
+    return status;
+}
+
+// (( expr ))：值非 0 时成功。表达式出错时返回 1
+static int execute_arith(const char* expr) {
+    long long value;
+    if (arith_evaluate(expr, &value) < 0) return 1;
+    return value == 0;
+}
+
+/**
+ * @description: for ((init; cond; step))。条件为空时一直循环
+ */
+static int execute_arith_for(node_t* node) {
+    long long value;
+    if (node->words[0][0] != '\0' && arith_evaluate(node->words[0], &value) < 0) return 1;
+
+    int status = 0;
+    loop_depth++;
+    for (;;) {
+        if (node->words[1][0] != '\0') {
+            if (arith_evaluate(node->words[1], &value) < 0) {
+                status = 1;
+                break;
+            }
+            if (value == 0) break;
+        }
+        status = execute_node(node->right);
+        if (pending_break) {
+            pending_break--;
+            break;
+        }
+        if (pending_continue && --pending_continue > 0) break;
+        if (pending_return || interrupted) break;
+        if (node->words[2][0] != '\0' && arith_evaluate(node->words[2], &value) < 0) {
+            status = 1;
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+static int execute_case(node_t* node) {
+    char* word = expand_word_string(node->name);
+    int status = 0;
+
+    for (case_item_t* item = node->items; item != NULL; item = item->next) {
+        int matched = 0;
+        for (int i = 0; item->patterns[i] != NULL && !matched; i++) {
+            char* pattern = expand_word_string(item->patterns[i]);
+            matched = (fnmatch(pattern, word, 0) == 0);
+            free(pattern);
+        }
+        if (matched) {
+            if (item->body) status = execute_node(item->body);
+            break;
+        }
+    }
+    free(word);
+    return status;
+}
+
+static int execute_subshell(node_t* body) {
+    fflush(NULL);
+    side_effect_count++;
+    spawn_group_t group;
+    group_init(&group, NULL, 0, 0); // 只受 TMOUT_CMD 限制
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        reset_interrupt_handler();
+        group_child(&group);
+        exit(execute_node(body));
+    }
+    group_parent(&group, pid);
+    int status, via_zygote = 0;
+    const char* name = "(subshell)";
+    if (group_wait(&group, &pid, &via_zygote, 1, &status, &name) >= 0) return 124;
+    return wait_status_to_exit(status);
+}
+
+// jobs 列表中显示的命令：管道各段的命令名，其他语句显示为子 Shell
+static void job_label(node_t* node, char* buf, size_t size) {
+    if (node->type != NODE_PIPELINE) {
+        snprintf(buf, size, "(subshell)");
+        return;
+    }
+    buf[0] = '\0';
+    for (int i = 0; i < node->cmd_count; i++) {
+        size_t used = strlen(buf);
+        snprintf(buf + used, size - used, "%s%s", i > 0 ? " | " : "", stage_name(&node->cmds[i]));
+    }
+}
+
+// 以 & 结尾的命令：简单命令和管道直接在后台启动，其他的放进子 Shell
+static int start_background(node_t* node) {
+    if (node->type == NODE_PIPELINE) {
+        return execute_pipeline_node(node, 1);
+    }
+    fflush(NULL);
+    side_effect_count++;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        reset_interrupt_handler();
+        capture_job_output();
+        node->is_background = 0;
+        exit(execute_node(node));
+    }
+    announce_background(pid);
+    add_background_job(pid, 0, 1);
+    return 0;
+}
+
+// JOB_CAPTURE 打开时，后台任务的 stdout/stderr 写进 joblog 的缓冲区
+static int execute_background(node_t* node) {
+    last_background_pid = 0;
+    job_output_fd = job_capture_begin();
+    int status = start_background(node);
+
+    char label[256];
+    job_label(node, label, sizeof(label));
+    job_capture_end(job_output_fd, last_background_pid, label);
+    job_output_fd = -1;
+    return status;
+}
+
+static int dispatch_node(node_t* node);
+
+static double timespec_seconds(const struct timespec* ts) {
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval* tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/**
+ * @description: time 关键字：执行后向 stderr 报告实际耗时和子进程的用户态/内核态 CPU 时间
+ * 孵化器启动的命令不是 Shell 的子进程，它们的 CPU 时间由孵化器随退出状态一起报告
+ */
+static int execute_timed(node_t* node) {
+    struct timespec start, end;
+    struct rusage ru_start, ru_end;
+    double zy_user_start, zy_sys_start, zy_user_end, zy_sys_end;
+
+    getrusage(RUSAGE_CHILDREN, &ru_start);
+    zygote_children_times(&zy_user_start, &zy_sys_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status = dispatch_node(node);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &ru_end);
+    zygote_children_times(&zy_user_end, &zy_sys_end);
+
+    double user = timeval_seconds(&ru_end.ru_utime) - timeval_seconds(&ru_start.ru_utime) +
+                  zy_user_end - zy_user_start;
+    double sys = timeval_seconds(&ru_end.ru_stime) - timeval_seconds(&ru_start.ru_stime) +
+                 zy_sys_end - zy_sys_start;
+    fprintf(stderr, "real %.6fs  user %.6fs  sys %.6fs\n",
+            timespec_seconds(&end) - timespec_seconds(&start), user, sys);
+    return status;
+}
+
+/**
+ * @description: 执行一棵语法树
+ * @return {int} - 退出码，同时保存到 $?
+ */
+int execute_node(node_t* node) {
+    if (node == NULL) return 0;
+    if (interrupted) return last_exit_status = INTERRUPTED_STATUS;
+
+    int status;
+    if (node->is_background) {
+        status = execute_background(node);
+    } else if (node->timed) {
+        status = execute_timed(node);
+    } else {
+        status = dispatch_node(node);
+    }
+    if (interrupted) status = INTERRUPTED_STATUS;
+    last_exit_status = status;
+    return status;
+}
+
+// 按节点类型执行，不处理 & 和 time
+static int dispatch_node(node_t* node) {
+    int status = 0;
+    switch (node->type) {
+    case NODE_PIPELINE:
+        status = execute_pipeline_node(node, 0);
+        break;
+    case NODE_SEQUENCE:
+        status = execute_node(node->left);
+        if (!control_pending()) status = execute_node(node->right);
+        break;
+    case NODE_AND:
+        status = execute_node(node->left);
+        if (status == 0 && !control_pending()) status = execute_node(node->right);
+        break;
+    case NODE_OR:
+        status = execute_node(node->left);
+        if (status != 0 && !control_pending()) status = execute_node(node->right);
+        break;
+    case NODE_NOT:
+        status = !execute_node(node->left);
+        break;
+    case NODE_SUBSHELL:
+        status = execute_subshell(node->left);
+        break;
+    case NODE_GROUP:
+        status = execute_node(node->left);
+        break;
+    case NODE_IF:
+        status = execute_node(node->left);
+        if (control_pending()) break;
+        if (status == 0) status = execute_node(node->right);
+        else status = node->else_part ? execute_node(node->else_part) : 0;
+        break;
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        status = execute_loop(node);
+        break;
+    case NODE_FOR:
+        status = execute_for(node);
+        break;
+    case NODE_CASE:
+        status = execute_case(node);
+        break;
+    case NODE_FUNCDEF:
+        define_function(node->name, node->left);
+        status = 0;
+        break;
+    case NODE_ARITH:
+        status = execute_arith(node->name);
+        break;
+    case NODE_ARITH_FOR:
+        status = execute_arith_for(node);
+        break;
+    }
+    return status;
+}
+
+/**
+ * @description: 解析并执行一段文本（脚本文件、-c 参数）
+ * @return {int} - 最后一条命令的退出码
+ */
+int execute_string(const char* src) {
+    size_t pos = 0;
+    node_t* node;
+    int r;
+
+    while ((r = parse_next(src, &pos, &node)) != PARSE_EOF) {
+        if (r == PARSE_INCOMPLETE) {
+            fprintf(stderr, "myshell: syntax error: unexpected end of file\n");
+            last_exit_status = 2;
+            break;
+        }
+        if (r == PARSE_ERROR) {
+            last_exit_status = 2;
+            continue;
+        }
+        execute_node(node);
+        free_node(node);
+    }
+    return last_exit_status;
+}
@@ -0,0 +1,348 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-07-21 10:40:15
+ * @FilePath: /linux-shell/src/expand.c
+ * @Descripttion: 展开模块-把解析器保留的原始词展开成最终的参数（引号、转义、$变量、$((算术))、~）
+ */
+#include "shell.h"
+
+// 一个可增长的字符串缓冲区
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void sb_putc(strbuf_t* sb, char c) {
+    if (sb->len + 2 > sb->cap) {
+        sb->cap = sb->cap ? sb->cap * 2 : 64;
+        sb->data = (char*)realloc(sb->data, sb->cap);
+    }
+    sb->data[sb->len++] = c;
+    sb->data[sb->len] = '\0';
+}
+
+static void sb_puts(strbuf_t* sb, const char* s) {
+    while (*s) sb_putc(sb, *s++);
+}
+
+// 展开过程中的状态：当前正在拼接的字段和已经完成的字段列表
+typedef struct {
+    strbuf_t cur;
+    int have_field;     // 当前字段是否已经存在（"" 这样的空引号也算一个字段）
+    int split;          // 是否对未加引号的展开结果做分词
+    char** fields;
+    int count;
+    int max;            // 最多允许的字段数，为 0 时 fields 按需扩容
+    int cap;
+    int overflow;
+    int failed;         // 算术展开出错（错误信息已经打印）
+} expander_t;
+
+static void push_field(expander_t* e, const char* s) {
+    if (e->max == 0) {
+        if (e->count + 1 >= e->cap) {
+            e->cap = e->cap ? e->cap * 2 : 16;
+            e->fields = (char**)realloc(e->fields, sizeof(char*) * e->cap);
+        }
+    } else if (e->count >= e->max) {
+        e->overflow = 1;
+        return;
+    }
+    e->fields[e->count++] = strdup(s);
+}
+
+static void end_field(expander_t* e) {
+    if (!e->have_field) return;
+    push_field(e, e->cur.data ? e->cur.data : "");
+    e->cur.len = 0;
+    if (e->cur.data) e->cur.data[0] = '\0';
+    e->have_field = 0;
+}
+
+static void put_literal(expander_t* e, char c) {
+    sb_putc(&e->cur, c);
+    e->have_field = 1;
+}
+
+// 放入一段展开结果：加引号时原样拼接，否则按空白分词
+static void put_value(expander_t* e, const char* value, int quoted) {
+    if (quoted || !e->split) {
+        sb_puts(&e->cur, value);
+        e->have_field = 1;
+        return;
+    }
+    for (; *value; value++) {
+        if (*value == ' ' || *value == '\t' || *value == '\n') {
+            end_field(e);
+        } else {
+            put_literal(e, *value);
+        }
+    }
+}
+
+/**
+ * @description: 展开以 $ 开头的一段（s[*i] 是 '$'）
+ */
+static void expand_dollar(expander_t* e, const char* s, size_t* i, int quoted) {
+    size_t p = *i + 1;
+    char num[32];
+
+    if (s[p] == '(' && s[p + 1] == '(') {
+        long end = arith_find_end(s + p + 2);
+        if (end >= 0) {
+            char* expr = strndup(s + p + 2, end);
+            long long value;
+            if (arith_evaluate(expr, &value) == 0) {
+                snprintf(num, sizeof(num), "%lld", value);
+                put_value(e, num, quoted);
+            } else {
+                e->failed = 1;
+            }
+            free(expr);
+            *i = p + 2 + end + 2;
+            return;
+        }
+    }
+    if (s[p] == '{') {
+        size_t end = p + 1;
+        while (s[end] != '\0' && s[end] != '}') end++;
+        char* name = strndup(s + p + 1, end - p - 1);
+        const char* value = get_var(name);
+        if (value) put_value(e, value, quoted);
+        free(name);
+        *i = (s[end] == '}') ? end + 1 : end;
+        return;
+    }
+    if (is_valid_name(s + p, 1)) {
+        size_t end = p;
+        while (is_valid_name(s + p, end - p + 1)) end++;
+        char* name = strndup(s + p, end - p);
+        const char* value = get_var(name);
+        if (value) put_value(e, value, quoted);
+        free(name);
+        *i = end;
+        return;
+    }
+
+    switch (s[p]) {
+    case '?':
+        snprintf(num, sizeof(num), "%d", last_exit_status);
+        put_value(e, num, quoted);
+        break;
+    case '$':
+        snprintf(num, sizeof(num), "%d", (int)getpid());
+        put_value(e, num, quoted);
+        break;
+    case '#':
+        snprintf(num, sizeof(num), "%d", get_positional_count());
+        put_value(e, num, quoted);
+        break;
+    case '@':
+    case '*':
+        // "$@" 展开成多个字段，每个参数各占一个；$* 和未加引号的 $@ 再按空白分词
+        for (int n = 1; n <= get_positional_count(); n++) {
+            if (n > 1) {
+                if (quoted && s[p] == '@') end_field(e);
+                else put_value(e, " ", quoted);
+            }
+            put_value(e, get_positional(n), quoted);
+        }
+        break;
+    default:
+        if (s[p] >= '0' && s[p] <= '9') {
+            const char* value = get_positional(s[p] - '0');
+            if (value) put_value(e, value, quoted);
+        } else {
+            // 不是变量，$ 按普通字符处理
+            put_literal(e, '$');
+            *i = p;
+            return;
+        }
+    }
+    *i = p + 1;
+}
+
+/**
+ * @description: 展开一个原始词，结果追加到 e->fields
+ */
+static void expand_word(expander_t* e, const char* s) {
+    // 快速路径：绝大多数词不含任何特殊字符
+    if (strpbrk(s, "'\"\\$~") == NULL) {
+        push_field(e, s);
+        return;
+    }
+
+    size_t i = 0;
+    if (s[0] == '~' && (s[1] == '\0' || s[1] == '/')) {
+        const char* home = get_var("HOME");
+        put_value(e, home ? home : "~", 1);
+        i = 1;
+    }
+
+    while (s[i] != '\0') {
+        char c = s[i];
+        if (c == '\'') {
+            e->have_field = 1;
+            for (i++; s[i] != '\0' && s[i] != '\''; i++) put_literal(e, s[i]);
+            if (s[i] == '\'') i++;
+        } else if (c == '\"') {
+            e->have_field = 1;
+            i++;
+            while (s[i] != '\0' && s[i] != '\"') {
+                if (s[i] == '\\' && strchr("$`\"\\\n", s[i + 1]) && s[i + 1] != '\0') {
+                    if (s[i + 1] != '\n') put_literal(e, s[i + 1]);
+                    i += 2;
+                } else if (s[i] == '$') {
+                    expand_dollar(e, s, &i, 1);
+                } else {
+                    put_literal(e, s[i++]);
+                }
+            }
+            if (s[i] == '\"') i++;
+        } else if (c == '\\') {
+            if (s[i + 1] != '\0' && s[i + 1] != '\n') put_literal(e, s[i + 1]);
+            i += (s[i + 1] != '\0') ? 2 : 1;
+        } else if (c == '$') {
+            expand_dollar(e, s, &i, 0);
+        } else {
+            put_literal(e, c);
+            i++;
+        }
+    }
+    end_field(e);
+}
+
+/**
+ * @description: 把一个词展开成单个字符串（不分词），用于重定向目标、赋值和 case
+ * @return {char*} - 新分配的字符串，调用者负责 free
+ */
+char* expand_word_string(const char* word) {
+    char* field = NULL;
+    expander_t e = {0};
+    e.fields = &field;
+    e.max = 1;
+    e.split = 0;
+    expand_word(&e, word);
+    free(e.cur.data);
+    return field ? field : strdup("");
+}
+
+/**
+ * @description: 展开一个词列表（for 循环使用），字段个数不受 MAX_ARGS 限制
+ * @param {char**} words - 以 NULL 结尾的原始词列表
+ * @param {int*} count - 输出：字段个数
+ * @return {char**} - 以 NULL 结尾的字段数组，调用者负责逐个 free
+ */
+char** expand_word_list(char** words, int* count) {
+    expander_t e = {0};
+    e.split = 1;
+    for (int i = 0; words[i] != NULL; i++) {
+        expand_word(&e, words[i]);
+    }
+    free(e.cur.data);
+    if (e.fields == NULL) e.fields = (char**)malloc(sizeof(char*));
+    e.fields[e.count] = NULL;
+    *count = e.count;
+    return e.fields;
+}
+
+// 展开 NAME=value 形式的赋值，只展开等号右边
+static char* expand_assignment(const char* assign) {
+    const char* eq = strchr(assign, '=');
+    char* value = expand_word_string(eq + 1);
+    size_t name_len = eq - assign;
+    char* result = (char*)malloc(name_len + strlen(value) + 2);
+    memcpy(result, assign, name_len + 1);
+    strcpy(result + name_len + 1, value);
+    free(value);
+    return result;
+}
+
+/**
+ * @description: 把解析器产出的原始命令展开成可以直接执行的命令
+ * @param {const command_t*} raw - 语法树中的命令（不会被修改）
+ * @param {command_t*} out - 输出：展开后的命令，用完后调用 free_expanded_command
+ * @return {int} - 成功返回 0，参数过多或算术展开出错返回 -1
+ */
+int expand_command(const command_t* raw, command_t* out) {
+    memset(out, 0, sizeof(command_t));
+
+    expander_t e = {0};
+    e.fields = out->args;
+    e.max = MAX_ARGS - 1;
+    e.split = 1;
+    for (int i = 0; raw->args[i] != NULL; i++) {
+        expand_word(&e, raw->args[i]);
+    }
+    free(e.cur.data);
+    out->args[e.count] = NULL;
+
+    if (raw->input_file) out->input_file = expand_word_string(raw->input_file);
+    if (raw->output_file) out->output_file = expand_word_string(raw->output_file);
+    out->append_output = raw->append_output;
+    output_target_t** tail = &out->more_outputs;
+    for (output_target_t* t = raw->more_outputs; t != NULL; t = t->next) {
+        *tail = (output_target_t*)calloc(1, sizeof(output_target_t));
+        (*tail)->file = expand_word_string(t->file);
+        (*tail)->append = t->append;
+        tail = &(*tail)->next;
+    }
+    out->is_background = raw->is_background;
+    out->meter_output = raw->meter_output;
+    out->compound = raw->compound;
+    out->substs = raw->substs; // 和复合命令一样属于原始命令
+
+    if (raw->assigns) {
+        int n = 0;
+        while (raw->assigns[n] != NULL) n++;
+        out->assigns = (char**)malloc(sizeof(char*) * (n + 1));
+        for (int i = 0; i < n; i++) {
+            out->assigns[i] = expand_assignment(raw->assigns[i]);
+        }
+        out->assigns[n] = NULL;
+    }
+
+    if (e.overflow) {
+        fprintf(stderr, "myshell: too many arguments\n");
+        free_expanded_command(out);
+        return -1;
+    }
+    if (e.failed) {
+        free_expanded_command(out);
+        return -1;
+    }
+    return 0;
+}
+
+// 释放额外的输出目标链表
+void free_output_targets(output_target_t* targets) {
+    while (targets != NULL) {
+        output_target_t* next = targets->next;
+        free(targets->file);
+        free(targets);
+        targets = next;
+    }
+}
+
+/**
+ * @description: 释放 expand_command 产生的命令（复合命令的语法树属于原始命令，不在这里释放）
+ */
+void free_expanded_command(command_t* cmd) {
+    for (int i = 0; cmd->args[i] != NULL; i++) {
+        free(cmd->args[i]);
+        cmd->args[i] = NULL;
+    }
+    free(cmd->input_file);
+    free(cmd->output_file);
+    free_output_targets(cmd->more_outputs);
+    if (cmd->assigns) {
+        for (int i = 0; cmd->assigns[i] != NULL; i++) free(cmd->assigns[i]);
+        free(cmd->assigns);
+    }
+    free(cmd->attrs);
+    cmd->input_file = cmd->output_file = NULL;
+    cmd->more_outputs = NULL;
+    cmd->assigns = NULL;
+    cmd->attrs = NULL;
+}
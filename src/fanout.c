@@ -0,0 +1,190 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-21 15:40:02
+ * @FilePath: /linux-shell/src/fanout.c
+ * @Descripttion: 输出分发模块-同一条命令有多个 > / >> 目标时，用 tee/splice 把输出同时写入每个目标
+ */
+
+// 用法: cmd > a.log >> all.log > /dev/tty
+// 命令的标准输出接到一个管道，由分发进程把数据写到每一个目标：
+//   cmd --(管道)--> 分发进程 --tee--> 临时管道 1 --splice--> 目标 1
+//                            --tee--> 临时管道 2 --splice--> 目标 2
+//                            --splice-----------------------> 最后一个目标
+// tee(2) 只是让临时管道引用同一批数据页，splice(2) 在内核中把数据页交给目标文件，
+// 数据不会拷贝到用户态。目标不支持 splice 时（例如某些终端）和 >> 追加的目标使用 read/write。
+// 某个目标写入失败（磁盘满、读端已关闭）时只放弃这一个目标，其余照常写入。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#define FANOUT_COPY_BUF 65536
+
+typedef struct {
+    int fd;          // 目标文件
+    int scratch[2];  // 临时管道；最后一个目标直接从输入管道 splice，不需要
+    int dead;        // 写入失败，不再写它
+    int use_copy;    // 不支持 splice，改用 read/write
+} fanout_target_t;
+
+// 用 read/write 把 from 管道中的 n 字节交给 to（to < 0 时丢弃）
+static int copy_bytes(int from, int to, size_t n) {
+    char buf[FANOUT_COPY_BUF];
+    int ok = to >= 0;
+    while (n > 0) {
+        ssize_t r = read(from, buf, n < sizeof(buf) ? n : sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        for (ssize_t off = 0; ok && off < r;) {
+            ssize_t w = write(to, buf + off, r - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) ok = 0;
+            else off += w;
+        }
+        n -= r;
+    }
+    return ok ? 0 : -1;
+}
+
+/**
+ * @description: 把管道 from 中的 n 字节交给一个目标。splice 不支持时改用拷贝，
+ * 写入失败时把目标标记为失效，剩下的数据读出丢弃（管道中的数据必须取走）
+ */
+static void move_bytes(int from, fanout_target_t* t, size_t n) {
+    while (n > 0 && !t->dead && !t->use_copy) {
+        ssize_t r = splice(from, NULL, t->fd, NULL, n, SPLICE_F_MOVE);
+        if (r > 0) {
+            n -= r;
+        } else if (r < 0 && errno == EINTR) {
+            continue;
+        } else if (r < 0 && errno == EINVAL) {
+            t->use_copy = 1;
+        } else {
+            t->dead = 1;
+        }
+    }
+    if (n > 0 && copy_bytes(from, t->dead ? -1 : t->fd, n) < 0) {
+        t->dead = 1;
+    }
+}
+
+/**
+ * @description: 分发进程主循环：每一轮先把输入管道中现有的数据 tee 到各临时管道，
+ * 再把临时管道 splice 到各自的目标，最后把输入管道中的这批数据 splice 到最后一个目标
+ */
+static void fanout_loop(int in_fd, fanout_target_t* targets, int count) {
+    // 临时管道的容量不小于输入管道，一次 tee 能放下输入管道中的全部数据
+    int pipe_size = fcntl(in_fd, F_GETPIPE_SZ);
+    for (int i = 0; i < count - 1; i++) {
+        if (pipe_size > 0 && fcntl(targets[i].scratch[1], F_GETPIPE_SZ) < pipe_size) {
+            fcntl(targets[i].scratch[1], F_SETPIPE_SZ, pipe_size);
+        }
+    }
+    fanout_target_t* last = &targets[count - 1];
+
+    for (;;) {
+        // 第一次 tee 决定这一轮的字节数 n，后面的 tee 都取同样的 n 字节
+        ssize_t n = -1;
+        for (int i = 0; i < count - 1; i++) {
+            if (targets[i].dead) continue;
+            size_t want = n < 0 ? (size_t)(pipe_size > 0 ? pipe_size : FANOUT_COPY_BUF) : (size_t)n;
+            ssize_t r;
+            while ((r = tee(in_fd, targets[i].scratch[1], want, 0)) < 0 && errno == EINTR) {}
+            if (r < 0) {
+                targets[i].dead = 1;
+                continue;
+            }
+            if (n < 0) n = r;
+            if (n == 0) break;
+            if (r < n) {
+                // 临时管道放不下（调整容量失败），这个目标跟不上，放弃它
+                copy_bytes(targets[i].scratch[0], -1, r);
+                targets[i].dead = 1;
+            }
+        }
+        if (n < 0) {
+            // 只剩最后一个目标：等到有数据（或上游关闭），取管道中现有的字节数
+            struct pollfd pfd = {in_fd, POLLIN, 0};
+            int avail = 0;
+            while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {}
+            if (ioctl(in_fd, FIONREAD, &avail) < 0) break;
+            n = avail;
+        }
+        if (n == 0) break; // 上游写端已经全部关闭
+
+        for (int i = 0; i < count - 1; i++) {
+            if (!targets[i].dead) move_bytes(targets[i].scratch[0], &targets[i], (size_t)n);
+        }
+        move_bytes(in_fd, last, (size_t)n);
+    }
+}
+
+// 分发进程只保留输入管道和目标文件，关闭从 Shell 继承的其他 fd（例如管道其他段的读写端），
+// 否则那些管道的另一端收不到 EOF / EPIPE
+static void close_other_fds(int in_fd, const int* target_fds, int count) {
+    int keep[count + 1];
+    keep[0] = in_fd;
+    memcpy(keep + 1, target_fds, sizeof(int) * count);
+    for (int i = 1; i <= count; i++) { // 插入排序，目标很少
+        for (int j = i; j > 0 && keep[j] < keep[j - 1]; j--) {
+            int tmp = keep[j];
+            keep[j] = keep[j - 1];
+            keep[j - 1] = tmp;
+        }
+    }
+    unsigned int next = STDERR_FILENO + 1;
+    for (int i = 0; i <= count; i++) {
+        if (keep[i] > (int)next) close_range(next, keep[i] - 1, 0);
+        if (keep[i] >= (int)next) next = keep[i] + 1;
+    }
+    close_range(next, ~0U, 0);
+}
+
+/**
+ * @description: 启动输出分发进程
+ * @param {const int*} target_fds - 已经打开的目标文件（分发进程接管，调用者在返回后应关闭它们）
+ * @param {int} count - 目标个数（至少 2 个）
+ * @param {int*} write_fd - 输出：命令的标准输出应当接到的管道写端
+ * @return {pid_t} - 分发进程的 pid，失败返回 -1（已打印错误）
+ */
+pid_t start_output_fanout(const int* target_fds, int count, int* write_fd) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close_other_fds(fds[0], target_fds, count);
+        signal(SIGPIPE, SIG_IGN); // 目标是已关闭的管道时得到 EPIPE，而不是被杀死
+        signal(SIGINT, SIG_IGN);  // Ctrl+C 结束命令后，分发进程还要把剩下的数据写完
+        fanout_target_t targets[count];
+        for (int i = 0; i < count; i++) {
+            targets[i] = (fanout_target_t){.fd = target_fds[i], .scratch = {-1, -1}};
+            // splice 不能写入 O_APPEND 的文件。>> 目标保留 O_APPEND、改用 read/write：
+            // 每次 write 都追加到当时的文件末尾，别的进程同时追加的内容不会被覆盖
+            int flags = fcntl(targets[i].fd, F_GETFL);
+            if (flags >= 0 && (flags & O_APPEND)) targets[i].use_copy = 1;
+            if (i < count - 1 && pipe2(targets[i].scratch, O_CLOEXEC) < 0) {
+                perror("pipe");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        fanout_loop(fds[0], targets, count);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[0]);
+    *write_fd = fds[1];
+    return pid;
+}
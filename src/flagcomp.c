@@ -0,0 +1,418 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-09-04 16:27:05
+ * @FilePath: /linux-shell/src/flagcomp.c
+ * @Descripttion: 选项补全模块-从命令的 --help 输出中提取长短选项，供 Tab 补全 -x / --xxx 使用
+ */
+
+// 命令名之后输入 - 再按 Tab 时补全这个命令的选项。选项表的来源是命令自己的 --help 输出:
+//   - 每个可执行文件只运行一次 `命令 --help`。子进程用 setsid 脱离终端，stdin 是 /dev/null，
+//     stdout/stderr 接到管道，由事件循环在后台读取；超过 HELP_TIMEOUT_MS 还没结束就杀掉整个进程组。
+//   - 结果写入 ~/.cache/myshell/flags，每个可执行文件一个文件（文件名是路径的哈希），
+//     里面记录路径、设备号、inode 和 mtime，任何一个变了（命令升级）就重新提取。
+//   - Tab 永远不等待提取：内存或磁盘里有结果就立即使用，否则启动提取并且这次不给出补全，
+//     提取完成后再按 Tab 就有了。
+// 设置 HELP_COMPLETION=off 可以关闭（不会再运行任何命令的 --help）。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define HELP_TIMEOUT_MS 2000        // 提取的时限
+#define HELP_MAX_OUTPUT (256 << 10) // 最多读入这么多 --help 输出，之后的内容丢弃
+#define FLAGS_MAX 1024              // 每个命令最多保存的选项数
+#define FLAG_BUCKETS 64
+#define FLAGS_MAGIC "# myshell flags v1"
+
+typedef enum { FLAGS_NONE, FLAGS_RUNNING, FLAGS_READY } flags_state_t;
+
+// 一个可执行文件的选项表
+typedef struct FlagEntry {
+    char* path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    flags_state_t state;
+    char** flags;           // 排好序、去过重
+    int count;
+    // 提取进行中
+    pid_t pid;
+    int fd;
+    char* output;
+    size_t output_len;
+    struct FlagEntry* next;
+} FlagEntry;
+
+// 超时定时器的参数：进程号用来确认还是同一次提取
+typedef struct {
+    FlagEntry* entry;
+    pid_t pid;
+} HelpTimer;
+
+static FlagEntry* buckets[FLAG_BUCKETS];
+
+static uint64_t hash_path(const char* s) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void free_flags(FlagEntry* e) {
+    for (int i = 0; i < e->count; i++) free(e->flags[i]);
+    free(e->flags);
+    e->flags = NULL;
+    e->count = 0;
+}
+
+static int same_file(const FlagEntry* e, const struct stat* st) {
+    return e->dev == st->st_dev && e->ino == st->st_ino &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// =================================================================
+// == 解析 --help 输出
+// =================================================================
+
+static int is_flag_char(char c) {
+    return isalnum((unsigned char)c) || c == '-' || c == '_';
+}
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @description: 从 --help 的输出中找出所有选项，存入 e->flags
+ * 识别的写法:
+ *   --name、--name=VALUE、--name[=VALUE]      GNU 风格的长选项
+ *   -x、-x VALUE、-x,                         单字母短选项
+ *   行首的 -name                              find、java 这类单个 - 的长选项
+ */
+static void parse_help(FlagEntry* e, const char* text, size_t len) {
+    char** flags = (char**)malloc(sizeof(char*) * FLAGS_MAX);
+    int count = 0;
+    int line_start = 1; // 当前位置之前这一行只有空白
+
+    for (size_t i = 0; i < len && count < FLAGS_MAX; i++) {
+        char c = text[i];
+        if (c == '\n') {
+            line_start = 1;
+            continue;
+        }
+        if (c == ' ' || c == '\t') continue;
+
+        char prev = i > 0 ? text[i - 1] : ' ';
+        int at_boundary = prev == ' ' || prev == '\t' || prev == '\n' || prev == ',' ||
+                          prev == '[' || prev == '(' || prev == '|' || prev == '/';
+        if (c == '-' && at_boundary && i + 1 < len) {
+            size_t start = i, end;
+            if (text[i + 1] == '-') {
+                end = i + 2;
+            } else {
+                end = i + 1;
+            }
+            if (end < len && isalnum((unsigned char)text[end])) {
+                while (end < len && is_flag_char(text[end])) end++;
+                size_t name_len = end - start;
+                while (name_len > 2 && text[start + name_len - 1] == '-') name_len--; // "--foo-" 中的连字符
+                char next = end < len ? text[end] : ' ';
+                int long_opt = text[i + 1] == '-';
+                int short_opt = !long_opt && name_len == 2;
+                int word_opt = !long_opt && name_len > 2 && line_start;
+                int ends_well = !isalnum((unsigned char)next) && next != '.' && next != '/' && next != '\'';
+                if ((long_opt || short_opt || word_opt) && ends_well) {
+                    flags[count++] = strndup(text + start, name_len);
+                }
+                i = end - 1;
+            }
+        }
+        line_start = 0;
+    }
+
+    qsort(flags, count, sizeof(char*), compare_strings);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && strcmp(flags[unique - 1], flags[i]) == 0) {
+            free(flags[i]);
+        } else {
+            flags[unique++] = flags[i];
+        }
+    }
+    free_flags(e);
+    e->flags = flags;
+    e->count = unique;
+}
+
+// =================================================================
+// == 磁盘缓存
+// =================================================================
+
+/**
+ * @description: 返回缓存目录（不存在时创建），失败返回 NULL
+ */
+static const char* cache_dir() {
+    static char dir[1024];
+    if (dir[0] != '\0') return dir;
+
+    const char* home = getenv("HOME");
+    if (home == NULL) return NULL;
+    const char* parts[] = {"/.cache", "/.cache/myshell", "/.cache/myshell/flags"};
+    for (int i = 0; i < 3; i++) {
+        snprintf(dir, sizeof(dir), "%s%s", home, parts[i]);
+        if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+            dir[0] = '\0';
+            return NULL;
+        }
+    }
+    return dir;
+}
+
+static int cache_file(const FlagEntry* e, char* path, size_t size) {
+    const char* dir = cache_dir();
+    if (dir == NULL) return -1;
+    snprintf(path, size, "%s/%016llx", dir, (unsigned long long)hash_path(e->path));
+    return 0;
+}
+
+/**
+ * @description: 从磁盘缓存读取选项表，路径、设备号、inode 或 mtime 对不上时视为没有缓存
+ * @return {int} - 读到返回 0，否则返回 -1
+ */
+static int load_cached(FlagEntry* e) {
+    char path[1100];
+    if (cache_file(e, path, sizeof(path)) < 0) return -1;
+    FILE* fp = fopen(path, "re");
+    if (fp == NULL) return -1;
+
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int ok = 0;
+    if (getline(&line, &cap, fp) > 0 && strncmp(line, FLAGS_MAGIC, strlen(FLAGS_MAGIC)) == 0 &&
+        (n = getline(&line, &cap, fp)) > 0) {
+        line[n - 1] = '\0';
+        unsigned long long dev, ino;
+        long long sec;
+        long nsec;
+        ok = strcmp(line, e->path) == 0 && fscanf(fp, "%llu %llu %lld %ld\n", &dev, &ino, &sec, &nsec) == 4 &&
+             dev == (unsigned long long)e->dev && ino == (unsigned long long)e->ino &&
+             sec == (long long)e->mtime.tv_sec && nsec == e->mtime.tv_nsec;
+    }
+    if (ok) {
+        free_flags(e);
+        e->flags = (char**)malloc(sizeof(char*) * FLAGS_MAX);
+        while (e->count < FLAGS_MAX && (n = getline(&line, &cap, fp)) > 1) {
+            line[n - 1] = '\0';
+            e->flags[e->count++] = strdup(line);
+        }
+        e->state = FLAGS_READY;
+    }
+    free(line);
+    fclose(fp);
+    return ok ? 0 : -1;
+}
+
+// 把选项表写入磁盘缓存（先写临时文件再 rename，几个 Shell 同时写也不会读到半个文件）
+static void store_cached(const FlagEntry* e) {
+    char path[1100], tmp[1200];
+    if (cache_file(e, path, sizeof(path)) < 0) return;
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE* fp = fopen(tmp, "we");
+    if (fp == NULL) return;
+    fprintf(fp, "%s\n%s\n%llu %llu %lld %ld\n", FLAGS_MAGIC, e->path, (unsigned long long)e->dev,
+            (unsigned long long)e->ino, (long long)e->mtime.tv_sec, (long)e->mtime.tv_nsec);
+    for (int i = 0; i < e->count; i++) fprintf(fp, "%s\n", e->flags[i]);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+// =================================================================
+// == 后台提取
+// =================================================================
+
+// 提取结束（输出读完或超时被杀）：解析输出、回收子进程、写入缓存
+static void finish_extraction(FlagEntry* e) {
+    loop_unwatch_fd(e->fd);
+    close(e->fd);
+    e->fd = -1;
+    kill(-e->pid, SIGKILL); // 进程组里可能还有 --help 启动的分页器之类
+    waitpid(e->pid, NULL, 0);
+    e->pid = 0;
+
+    parse_help(e, e->output ? e->output : "", e->output_len);
+    free(e->output);
+    e->output = NULL;
+    e->output_len = 0;
+    e->state = FLAGS_READY;
+    store_cached(e);
+}
+
+static void help_output(int fd, void* ctx) {
+    FlagEntry* e = (FlagEntry*)ctx;
+    char buf[8192];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+        finish_extraction(e);
+        return;
+    }
+    if (e->output_len + n <= HELP_MAX_OUTPUT) {
+        e->output = (char*)realloc(e->output, e->output_len + n);
+        memcpy(e->output + e->output_len, buf, n);
+        e->output_len += n;
+    }
+}
+
+static void help_timeout(int fd, void* ctx) {
+    HelpTimer* timer = (HelpTimer*)ctx;
+    // 杀掉后管道关闭，已经读到的部分照常解析
+    if (timer->entry->state == FLAGS_RUNNING && timer->entry->pid == timer->pid) {
+        kill(-timer->pid, SIGKILL);
+    }
+    free(timer);
+}
+
+/**
+ * @description: 在后台运行 `命令 --help`，输出由事件循环读取
+ * @return {int} - 成功启动返回 0，失败返回 -1
+ */
+static int start_extraction(FlagEntry* e) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // 新的会话：没有控制终端，也收不到终端的 Ctrl+C；进程组号就是 pid，超时时整组杀掉
+        setsid();
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        int null_fd = open("/dev/null", O_RDONLY);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        // 让 git --help、man 之类直接输出，不去启动分页器
+        setenv("PAGER", "cat", 1);
+        setenv("MANPAGER", "cat", 1);
+        setenv("GIT_PAGER", "cat", 1);
+        setenv("TERM", "dumb", 1);
+        const char* name = strrchr(e->path, '/');
+        execl(e->path, name ? name + 1 : e->path, "--help", (char*)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    if (loop_watch_fd(fds[0], help_output, e) < 0) {
+        close(fds[0]);
+        kill(-pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    e->pid = pid;
+    e->fd = fds[0];
+    e->state = FLAGS_RUNNING;
+
+    HelpTimer* timer = (HelpTimer*)malloc(sizeof(HelpTimer));
+    timer->entry = e;
+    timer->pid = pid;
+    if (loop_add_timer(HELP_TIMEOUT_MS, help_timeout, timer) < 0) free(timer);
+    return 0;
+}
+
+// =================================================================
+// == 查询
+// =================================================================
+
+/**
+ * @description: 在 PATH 中查找命令对应的可执行文件
+ * @return {char*} - 完整路径（需要 free），找不到返回 NULL
+ */
+static char* find_executable(const char* name) {
+    if (strchr(name, '/') != NULL) {
+        return access(name, X_OK) == 0 ? realpath(name, NULL) : NULL;
+    }
+    const char* path = getenv("PATH");
+    if (path == NULL) return NULL;
+    char full[PATH_MAX];
+    while (*path) {
+        const char* colon = strchrnul(path, ':');
+        int len = (int)(colon - path);
+        snprintf(full, sizeof(full), "%.*s/%s", len, len ? path : ".", name);
+        struct stat st;
+        if (stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0) {
+            return strdup(full);
+        }
+        path = *colon ? colon + 1 : colon;
+    }
+    return NULL;
+}
+
+/**
+ * @description: 取得命令的选项表。没有可用的结果时启动后台提取，立即返回 NULL
+ * @param {const char*} command - 命令名（或路径）
+ * @param {int*} count - 输出：选项个数
+ * @return {char**} - 排好序的选项表（属于本模块，不要 free），还没有结果时返回 NULL
+ */
+char** lookup_command_flags(const char* command, int* count) {
+    *count = 0;
+    const char* setting = get_var("HELP_COMPLETION");
+    if (setting != NULL && strcmp(setting, "off") == 0) return NULL;
+    if (is_builtin(command) || lookup_function(command) != NULL) return NULL;
+
+    char* path = find_executable(command);
+    struct stat st;
+    if (path == NULL || stat(path, &st) < 0) {
+        free(path);
+        return NULL;
+    }
+
+    FlagEntry** bucket = &buckets[hash_path(path) % FLAG_BUCKETS];
+    FlagEntry* e = *bucket;
+    while (e != NULL && strcmp(e->path, path) != 0) e = e->next;
+    if (e == NULL) {
+        e = (FlagEntry*)calloc(1, sizeof(FlagEntry));
+        e->path = path;
+        e->fd = -1;
+        e->next = *bucket;
+        *bucket = e;
+    } else {
+        free(path);
+    }
+
+    if (e->state == FLAGS_RUNNING) return NULL;
+    if (e->state == FLAGS_READY && same_file(e, &st)) {
+        *count = e->count;
+        return e->flags;
+    }
+
+    // 第一次查询，或者可执行文件换过了
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtim;
+    e->state = FLAGS_NONE;
+    free_flags(e);
+    if (load_cached(e) == 0) {
+        *count = e->count;
+        return e->flags;
+    }
+    start_extraction(e);
+    return NULL;
+}
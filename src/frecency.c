@@ -0,0 +1,470 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-09-08 11:05:26
+ * @FilePath: /linux-shell/src/frecency.c
+ * @Descripttion: 目录跳转模块-记录 cd 去过的目录，cd -j 片段 按访问频率和最近访问时间跳到最匹配的目录
+ */
+
+// 用法:
+//   cd -j 片段...   跳到匹配所有片段的目录中得分最高、仍然存在的那个（j 是它的别名）
+//   cd -j          列出记录的目录和得分
+// 匹配规则: 片段按顺序出现在路径中，最后一个片段必须出现在路径的最后一段里；片段全是小写时
+// 不区分大小写。得分 = 访问权重 × 最近访问系数（1 小时内 ×4，1 天内 ×2，1 周内 ×0.5，更早 ×0.25）。
+// 得分相同时，片段恰好等于路径中某一段的个数多者优先，再按路径长度从短到长。
+//
+// 交互模式下每次成功的 cd 都会记录（脚本中的 cd 不记录）。数据库 ~/.myshell_dirs 是一个紧凑的
+// 二进制文件: 文件头 + 每个目录一条 {权重, 最近访问时间, 路径长度, 以 \0 结尾的路径}。
+// 启动时一次 read 读入整个文件，索引直接指向这块内存里的路径，不逐条分配。
+// 更新时先 flock 锁住 ~/.myshell_dirs.lock（读入时加共享锁），确认手里的索引是最新的，然后:
+// 已有的目录只原地改写它的权重和访问时间（8 字节）；新目录或需要衰减时写临时文件再 rename。
+// 多个 Shell 同时 cd 不会丢失更新，也不会有人读到写了一半的文件。每次写入都让文件头的写入代数
+// 加一，其他 Shell 发现代数或 inode 变了，cd -j 之前会先重新读入。
+// 所有目录的权重之和超过 DIRS_AGING_TOTAL 时整体衰减到 90%，权重不足 1 或已经不存在的目录被删除，
+// 数据库的大小因此有上限，很久不去的目录逐渐淘汰。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define DIRS_MAGIC 0x53524944  // "DIRS"
+#define DIRS_VERSION 1
+#define DIRS_AGING_TOTAL 9000  // 权重之和超过它时整体衰减
+#define DIRS_AGING_FACTOR 0.9f
+#define DIRS_LIST_MAX 20       // cd -j 不带参数时最多列出的条数
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t generation;    // 每次写入加一，用来发现其他 Shell 的更新
+} dirs_header_t;
+
+// 每条记录后面紧跟 len 字节的路径（包括结尾的 \0）
+typedef struct {
+    float rank;
+    uint32_t atime;
+    uint16_t len;
+} __attribute__((packed)) dirs_record_t;
+
+typedef struct {
+    const char* path;   // 指向 db_data 中的路径
+    float rank;
+    uint32_t atime;
+    uint32_t offset;    // 记录在文件中的位置，原地更新时使用
+} DirEntry;
+
+static char* db_data = NULL;      // 读入的整个数据库文件
+static DirEntry* entries = NULL;
+static int entry_count = 0;
+static float rank_total = 0;      // 所有目录的权重之和
+static ino_t db_ino = 0;          // 读入的文件和它的写入代数
+static uint32_t db_generation = 0;
+static int db_loaded = 0;
+static int recording = 0;         // 交互模式才记录 cd
+static double load_us = 0;        // 最近一次读入数据库的耗时
+
+static const char* db_path() {
+    static char path[1024];
+    if (path[0] == '\0') {
+        const char* home = getenv("HOME");
+        if (home == NULL) return NULL;
+        snprintf(path, sizeof(path), "%s/.myshell_dirs", home);
+    }
+    return path;
+}
+
+// =================================================================
+// == 读写数据库
+// =================================================================
+
+/**
+ * @description: 用一块数据库内容重建索引，索引中的路径直接指向 data（data 的所有权转给本模块）
+ * @return {int} - 格式正确返回 0，否则返回 -1（索引清空）
+ */
+static int adopt_data(char* data, size_t size) {
+    free(entries);
+    free(db_data);
+    entries = NULL;
+    entry_count = 0;
+    rank_total = 0;
+    db_generation = 0;
+    db_data = data;
+
+    dirs_header_t header;
+    if (data == NULL || size < sizeof(header)) return -1;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != DIRS_MAGIC || header.version != DIRS_VERSION) return -1;
+    db_generation = header.generation;
+
+    entries = (DirEntry*)malloc(sizeof(DirEntry) * (header.count + 1));
+    size_t pos = sizeof(header);
+    for (uint32_t i = 0; i < header.count; i++) {
+        dirs_record_t rec;
+        if (pos + sizeof(rec) > size) break;
+        memcpy(&rec, data + pos, sizeof(rec));
+        if (rec.len == 0 || pos + sizeof(rec) + rec.len > size || data[pos + sizeof(rec) + rec.len - 1] != '\0') break;
+        entries[entry_count].path = data + pos + sizeof(rec);
+        entries[entry_count].rank = rec.rank;
+        entries[entry_count].atime = rec.atime;
+        entries[entry_count].offset = (uint32_t)pos;
+        rank_total += rec.rank;
+        entry_count++;
+        pos += sizeof(rec) + rec.len;
+    }
+    return 0;
+}
+
+// 读入数据库文件，建立索引。文件不存在时索引为空
+static void load_db() {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    db_loaded = 1;
+    db_ino = 0;
+
+    const char* path = db_path();
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    char* data = NULL;
+    size_t size = 0;
+    struct stat st;
+    if (fd >= 0) {
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            db_ino = st.st_ino;
+            data = (char*)malloc(st.st_size);
+            ssize_t n = read(fd, data, st.st_size);
+            size = n > 0 ? (size_t)n : 0;
+        }
+        close(fd);
+    }
+    adopt_data(data, size);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    load_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+}
+
+// 读入之后文件是否被写过（换了文件，或者写入代数变了）
+static int db_changed() {
+    if (!db_loaded) return 1;
+    const char* path = db_path();
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    if (fd < 0) return db_ino != 0;
+    struct stat st;
+    dirs_header_t header;
+    int changed = fstat(fd, &st) < 0 || st.st_ino != db_ino ||
+                  pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.generation != db_generation;
+    close(fd);
+    return changed;
+}
+
+// 锁住数据库：写入时 LOCK_EX，读入时 LOCK_SH。返回锁文件的 fd（关闭即解锁），失败返回 -1
+static int lock_db(int operation) {
+    char lock_path[1100];
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", db_path());
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0 && flock(fd, operation) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// 数据库被其他 Shell 更新过时重新读入
+static void refresh_db() {
+    if (db_path() == NULL || !db_changed()) return;
+    int lock_fd = lock_db(LOCK_SH);
+    load_db();
+    if (lock_fd >= 0) close(lock_fd);
+}
+
+/**
+ * @description: 把 list 中的目录写成数据库内容
+ * @param {uint32_t} generation - 写入代数
+ * @param {size_t*} size - 输出：内容的字节数
+ * @return {char*} - 数据库内容（需要 free）
+ */
+static char* serialize(const DirEntry* list, int count, uint32_t generation, size_t* size) {
+    size_t total = sizeof(dirs_header_t);
+    for (int i = 0; i < count; i++) total += sizeof(dirs_record_t) + strlen(list[i].path) + 1;
+
+    char* data = (char*)malloc(total);
+    dirs_header_t header = {DIRS_MAGIC, DIRS_VERSION, (uint32_t)count, generation};
+    memcpy(data, &header, sizeof(header));
+    size_t pos = sizeof(header);
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(list[i].path) + 1;
+        dirs_record_t rec = {list[i].rank, list[i].atime, (uint16_t)len};
+        memcpy(data + pos, &rec, sizeof(rec));
+        memcpy(data + pos + sizeof(rec), list[i].path, len);
+        pos += sizeof(rec) + len;
+    }
+    *size = total;
+    return data;
+}
+
+/**
+ * @description: 原地更新一条已有记录的权重和访问时间，以及文件头的写入代数（调用者持有写锁）
+ * @return {int} - 成功返回 0，失败返回 -1
+ */
+static int update_in_place(DirEntry* e, uint32_t now) {
+    int fd = open(db_path(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct {
+        float rank;
+        uint32_t atime;
+    } __attribute__((packed)) fields = {e->rank + 1, now};
+    uint32_t generation = db_generation + 1;
+    int ok = pwrite(fd, &fields, sizeof(fields), e->offset) == sizeof(fields) &&
+             pwrite(fd, &generation, sizeof(generation), offsetof(dirs_header_t, generation)) == sizeof(generation);
+    close(fd);
+    if (!ok) return -1;
+
+    // 读入的内容也同步修改，和文件保持一致
+    memcpy(db_data + e->offset, &fields, sizeof(fields));
+    memcpy(db_data + offsetof(dirs_header_t, generation), &generation, sizeof(generation));
+    e->rank += 1;
+    e->atime = now;
+    rank_total += 1;
+    db_generation = generation;
+    return 0;
+}
+
+/**
+ * @description: 记录一次对目录的访问。加写锁后确认索引是最新的：已有的目录原地更新权重；
+ * 新目录或需要衰减时重写整个文件（写临时文件再 rename）
+ * @param {const char*} dir - 目录的绝对路径
+ */
+static void visit_directory(const char* dir) {
+    const char* path = db_path();
+    if (path == NULL || strlen(dir) >= UINT16_MAX) return;
+    int lock_fd = lock_db(LOCK_EX);
+    if (lock_fd < 0) return;
+
+    if (db_changed()) load_db();
+    uint32_t now = (uint32_t)time(NULL);
+    DirEntry* existing = NULL;
+    for (int i = 0; i < entry_count && existing == NULL; i++) {
+        if (strcmp(entries[i].path, dir) == 0) existing = &entries[i];
+    }
+    if (existing != NULL && rank_total + 1 <= DIRS_AGING_TOTAL && update_in_place(existing, now) == 0) {
+        close(lock_fd);
+        return;
+    }
+
+    DirEntry* list = (DirEntry*)malloc(sizeof(DirEntry) * (entry_count + 1));
+    int count = 0;
+    for (int i = 0; i < entry_count; i++) {
+        list[count] = entries[i];
+        if (&entries[i] == existing) {
+            list[count].rank += 1;
+            list[count].atime = now;
+        }
+        count++;
+    }
+    if (existing == NULL) {
+        list[count].path = dir;
+        list[count].rank = 1;
+        list[count].atime = now;
+        count++;
+    }
+
+    // 衰减：权重整体打九折，去掉权重不足 1 和已经不存在的目录
+    if (rank_total + 1 > DIRS_AGING_TOTAL) {
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            struct stat st;
+            list[i].rank *= DIRS_AGING_FACTOR;
+            if (list[i].rank >= 1 && stat(list[i].path, &st) == 0 && S_ISDIR(st.st_mode)) {
+                list[kept++] = list[i];
+            }
+        }
+        count = kept;
+    }
+
+    size_t size;
+    char* data = serialize(list, count, db_generation + 1, &size);
+    free(list);
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    struct stat st;
+    int ok = fd >= 0 && write(fd, data, size) == (ssize_t)size && fstat(fd, &st) == 0;
+    if (fd >= 0) close(fd);
+    if (ok && rename(tmp_path, path) == 0) {
+        adopt_data(data, size); // 刚写入的内容就是最新的索引
+        db_ino = st.st_ino;
+    } else {
+        unlink(tmp_path);
+        free(data);
+    }
+    close(lock_fd); // 同时释放锁
+}
+
+// =================================================================
+// == 查询
+// =================================================================
+
+typedef struct {
+    const DirEntry* entry;
+    float score;
+    int components;     // 恰好等于路径中某一段的片段个数
+} Candidate;
+
+static float frecency(const DirEntry* e, uint32_t now) {
+    uint32_t age = now > e->atime ? now - e->atime : 0;
+    if (age < 3600) return e->rank * 4;
+    if (age < 86400) return e->rank * 2;
+    if (age < 604800) return e->rank / 2;
+    return e->rank / 4;
+}
+
+/**
+ * @description: 检查路径是否按顺序包含所有片段，最后一个片段在路径的最后一段中
+ * @return {int} - 不匹配返回 -1，匹配时返回恰好等于某一段路径的片段个数
+ */
+static int match_fragments(const char* path, char** fragments, int ignore_case) {
+    const char* last_component = strrchr(path, '/');
+    last_component = last_component ? last_component + 1 : path;
+
+    // 先看最后一个片段在不在最后一段里，大多数目录在这一步就被排除
+    int last = 0;
+    while (fragments[last + 1] != NULL) last++;
+    const char* tail = ignore_case ? strcasestr(last_component, fragments[last]) : strstr(last_component, fragments[last]);
+    if (tail == NULL) return -1;
+
+    const char* pos = path;
+    int components = 0;
+    for (int i = 0; i <= last; i++) {
+        size_t len = strlen(fragments[i]);
+        // 最后一个片段只在最后一段里找（它可能在前面也出现过）
+        const char* from = i == last && last_component > pos ? last_component : pos;
+        const char* hit = ignore_case ? strcasestr(from, fragments[i]) : strstr(from, fragments[i]);
+        if (hit == NULL) return -1;
+        if ((hit == path || hit[-1] == '/') && (hit[len] == '\0' || hit[len] == '/')) components++;
+        pos = hit + len;
+    }
+    return components;
+}
+
+static int compare_candidates(const void* a, const void* b) {
+    const Candidate* x = (const Candidate*)a;
+    const Candidate* y = (const Candidate*)b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->components != y->components) return y->components - x->components;
+    return (int)strlen(x->entry->path) - (int)strlen(y->entry->path);
+}
+
+// 列出得分最高的目录
+static void list_directories() {
+    uint32_t now = (uint32_t)time(NULL);
+    Candidate* list = (Candidate*)malloc(sizeof(Candidate) * (entry_count + 1));
+    for (int i = 0; i < entry_count; i++) {
+        list[i].entry = &entries[i];
+        list[i].score = frecency(&entries[i], now);
+        list[i].components = 0;
+    }
+    qsort(list, entry_count, sizeof(Candidate), compare_candidates);
+    for (int i = 0; i < entry_count && i < DIRS_LIST_MAX; i++) {
+        printf("%8.1f  %s\n", list[i].score, list[i].entry->path);
+    }
+    free(list);
+}
+
+/**
+ * @description: 找出匹配所有片段、得分最高、仍然存在且不是当前目录的目录
+ * @return {char*} - 目录路径（需要 free），没有匹配返回 NULL
+ */
+static char* resolve_fragments(char** fragments) {
+    int ignore_case = 1;
+    for (int i = 0; fragments[i] != NULL; i++) {
+        for (const char* p = fragments[i]; *p; p++) {
+            if (isupper((unsigned char)*p)) ignore_case = 0;
+        }
+    }
+
+    uint32_t now = (uint32_t)time(NULL);
+    Candidate* list = (Candidate*)malloc(sizeof(Candidate) * (entry_count + 1));
+    int count = 0;
+    for (int i = 0; i < entry_count; i++) {
+        int components = match_fragments(entries[i].path, fragments, ignore_case);
+        if (components < 0) continue;
+        list[count].entry = &entries[i];
+        list[count].score = frecency(&entries[i], now);
+        list[count].components = components;
+        count++;
+    }
+    qsort(list, count, sizeof(Candidate), compare_candidates);
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) cwd[0] = '\0';
+    char* result = NULL;
+    for (int i = 0; i < count && result == NULL; i++) {
+        struct stat st;
+        const char* path = list[i].entry->path;
+        if (strcmp(path, cwd) != 0 && stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            result = strdup(path);
+        }
+    }
+    free(list);
+    return result;
+}
+
+// =================================================================
+// == 对外接口
+// =================================================================
+
+/**
+ * @description: 交互模式启动时调用：读入数据库，开始记录 cd
+ */
+void dirs_init() {
+    recording = 1;
+    refresh_db();
+}
+
+/**
+ * @description: cd 成功后调用，记录当前目录（只在交互模式下记录）
+ */
+void dirs_record_cwd() {
+    if (!recording) return;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) visit_directory(cwd);
+}
+
+/**
+ * @description: cd -j 的实现
+ * @param {char**} fragments - 片段列表（以 NULL 结尾），为空时列出记录的目录
+ * @return {int} - 退出码
+ */
+int dirs_jump(char** fragments) {
+    refresh_db();
+    if (fragments[0] == NULL) {
+        list_directories();
+        return 0;
+    }
+
+    char* dir = resolve_fragments(fragments);
+    if (dir == NULL) {
+        fprintf(stderr, "cd: -j: no directory matches");
+        for (int i = 0; fragments[i] != NULL; i++) fprintf(stderr, " %s", fragments[i]);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    if (chdir(dir) != 0) {
+        perror(dir);
+        free(dir);
+        return 1;
+    }
+    printf("%s\n", dir);
+    free(dir);
+    dirs_record_cwd();
+    return 0;
+}
+
+// myshell --startup-stats 的一行：目录数据库的条数和读入耗时
+void print_dirs_stats() {
+    fprintf(stderr, "startup: %d directories indexed for cd -j in %.1f us\n", entry_count, load_us);
+}
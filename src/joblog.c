@@ -0,0 +1,366 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-25 09:47:15
+ * @FilePath: /linux-shell/src/joblog.c
+ * @Descripttion: 后台输出捕获模块-后台任务的 stdout/stderr 写进每个任务自己的环形缓冲区，之后用 jobs -o / joblog 查看
+ */
+
+// 用法:
+//   JOB_CAPTURE=1        之后以 & 启动的任务，输出不再直接写到终端（也可以写大小，例如 JOB_CAPTURE=256K）
+//   jobs                 列出捕获了输出的任务
+//   jobs -o N            打印任务 N（启动时显示的 [N]）到目前为止的输出
+//   joblog N             打印已有的输出，然后跟随新的输出，直到任务结束或按下 Ctrl+C
+//
+// 每个任务一个管道，读端设为非阻塞交给事件循环：可读时一次最多读 JOB_DRAIN_LIMIT 字节放进环形缓冲区，
+// 读不完的留到下一轮，输出很多的任务不会拖慢按键处理。缓冲区满了以后，最旧的数据写进溢出文件
+// （已经 unlink 的临时文件，Shell 退出后自动消失），所以每个任务占用的内存固定为缓冲区大小。
+// 溢出文件超过 JOB_SPILL_MAX 后再溢出的数据丢弃，只记录丢弃的字节数。
+// 前台命令运行时 Shell 不在事件循环中，后台任务的输出先积在管道里（管道容量调大到 JOB_PIPE_SIZE）。
+// 只在交互模式（事件循环运行时）生效；管道或内存不够时不捕获，输出照常写到终端。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+
+#define JOB_RING_DEFAULT (64 << 10)   // 默认的环形缓冲区大小
+#define JOB_RING_MIN (4 << 10)
+#define JOB_RING_MAX (16 << 20)
+#define JOB_SPILL_MAX (64ULL << 20)   // 每个任务的溢出文件上限
+#define JOB_PIPE_SIZE (1 << 20)
+#define JOB_DRAIN_LIMIT (256 << 10)   // 事件循环每一轮从一个任务读取的上限
+#define JOB_KEEP_FINISHED 16          // 保留多少个已结束任务的输出
+
+typedef struct job_log {
+    pid_t pid;                 // 0 表示任务还在启动
+    int fd;                    // 管道读端，所有写端都关闭后为 -1
+    char* label;               // 命令，例如 "make | tee"
+    char* ring;
+    size_t cap, start, len;    // 环形缓冲区：容量、最旧数据的位置、数据量
+    int spill_fd;              // 溢出文件，没有溢出时为 -1
+    unsigned long long spilled, dropped, total;
+    struct job_log* next;      // 新登记的在前
+} job_log_t;
+
+static job_log_t* logs = NULL;
+
+static job_log_t* find_log(pid_t pid) {
+    for (job_log_t* log = logs; log != NULL; log = log->next) {
+        if (log->pid == pid) return log;
+    }
+    return NULL;
+}
+
+static void free_log(job_log_t* log) {
+    for (job_log_t** link = &logs; *link != NULL; link = &(*link)->next) {
+        if (*link == log) {
+            *link = log->next;
+            break;
+        }
+    }
+    if (log->fd >= 0) {
+        loop_unwatch_fd(log->fd);
+        close(log->fd);
+    }
+    if (log->spill_fd >= 0) close(log->spill_fd);
+    free(log->label);
+    free(log->ring);
+    free(log);
+}
+
+// 已结束的任务只保留最近 JOB_KEEP_FINISHED 个
+static void trim_finished_logs() {
+    int finished = 0;
+    job_log_t* log = logs;
+    while (log != NULL) {
+        job_log_t* next = log->next;
+        if (log->fd < 0 && ++finished > JOB_KEEP_FINISHED) free_log(log);
+        log = next;
+    }
+}
+
+// =================================================================
+// == 环形缓冲区与溢出文件
+// =================================================================
+
+static void spill(job_log_t* log, const char* data, size_t n) {
+    if (log->spill_fd < 0 && log->dropped == 0) {
+        const char* dir = getenv("TMPDIR");
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/myshell-job-XXXXXX", dir && *dir ? dir : "/tmp");
+        log->spill_fd = mkostemp(path, O_CLOEXEC);
+        if (log->spill_fd >= 0) unlink(path);
+    }
+    size_t room = log->spill_fd >= 0 && log->spilled < JOB_SPILL_MAX ? JOB_SPILL_MAX - log->spilled : 0;
+    size_t keep = n < room ? n : room;
+    // 一旦开始丢弃就不再写溢出文件，保证文件中是连续的最早一段输出
+    if (keep > 0 && log->dropped == 0) {
+        ssize_t w = pwrite(log->spill_fd, data, keep, (off_t)log->spilled);
+        if (w > 0) log->spilled += w;
+        keep = w > 0 ? (size_t)w : 0;
+    } else {
+        keep = 0;
+    }
+    log->dropped += n - keep;
+}
+
+// 把环形缓冲区中最旧的 n 字节移到溢出文件
+static void spill_oldest(job_log_t* log, size_t n) {
+    while (n > 0) {
+        size_t chunk = log->cap - log->start;
+        if (chunk > n) chunk = n;
+        spill(log, log->ring + log->start, chunk);
+        log->start = (log->start + chunk) % log->cap;
+        log->len -= chunk;
+        n -= chunk;
+    }
+}
+
+static void ring_append(job_log_t* log, const char* data, size_t n) {
+    log->total += n;
+    if (n >= log->cap) {
+        // 比整个缓冲区还大：缓冲区和这次数据的前面部分都溢出
+        spill_oldest(log, log->len);
+        spill(log, data, n - log->cap);
+        data += n - log->cap;
+        n = log->cap;
+        log->start = 0;
+    } else if (n > log->cap - log->len) {
+        // 每次至少溢出 1/4 个缓冲区，避免每次读取都写一次文件
+        size_t need = n - (log->cap - log->len);
+        if (need < log->cap / 4) need = log->cap / 4;
+        if (need > log->len) need = log->len;
+        spill_oldest(log, need);
+    }
+    while (n > 0) {
+        size_t end = (log->start + log->len) % log->cap;
+        size_t chunk = log->cap - end;
+        if (chunk > n) chunk = n;
+        memcpy(log->ring + end, data, chunk);
+        log->len += chunk;
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+static void write_all(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, data, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        data += w;
+        n -= w;
+    }
+}
+
+// 打印到目前为止捕获的全部输出：溢出文件、丢弃提示、环形缓冲区
+static void print_log(job_log_t* log) {
+    fflush(stdout);
+    char buf[65536];
+    for (unsigned long long off = 0; off < log->spilled;) {
+        ssize_t r = pread(log->spill_fd, buf, sizeof(buf), (off_t)off);
+        if (r <= 0) break;
+        write_all(STDOUT_FILENO, buf, r);
+        off += r;
+    }
+    if (log->dropped > 0) {
+        fprintf(stderr, "joblog: [%d] %llu bytes dropped here (spill file full)\n", log->pid, log->dropped);
+    }
+    size_t first = log->cap - log->start;
+    if (first > log->len) first = log->len;
+    write_all(STDOUT_FILENO, log->ring + log->start, first);
+    write_all(STDOUT_FILENO, log->ring, log->len - first);
+}
+
+// =================================================================
+// == 从管道读取
+// =================================================================
+
+/**
+ * @description: 从任务的管道读取数据放进缓冲区，最多读 limit 字节
+ * @param {int} echo_fd - 同时把读到的数据写到这里（joblog 跟随时），-1 表示不写
+ * @return {int} - 管道已经关闭（任务结束）返回 1，否则返回 0
+ */
+static int read_job_output(job_log_t* log, size_t limit, int echo_fd) {
+    char buf[16384];
+    size_t got = 0;
+    while (got < limit) {
+        ssize_t r = read(log->fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && errno == EAGAIN) return 0;
+        if (r <= 0) {
+            loop_unwatch_fd(log->fd);
+            close(log->fd);
+            log->fd = -1;
+            return 1;
+        }
+        ring_append(log, buf, r);
+        if (echo_fd >= 0) write_all(echo_fd, buf, r);
+        got += r;
+    }
+    return 0;
+}
+
+static void drain_job(int fd, void* ctx) {
+    (void)fd;
+    read_job_output((job_log_t*)ctx, JOB_DRAIN_LIMIT, -1);
+}
+
+// JOB_CAPTURE 的值：空、0、off 表示不捕获；1、on 用默认大小；也可以直接写缓冲区大小
+static size_t capture_ring_size() {
+    const char* value = get_var("JOB_CAPTURE");
+    unsigned long long size;
+    if (value == NULL || value[0] == '\0' || strcmp(value, "0") == 0 || strcmp(value, "off") == 0) return 0;
+    if (strcmp(value, "1") == 0 || strcmp(value, "on") == 0) return JOB_RING_DEFAULT;
+    if (parse_size(value, &size) < 0) return JOB_RING_DEFAULT;
+    if (size < JOB_RING_MIN) return JOB_RING_MIN;
+    if (size > JOB_RING_MAX) return JOB_RING_MAX;
+    return (size_t)size;
+}
+
+/**
+ * @description: 准备捕获一个即将启动的后台任务的输出（JOB_CAPTURE 打开且事件循环运行时）
+ * @return {int} - 子进程应当作为 stdout/stderr 的管道写端（FD_CLOEXEC），不捕获时返回 -1
+ */
+int job_capture_begin() {
+    size_t cap = capture_ring_size();
+    int fds[2];
+    if (cap == 0 || pipe2(fds, O_CLOEXEC) < 0) return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETPIPE_SZ, JOB_PIPE_SIZE); // 失败时保持默认容量
+
+    job_log_t* log = (job_log_t*)calloc(1, sizeof(job_log_t));
+    log->ring = (char*)malloc(cap);
+    log->cap = cap;
+    log->fd = fds[0];
+    log->spill_fd = -1;
+    if (log->ring == NULL || loop_watch_fd(log->fd, drain_job, log) < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        free(log->ring);
+        free(log);
+        return -1;
+    }
+    log->next = logs;
+    logs = log;
+    trim_finished_logs();
+    return fds[1];
+}
+
+/**
+ * @description: 后台任务已经启动：关闭 Shell 手里的写端，把捕获的输出登记到任务的 pid 下
+ * @param {int} write_fd - job_capture_begin 返回的写端
+ * @param {pid_t} pid - 任务的 pid（启动时显示的 [N]），没有启动成功时为 0
+ * @param {const char*} label - jobs 列表中显示的命令
+ */
+void job_capture_end(int write_fd, pid_t pid, const char* label) {
+    if (write_fd < 0) return;
+    close(write_fd);
+    job_log_t* log = find_log(0);
+    if (log == NULL) return;
+    if (pid <= 0) {
+        free_log(log);
+        return;
+    }
+    job_log_t* old = find_log(pid); // pid 被重用时丢掉旧任务的记录
+    if (old != NULL) free_log(old);
+    log->pid = pid;
+    log->label = strdup(label);
+}
+
+// =================================================================
+// == jobs / joblog 内建命令
+// =================================================================
+
+static void format_bytes(unsigned long long bytes, char* buf, size_t size) {
+    if (bytes >= (1ULL << 30)) snprintf(buf, size, "%.1f GB", bytes / (double)(1ULL << 30));
+    else if (bytes >= (1ULL << 20)) snprintf(buf, size, "%.1f MB", bytes / (double)(1ULL << 20));
+    else if (bytes >= 1024) snprintf(buf, size, "%.1f KB", bytes / 1024.0);
+    else snprintf(buf, size, "%llu B", bytes);
+}
+
+static job_log_t* lookup_job_arg(const char* cmd, const char* arg) {
+    char* end;
+    long pid = strtol(arg != NULL && arg[0] == '%' ? arg + 1 : (arg ? arg : ""), &end, 10);
+    if (arg == NULL || *end != '\0' || pid <= 0) {
+        fprintf(stderr, "%s: usage: %s N (N is the job number printed as [N])\n", cmd,
+                strcmp(cmd, "jobs") == 0 ? "jobs -o" : cmd);
+        return NULL;
+    }
+    job_log_t* log = find_log((pid_t)pid);
+    if (log == NULL) fprintf(stderr, "%s: %ld: no captured output for this job\n", cmd, pid);
+    return log;
+}
+
+/**
+ * @description: jobs 内建命令：列出捕获了输出的后台任务；jobs -o N 打印任务 N 的输出
+ */
+int builtin_jobs(char** args) {
+    if (args[1] != NULL && strcmp(args[1], "-o") == 0) {
+        job_log_t* log = lookup_job_arg("jobs", args[2]);
+        if (log == NULL) return 1;
+        if (log->fd >= 0) read_job_output(log, SIZE_MAX, -1); // 先取走管道中已有的数据
+        print_log(log);
+        return 0;
+    }
+    if (args[1] != NULL) {
+        fprintf(stderr, "jobs: usage: jobs [-o N]\n");
+        return 2;
+    }
+    // 按启动顺序列出（链表中新的在前）
+    int count = 0;
+    for (job_log_t* log = logs; log != NULL; log = log->next) count++;
+    job_log_t* order[count > 0 ? count : 1];
+    count = 0;
+    for (job_log_t* log = logs; log != NULL; log = log->next) order[count++] = log;
+    for (int i = count - 1; i >= 0; i--) {
+        job_log_t* log = order[i];
+        if (log->pid == 0) continue;
+        char total[32];
+        format_bytes(log->total, total, sizeof(total));
+        printf("[%d] %-8s %10s  %s\n", log->pid, log->fd >= 0 ? "Running" : "Done", total, log->label);
+    }
+    return 0;
+}
+
+/**
+ * @description: joblog 内建命令：打印任务已有的输出，然后跟随新的输出，直到任务关闭输出或按下 Ctrl+C
+ */
+int builtin_joblog(char** args) {
+    job_log_t* log = lookup_job_arg("joblog", args[1]);
+    if (log == NULL) return 1;
+    pid_t pid = log->pid;
+    if (log->fd >= 0) read_job_output(log, SIZE_MAX, -1);
+    print_log(log);
+    if (log->fd < 0) return 0;
+
+    // 跟随期间屏蔽 SIGINT，通过 signalfd 得知 Ctrl+C 后停止跟随，Shell 不会被杀死
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    int sig_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    int status = 0;
+    for (;;) {
+        struct pollfd pfds[2] = {{log->fd, POLLIN, 0}, {sig_fd, POLLIN, 0}};
+        if (poll(pfds, sig_fd >= 0 ? 2 : 1, -1) < 0 && errno != EINTR) {
+            status = 1;
+            break;
+        }
+        if (sig_fd >= 0 && (pfds[1].revents & POLLIN)) {
+            struct signalfd_siginfo info;
+            while (read(sig_fd, &info, sizeof(info)) == sizeof(info)) {}
+            fprintf(stderr, "\njoblog: [%d] stopped following\n", pid);
+            note_interrupt();
+            status = INTERRUPTED_STATUS;
+            break;
+        }
+        if (pfds[0].revents && read_job_output(log, JOB_DRAIN_LIMIT, STDOUT_FILENO)) break;
+    }
+    if (sig_fd >= 0) close(sig_fd);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return status;
+}
@@ -21,6 +21,9 @@
 #include <unistd.h> // 为了 gethostname
 #include <ctype.h> // for isspace()
 #include <stdbool.h> // for bool type
+#include <time.h> // for --startup-stats
+
+#define READLINE_HISTORY_MAX 1000 // 上下方向键可以翻到的历史条数
 // 定义包含了 \001 和 \002 的、readline 安全的 ANSI 颜色代码
 #define C_RESET   "\001\033[0m\002"
 #define C_BLACK   "\001\033[30m\002"
@@ -35,125 +38,530 @@
 // 函数原型
 void main_loop();
 char* get_prompt();
-void initialize_shell();
-int parse_line(char* line, command_t* cmds);
+void initialize_shell(bool load_rc);
+static int run_script_file(const char* path);
+
+/**
+ * @description: 程序入口
+ * 用法: myshell [--norc] [--startup-stats] [--zygote] [--record 文件]  交互模式
+ *       myshell -c '命令' [参数]           执行一条命令
+ *       myshell 脚本 [参数]                执行脚本文件
+ */
+int main(int argc, char* argv[]) {
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    // 交互模式的选项
+    bool load_rc = true;
+    bool startup_stats = false;
+    const char* record_path = NULL;
+    bool use_zygote = getenv("SPAWN_BACKEND") != NULL && strcmp(getenv("SPAWN_BACKEND"), "zygote") == 0;
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--norc") == 0) {
+            load_rc = false;
+        } else if (strcmp(argv[1], "--startup-stats") == 0) {
+            startup_stats = true;
+        } else if (strcmp(argv[1], "--zygote") == 0) {
+            use_zygote = true;
+        } else if (strcmp(argv[1], "--record") == 0 && argc > 2) {
+            record_path = argv[2];
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        } else {
+            fprintf(stderr, "myshell: %s: invalid option\n", argv[1]);
+            return 2;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
 
-int main() {
-    initialize_shell();
+    // 孵化器要在加载任何状态之前 fork 出来，这样它的内存映射最小
+    if (use_zygote) {
+        start_zygote();
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        // 和 sh -c 命令 名字 参数... 相同：命令之后的第一个参数是 $0，没有时 $0 是 Shell 自己
+        if (argc > 3) set_positional_params(argc - 3, argv + 3);
+        else set_positional_params(1, argv);
+        return execute_string(argv[2]);
+    }
+    if (argc > 1) {
+        set_positional_params(argc - 1, argv + 1);
+        return run_script_file(argv[1]);
+    }
+
+    set_positional_params(1, argv);
+    initialize_shell(load_rc);
+
+    if (startup_stats) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        print_startup_stats((now.tv_sec - start_time.tv_sec) * 1e3 +
+                            (now.tv_nsec - start_time.tv_nsec) / 1e6);
+        print_dirs_stats();
+    }
+    if (record_path != NULL && record_open(record_path) < 0) {
+        return 2;
+    }
     main_loop();
-    return EXIT_SUCCESS;
+    return last_exit_status;
 }
 
 /**
- * @description: 初始化 Shell，包括命令补全
+ * @description: 读入整个脚本文件并执行
+ * @return {int} - 最后一条命令的退出码
  */
-void initialize_shell() {
+static int run_script_file(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return 127;
+    }
+
+    size_t len = 0, cap = 4096;
+    char* src = (char*)malloc(cap);
+    size_t n;
+    while ((n = fread(src + len, 1, cap - len - 1, fp)) > 0) {
+        len += n;
+        if (cap - len - 1 == 0) {
+            cap *= 2;
+            src = (char*)realloc(src, cap);
+        }
+    }
+    src[len] = '\0';
+    fclose(fp);
+
+    int status = execute_string(src);
+    free(src);
+    return status;
+}
+
+/**
+ * @description: 初始化 Shell，包括命令补全和 ~/.myshellrc
+ */
+void initialize_shell(bool load_rc) {
     // 绑定我们的补全回调函数
     // 向 readline 注册自己的补全处理函数 completion_callback
     // 这个函数定义在 completion.c 中
     rl_attempted_completion_function = completion_callback;
+
+    // readline 的历史记录默认不限条数，长时间运行的会话里会一直增长
+    stifle_history(READLINE_HISTORY_MAX);
+
+    // 读入 cd 的访问记录，j 片段 跳到最常去的匹配目录。rc 文件可以重新定义 j
+    dirs_init();
+    define_alias("j", "cd -j");
+
+    // 加载配置（别名、变量、函数），rc 文件没变时直接用快照
+    if (load_rc) {
+        load_rc_file();
+    }
+}
+
+// 交互模式的输入状态。复合命令跨越多行时（例如缺少 fi/done、引号未闭合），
+// 已经读入的文本和解析进度保存在这里，等下一行输入到达后继续解析
+static char* pending_text = NULL;     // 别名展开后的输入，续行会被追加进去
+static char* pending_line = NULL;     // 历史展开后的第一行，用于历史记录
+static node_t** pending_nodes = NULL; // 已经解析出的语法树
+static int pending_count = 0;
+static size_t pending_pos = 0;        // 下一条命令在 pending_text 中的位置
+static bool pending_batch = false;    // 输入来自一次粘贴，历史记录按行批量写入
+static bool shell_done = false;
+
+static void handle_line(char* line);
+static void add_history_lines(const char* text);
+
+// 显示主提示符，等待下一条命令
+static void show_prompt() {
+    record_begin(RECORD_PROMPT);
+    char* prompt = get_prompt();
+    loop_set_prompt(NULL, NULL);
+    loop_set_prompt(prompt, handle_line);
+    free(prompt);
+    record_end(RECORD_PROMPT);
+    record_begin(RECORD_WAIT);
+}
+
+static void discard_pending() {
+    for (int i = 0; i < pending_count; i++) free_node(pending_nodes[i]);
+    free(pending_nodes);
+    free(pending_text);
+    free(pending_line);
+    pending_nodes = NULL;
+    pending_count = 0;
+    pending_text = pending_line = NULL;
+    pending_pos = 0;
+    pending_batch = false;
 }
 
 /**
- * @description: Shell 的主循环，使用 readline
+ * @description: 继续解析 pending_text 中剩下的部分
+ * @return {bool} - 命令还没写完、需要继续读取时返回 true
  */
-void main_loop() {
-    char* line_from_readline; // 从 readline 读取的原始行
-    char* line_to_process;    // 经过历史展开后，最终要处理的行
-    command_t cmds[MAX_ARGS];
-    int cmd_count;
-
-    while (1) {
-        char* prompt = get_prompt();
-        line_from_readline = readline(prompt);
-        free(prompt);
-
-        if (line_from_readline == NULL) { // Ctrl+D
-            printf("exit\n");
-            break;
+static bool parse_pending() {
+    node_t* node;
+    int r;
+    while ((r = parse_next(pending_text, &pending_pos, &node)) != PARSE_EOF) {
+        if (r == PARSE_OK) {
+            pending_nodes = (node_t**)realloc(pending_nodes, sizeof(node_t*) * (pending_count + 1));
+            pending_nodes[pending_count++] = node;
+        } else if (r == PARSE_ERROR) {
+            last_exit_status = 2;
+        } else { // PARSE_INCOMPLETE
+            return true;
         }
+    }
+    return false;
+}
+
+// 记录历史并执行已经解析好的命令
+static void run_pending() {
+    // 执行命令前移除 readline 回调，让终端恢复正常模式
+    loop_set_prompt(NULL, NULL);
+
+    // 将最终要执行的命令添加到两个历史记录系统
+    // 有续行时记录完整的多行命令，粘贴的内容按行一次性写入
+    if (pending_batch) {
+        add_history_lines(pending_text);
+    } else {
+        const char* history_text = strchr(pending_text, '\n') ? pending_text : pending_line;
+        add_history(history_text);
+        add_to_history(history_text);
+    }
+
+    // 【执行】遍历语法树：内建命令和函数在 Shell 内执行，外部命令 fork 执行
+    // 执行中按下 Ctrl+C 时剩下的命令都不再执行，下一行输入重新开始
+    interrupted = 0;
+    for (int i = 0; i < pending_count; i++) {
+        execute_node(pending_nodes[i]);
+        free_node(pending_nodes[i]);
+    }
+    if (interrupted) printf("\n"); // 终端回显的 ^C 后面换行，提示符从新的一行开始
+    pending_count = 0;
+    discard_pending();
+}
 
-        // 如果是空行，释放内存并开始下一次循环
-        if (!*line_from_readline) {
-            free(line_from_readline);
-            continue;
+/**
+ * @description: 对一行新输入做历史展开（!! 和 !n）
+ * @return {char*} - 展开后的行（需要 free），展开失败返回 NULL
+ */
+static char* expand_history_line(const char* line) {
+    if (line[0] != '!' || line[1] == '\0' || isspace(line[1])) {
+        return strdup(line); // 如果不是历史展开命令，则直接处理当前输入
+    }
+
+    const char* history_cmd = NULL;
+    // 处理 '!!'
+    if (line[1] == '!' && (line[2] == '\0' || isspace(line[2]))) {
+        history_cmd = get_history_entry(get_history_count() - 1);
+    }
+    // 处理 '!n'
+    else {
+        int n = atoi(&line[1]);
+        if (n > 0) {
+            history_cmd = get_history_entry(n - 1); // 我们的历史数组索引从 0 开始
         }
+    }
 
-        bool expansion_failed = false;
-
-        // --- 新增：在这里处理历史命令展开 ---
-        if (line_from_readline[0] == '!') {
-            const char* history_cmd = NULL;
-
-            // 处理 '!!'
-            if (line_from_readline[1] == '!' && (line_from_readline[2] == '\0' || isspace(line_from_readline[2]))) {
-                history_cmd = get_history_entry(get_history_count() - 1);
-            } 
-            // 处理 '!n'
-            else {
-                int n = atoi(&line_from_readline[1]);
-                if (n > 0) {
-                    history_cmd = get_history_entry(n - 1); // 我们的历史数组索引从 0 开始
-                }
-            }
-
-            if (history_cmd) {
-                line_to_process = strdup(history_cmd); // 复制历史命令
-                printf("%s\n", line_to_process);     // 回显到屏幕
-            } else {
-                fprintf(stderr, "myshell: %s: event not found\n", line_from_readline);
-                expansion_failed = true;
-            }
-        } else {
-            // 如果不是历史展开命令，则直接处理当前输入
-            line_to_process = strdup(line_from_readline);
+    if (history_cmd == NULL) {
+        fprintf(stderr, "myshell: %s: event not found\n", line);
+        return NULL;
+    }
+    printf("%s\n", history_cmd); // 回显到屏幕
+    return strdup(history_cmd);
+}
+
+/**
+ * @description: readline 读完一行时的回调：续行追加到未完成的命令，否则作为新命令处理
+ */
+static void handle_line(char* line) {
+    double received = record_clock();
+    record_end(RECORD_WAIT);
+    if (line == NULL) { // Ctrl+D
+        loop_set_prompt(NULL, NULL);
+        if (pending_text != NULL) {
+            fprintf(stderr, "myshell: syntax error: unexpected end of file\n");
+            last_exit_status = 2;
+            run_pending();
         }
-        
-        // 释放 readline 返回的原始行，我们现在只跟 line_to_process 打交道
-        free(line_from_readline);
-        
-        // 如果历史展开失败，则跳过本次循环
-        if (expansion_failed) {
-            free(line_to_process); // 别忘了释放为它分配的内存
-            continue;
+        printf("exit\n");
+        shell_done = true;
+        return;
+    }
+
+    if (pending_text != NULL) {
+        // 续行
+        record_begin(RECORD_PARSE);
+        size_t len = strlen(pending_text);
+        pending_text = (char*)realloc(pending_text, len + strlen(line) + 2);
+        pending_text[len] = '\n';
+        strcpy(pending_text + len + 1, line);
+    } else {
+        // 如果是空行，直接等待下一条命令
+        if (!*line) {
+            free(line);
+            show_prompt();
+            return;
         }
-        
-        // --- 原有的处理流程，现在都基于 line_to_process ---
-        
-        // 将最终要执行的命令添加到两个历史记录系统
-        add_history(line_to_process);
-        add_to_history(line_to_process);
-        
-        char* expanded_line = expand_alias(line_to_process);
-        
-        if (strlen(expanded_line) > 0) {
-            cmd_count = parse_line(expanded_line, cmds);
-            if (cmd_count > 0) {
-                if (cmd_count > 1) {
-                    execute_pipeline(cmds, cmd_count);
-                } else {
-                    if (handle_builtin_command(&cmds[0]) == 0 && cmds[0].args[0] != NULL) {
-                        // 代码首先进入 if 的条件判断，执行 handle_builtin_command(&cmds[0])。
-                        // handle_builtin_command 函数（在 builtins.c 中）会拿到 "cd" 这个名字。
-                        // 它会在自己的内建命令列表 builtin_str[] 中进行查找。
-                        // 它找到了！ "cd" 在列表里。于是，它立刻调用对应的 C 函数 builtin_cd(cmds[0].args)。
-                        // builtin_cd() 函数直接在当前 Shell 进程内部执行 chdir("src") 系统调用，改变了 Shell 的工作目录。
-                        
-                        // ‼️
-                        // builtin_cd() 执行完毕后，handle_builtin_command 函数返回 1（表示“我成功处理了这个命令”）。
-
-                        // 回到 main.c，if 的条件变成了 if (1 == 0)，这个条件是假。
-                        // 因此，if 代码块内部的 execute_command(&cmds[0]) 完全不会被执行。
-                        //【路径 B】如果不是内建命令
-                        execute_command(&cmds[0]);//执行外部命令
-                    }
-                    // 【路径 A】执行内建命令，main_loop 继续下一次循环
-                }
-            }
+        record_begin(RECORD_PARSE);
+        pending_line = expand_history_line(line);
+        if (pending_line == NULL) { // 如果历史展开失败，则跳过本次输入
+            record_end(RECORD_PARSE);
+            record_input('L', line, received);
+            free(line);
+            show_prompt();
+            return;
         }
-        
-        free(expanded_line);
-        free(line_to_process); // 释放我们为 line_to_process 分配的内存
+        pending_text = expand_alias(pending_line);
+    }
+
+    // 复合命令没写完时用 "> " 提示继续读取下一行
+    bool more = parse_pending();
+    record_end(RECORD_PARSE);
+    if (more) {
+        loop_set_prompt(NULL, NULL);
+        loop_set_prompt("> ", handle_line);
+        record_input('L', line, received);
+        free(line);
+        record_begin(RECORD_WAIT);
+        return;
+    }
+    record_begin(RECORD_EXEC);
+    run_pending();
+    record_end(RECORD_EXEC);
+    record_input('L', line, received);
+    free(line);
+    if (!shell_done) show_prompt();
+}
+
+// =================================================================
+// == 粘贴多行文本 (bracketed paste)
+// =================================================================
+
+// 终端在粘贴内容前后加上 ESC[200~ 和 ESC[201~。包含换行的粘贴内容不再逐行
+// 经过 readline（每行重绘提示符、写一次历史），而是作为一批：解析一次，依次执行，
+// 历史记录一次性写入。最后一个换行之后的不完整行放回输入行，继续编辑。
+// PASTE_CONFIRM=N 时，N 行及以上的粘贴在执行前需要确认。
+
+#define PASTE_END "\033[201~"
+
+static char* paste_text = NULL;      // 等待执行的粘贴内容（到最后一个换行为止）
+static char* paste_rest = NULL;      // 最后一个换行之后的部分
+
+/**
+ * @description: 把粘贴的每一行写入历史记录。只写入最后能保留下来的那些行，
+ * 几千行的粘贴不会逐行触发历史记录的淘汰
+ */
+static void add_history_lines(const char* text) {
+    int total = 0;
+    for (const char* p = text; *p; p++) total += (*p == '\n');
+    if (text[0] != '\0' && text[strlen(text) - 1] != '\n') total++;
+
+    int skip = total > READLINE_HISTORY_MAX ? total - READLINE_HISTORY_MAX : 0;
+    int index = 0;
+    const char* line = text;
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        if (index++ >= skip && len > 0) {
+            char* copy = strndup(line, len);
+            add_history(copy);
+            if (index > total - HIST_SIZE) add_to_history(copy);
+            free(copy);
+        }
+        line += len + (end != NULL);
+    }
+}
+
+// 对粘贴的每一行做别名展开，和逐行输入时的效果一致
+static char* expand_alias_lines(const char* text) {
+    size_t cap = strlen(text) + 256, len = 0;
+    char* out = (char*)malloc(cap);
+    const char* line = text;
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        char* copy = strndup(line, end ? (size_t)(end - line) : strlen(line));
+        char* expanded = expand_alias(copy);
+        size_t n = strlen(expanded);
+        if (len + n + 2 > cap) {
+            cap = (len + n + 2) * 2;
+            out = (char*)realloc(out, cap);
+        }
+        memcpy(out + len, expanded, n);
+        len += n;
+        if (end) out[len++] = '\n';
+        free(expanded);
+        free(copy);
+        line = end ? end + 1 : line + strlen(line);
+    }
+    out[len] = '\0';
+    return out;
+}
+
+// 粘贴的行数达到 PASTE_CONFIRM 时询问是否执行
+static bool confirm_paste(int lines) {
+    const char* value = get_var("PASTE_CONFIRM");
+    int threshold = value ? atoi(value) : 0;
+    if (threshold <= 0 || lines < threshold) return true;
+
+    char question[64];
+    snprintf(question, sizeof(question), "run %d pasted lines? [y/N] ", lines);
+    char* answer = readline(question);
+    bool yes = answer != NULL && (answer[0] == 'y' || answer[0] == 'Y');
+    free(answer);
+    return yes;
+}
+
+/**
+ * @description: 在主循环中执行一次粘贴（由 loop_defer 调用，此时 readline 已处理完按键）
+ */
+static void run_paste(int fd, void* ctx) {
+    char* text = paste_text;
+    char* rest = paste_rest;
+    paste_text = paste_rest = NULL;
+    if (text == NULL) return;
+    double received = record_clock();
+    record_end(RECORD_WAIT);
+    char* recorded = record_enabled() ? strdup(text) : NULL;
+
+    int lines = 0;
+    for (const char* p = text; *p; p++) lines += (*p == '\n');
+    loop_set_prompt(NULL, NULL);
+    printf("[paste] %d lines\n", lines);
+
+    if (!confirm_paste(lines)) {
+        free(text);
+        free(rest);
+        free(recorded);
+        show_prompt();
+        return;
+    }
+
+    // 去掉最后的换行，和逐行输入时一样由解析器处理每一行
+    record_begin(RECORD_PARSE);
+    text[strlen(text) - 1] = '\0';
+    char* expanded = expand_alias_lines(text);
+    free(text);
+    if (pending_text != NULL) {
+        // 正在输入一条多行命令（"> " 提示符）时，粘贴的内容是它的续行
+        size_t len = strlen(pending_text);
+        pending_text = (char*)realloc(pending_text, len + strlen(expanded) + 2);
+        pending_text[len] = '\n';
+        strcpy(pending_text + len + 1, expanded);
+        free(expanded);
+    } else {
+        pending_text = expanded;
+    }
+    pending_batch = true;
+
+    bool more = parse_pending();
+    record_end(RECORD_PARSE);
+    if (more) {
+        loop_set_prompt("> ", handle_line);
+        record_input('P', recorded, received);
+        record_begin(RECORD_WAIT);
+    } else {
+        record_begin(RECORD_EXEC);
+        run_pending();
+        record_end(RECORD_EXEC);
+        record_input('P', recorded, received);
+        if (shell_done) {
+            free(recorded);
+            free(rest);
+            return;
+        }
+        show_prompt();
+    }
+    free(recorded);
+    if (rest != NULL) {
+        rl_insert_text(rest);
+        rl_redisplay();
+        free(rest);
+    }
+}
+
+/**
+ * @description: ESC[200~ 的按键处理函数：读入整段粘贴内容。不含换行的内容直接插入
+ * 输入行；含换行的内容连同已经输入的部分一起交给 run_paste 批量执行
+ */
+static int paste_begin(int count, int key) {
+    size_t len = 0, cap = 4096;
+    char* buf = (char*)malloc(cap);
+    size_t end_len = strlen(PASTE_END);
+
+    for (;;) {
+        int c = rl_read_key();
+        if (c < 0) break;
+        if (c == '\r') c = '\n'; // 终端把粘贴内容中的换行发送为 \r
+        if (len + 1 >= cap) {
+            cap *= 2;
+            buf = (char*)realloc(buf, cap);
+        }
+        buf[len++] = (char)c;
+        if (len >= end_len && memcmp(buf + len - end_len, PASTE_END, end_len) == 0) {
+            len -= end_len;
+            break;
+        }
+    }
+    buf[len] = '\0';
+
+    char* last_newline = strrchr(buf, '\n');
+    if (last_newline == NULL) {
+        rl_insert_text(buf);
+        free(buf);
+        return 0;
+    }
+
+    // 已经输入的内容是第一行的开头
+    free(paste_text);
+    free(paste_rest);
+    paste_rest = *(last_newline + 1) ? strdup(last_newline + 1) : NULL;
+    *(last_newline + 1) = '\0';
+    paste_text = (char*)malloc(rl_end + strlen(buf) + 1);
+    memcpy(paste_text, rl_line_buffer, rl_end);
+    strcpy(paste_text + rl_end, buf);
+    free(buf);
+
+    rl_replace_line("", 0);
+    rl_redisplay();
+    loop_defer(run_paste, NULL);
+    return 0;
+}
+
+// 提示符下按 Ctrl+C：丢弃正在输入的内容（包括未完成的多行命令），显示新的提示符
+static void interrupt_input() {
+    discard_pending();
+    rl_replace_line("", 0);
+    printf("\n");
+    last_exit_status = 130;
+    show_prompt();
+}
+
+/**
+ * @description: Shell 的主循环。使用 readline 的回调接口，由事件循环在按键到达时
+ * 交给 readline 处理，等待输入期间也能回收后台任务、处理定时器等异步事件
+ */
+void main_loop() {
+    if (event_loop_init(interrupt_input) < 0) {
+        perror("myshell: event loop");
+    }
+    // 执行命令期间 Ctrl+C 只打断命令，不结束 Shell
+    catch_interrupts();
+
+    // 让终端用 ESC[200~ ... ESC[201~ 包住粘贴的内容，并由我们自己处理
+    rl_variable_bind("enable-bracketed-paste", "on");
+    rl_bind_keyseq_in_map("\033[200~", paste_begin, emacs_standard_keymap);
+    rl_bind_keyseq_in_map("\033[200~", paste_begin, vi_insertion_keymap);
+
+    // 启动后稍等一会儿，趁用户还没开始输入时扫描 PATH，建好找不到命令时用的拼写建议索引
+    loop_add_timer(300, warm_command_index, NULL);
+
+    show_prompt();
+    while (!shell_done) {
+        loop_run_once();
     }
 }
 
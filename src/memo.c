@@ -0,0 +1,545 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-05 15:12:44
+ * @FilePath: /linux-shell/src/memo.c
+ * @Descripttion: memo 前缀模块-缓存只读命令的输出，相同输入时直接从 mmap 的缓存文件回放
+ */
+
+// 用法:
+//   memo [--env 名称]... [--file 路径]... [--] 命令 ...
+//   memo --stats        命中率、条目数和缓存大小
+//   memo --clear        清空缓存
+//
+// 缓存的键由以下内容计算哈希:
+//   argv、当前目录、PATH 和 --env 指定的变量值、--file 指定文件（以及普通文件形式的 stdin）
+//   的 设备/inode/大小/mtime。stdin 是管道、套接字等时不使用缓存，直接执行命令。
+// 命中时把保存的 stdout、stderr（保持原来的交错顺序）和退出码原样回放；未命中时通过
+// execute_command() 执行命令，同时由一个 tee 进程把输出边显示边写入缓存。
+// 缓存目录是 ~/.cache/myshell/memo，每个条目一个文件，用 mtime 记录最近使用时间。
+// 总大小超过 MEMO_MAX_SIZE（默认 256M，可带 K/M/G 后缀）时，从最久没用的条目开始删除。
+// 被信号杀死的命令不缓存。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MEMO_MAGIC 0x4f4d454d  // "MEMO"
+#define MEMO_VERSION 1
+#define MEMO_DEFAULT_MAX (256ULL << 20)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t exit_code;      // 写完输出后才填入
+    uint32_t key_len;       // 后面紧跟完整的键，用于排除哈希冲突
+} memo_header_t;
+
+// 输出记录: 1 字节流编号(1=stdout, 2=stderr) + 4 字节长度 + 数据
+typedef struct {
+    uint8_t stream;
+    uint32_t len;
+} __attribute__((packed)) memo_record_t;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} memo_stats_t;
+
+// 简单的可增长字符串缓冲区，用来拼键
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} keybuf_t;
+
+static void key_add(keybuf_t* k, const void* data, size_t len) {
+    if (k->len + len > k->cap) {
+        k->cap = (k->len + len) * 2 + 256;
+        k->data = (char*)realloc(k->data, k->cap);
+    }
+    memcpy(k->data + k->len, data, len);
+    k->len += len;
+}
+
+static void key_add_str(keybuf_t* k, const char* s) {
+    key_add(k, s, strlen(s) + 1);
+}
+
+static void key_add_stat(keybuf_t* k, const char* name, const struct stat* st) {
+    char buf[160];
+    if (st == NULL) {
+        snprintf(buf, sizeof(buf), "%s:missing", name);
+    } else {
+        snprintf(buf, sizeof(buf), "%s:%llu:%llu:%lld:%lld.%09ld", name,
+                 (unsigned long long)st->st_dev, (unsigned long long)st->st_ino,
+                 (long long)st->st_size, (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec);
+    }
+    key_add_str(k, buf);
+}
+
+// FNV-1a 64 位哈希
+static uint64_t hash_key(const keybuf_t* k) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < k->len; i++) {
+        h ^= (unsigned char)k->data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// =================================================================
+// == 缓存目录、统计和淘汰
+// =================================================================
+
+/**
+ * @description: 返回缓存目录（不存在时创建），失败返回 NULL
+ */
+static const char* cache_dir() {
+    static char dir[1024];
+    if (dir[0] != '\0') return dir;
+
+    const char* home = getenv("HOME");
+    if (home == NULL) return NULL;
+    const char* parts[] = {"/.cache", "/.cache/myshell", "/.cache/myshell/memo"};
+    for (int i = 0; i < 3; i++) {
+        snprintf(dir, sizeof(dir), "%s%s", home, parts[i]);
+        if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+            dir[0] = '\0';
+            return NULL;
+        }
+    }
+    return dir;
+}
+
+static unsigned long long max_cache_size() {
+    const char* value = get_var("MEMO_MAX_SIZE");
+    unsigned long long size;
+    if (value != NULL && parse_size(value, &size) == 0) return size;
+    return MEMO_DEFAULT_MAX;
+}
+
+/**
+ * @description: 在文件锁保护下更新统计（管道里的 memo 在子进程中执行，计数必须放在文件里）
+ */
+static void update_stats(int hits, int misses, int evictions, memo_stats_t* out) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/stats", cache_dir());
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    flock(fd, LOCK_EX);
+
+    memo_stats_t stats = {0};
+    if (pread(fd, &stats, sizeof(stats), 0) != sizeof(stats)) memset(&stats, 0, sizeof(stats));
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.evictions += evictions;
+    if (hits || misses || evictions) {
+        if (pwrite(fd, &stats, sizeof(stats), 0) != sizeof(stats)) perror("memo: stats");
+    }
+    if (out != NULL) *out = stats;
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+typedef struct {
+    char name[32];
+    off_t size;
+    struct timespec used;
+} entry_info_t;
+
+static int compare_by_use(const void* a, const void* b) {
+    const entry_info_t* x = (const entry_info_t*)a;
+    const entry_info_t* y = (const entry_info_t*)b;
+    if (x->used.tv_sec != y->used.tv_sec) return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    if (x->used.tv_nsec != y->used.tv_nsec) return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @description: 列出所有缓存条目（文件名是 16 位十六进制哈希）
+ * @return {entry_info_t*} - 条目数组，调用者负责释放
+ */
+static entry_info_t* list_entries(int* count, unsigned long long* total) {
+    DIR* d = opendir(cache_dir());
+    entry_info_t* entries = NULL;
+    *count = 0;
+    *total = 0;
+    if (d == NULL) return NULL;
+
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strlen(de->d_name) != 16 || strspn(de->d_name, "0123456789abcdef") != 16) continue;
+        if (fstatat(dirfd(d), de->d_name, &st, 0) < 0) continue;
+        entries = (entry_info_t*)realloc(entries, sizeof(entry_info_t) * (*count + 1));
+        entry_info_t* e = &entries[(*count)++];
+        strcpy(e->name, de->d_name);
+        e->size = st.st_size;
+        e->used = st.st_mtim;
+        *total += st.st_size;
+    }
+    closedir(d);
+    return entries;
+}
+
+// 总大小超过上限时，按最近使用时间从旧到新删除
+static void evict_entries() {
+    int count;
+    unsigned long long total;
+    unsigned long long limit = max_cache_size();
+    entry_info_t* entries = list_entries(&count, &total);
+    if (total <= limit) {
+        free(entries);
+        return;
+    }
+
+    qsort(entries, count, sizeof(entry_info_t), compare_by_use);
+    int evicted = 0;
+    for (int i = 0; i < count && total > limit; i++) {
+        char path[1100];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir(), entries[i].name);
+        if (unlink(path) == 0) {
+            total -= entries[i].size;
+            evicted++;
+        }
+    }
+    free(entries);
+    update_stats(0, 0, evicted, NULL);
+}
+
+// =================================================================
+// == 命中回放
+// =================================================================
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @description: 查找缓存条目，找到时把输出回放到 stdout/stderr
+ * @return {int} - 命中时返回保存的退出码，未命中返回 -1
+ */
+static int replay_entry(const char* path, const keybuf_t* key) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(memo_header_t)) {
+        close(fd);
+        return -1;
+    }
+    char* data = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    size_t size = st.st_size;
+    memo_header_t* hdr = (memo_header_t*)data;
+    size_t pos = sizeof(memo_header_t) + hdr->key_len;
+    int status = -1;
+    if (hdr->magic != MEMO_MAGIC || hdr->version != MEMO_VERSION || hdr->exit_code < 0 ||
+        pos > size || hdr->key_len != key->len ||
+        memcmp(data + sizeof(memo_header_t), key->data, key->len) != 0) {
+        goto done;
+    }
+
+    // 先检查所有记录都完整，再开始输出，损坏的文件按未命中处理
+    for (size_t p = pos; p < size;) {
+        memo_record_t rec;
+        if (p + sizeof(rec) > size) goto done;
+        memcpy(&rec, data + p, sizeof(rec));
+        p += sizeof(rec);
+        if (rec.len > size - p || (rec.stream != 1 && rec.stream != 2)) goto done;
+        p += rec.len;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    while (pos < size) {
+        memo_record_t rec;
+        memcpy(&rec, data + pos, sizeof(rec));
+        pos += sizeof(rec);
+        if (write_all(rec.stream, data + pos, rec.len) < 0) break;
+        pos += rec.len;
+    }
+    status = hdr->exit_code;
+    utimensat(AT_FDCWD, path, NULL, 0); // 更新最近使用时间（mtime），用于 LRU
+
+done:
+    munmap(data, size);
+    return status;
+}
+
+// =================================================================
+// == 未命中：执行并写入缓存
+// =================================================================
+
+/**
+ * @description: tee 进程：把命令的 stdout/stderr 原样转发，同时按顺序写入缓存文件
+ * @return {int} - 缓存内容完整返回 0，超过大小上限或写入失败返回 1
+ */
+static int tee_output(int out_fd, int err_fd, int cache_fd, unsigned long long limit) {
+    struct pollfd pfds[2] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}};
+    int streams[2] = {STDOUT_FILENO, STDERR_FILENO};
+    int open_count = 2;
+    int cache_ok = 1;
+    unsigned long long written = 0;
+    char buf[65536];
+
+    while (open_count > 0) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (pfds[i].fd < 0 || pfds[i].revents == 0) continue;
+            ssize_t n = read(pfds[i].fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                open_count--;
+                continue;
+            }
+            write_all(streams[i], buf, n);
+
+            written += sizeof(memo_record_t) + n;
+            if (written > limit) cache_ok = 0; // 单条输出比整个缓存还大，只转发不缓存
+            if (cache_ok) {
+                memo_record_t rec = {(uint8_t)streams[i], (uint32_t)n};
+                if (write_all(cache_fd, (const char*)&rec, sizeof(rec)) < 0 ||
+                    write_all(cache_fd, buf, n) < 0) {
+                    cache_ok = 0;
+                }
+            }
+        }
+    }
+    return cache_ok ? 0 : 1;
+}
+
+/**
+ * @description: 通过 execute_command() 执行命令，输出经 tee 进程同时写入缓存
+ * @return {int} - 命令的退出码
+ */
+static int run_and_store(char** argv, const char* path, const keybuf_t* key) {
+    command_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    for (int i = 0; argv[i] != NULL && i < MAX_ARGS - 1; i++) cmd.args[i] = argv[i];
+
+    char tmp[1200];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    int cache_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int out_pipe[2], err_pipe[2];
+    if (cache_fd < 0 || pipe2(out_pipe, O_CLOEXEC) < 0) {
+        if (cache_fd >= 0) {
+            close(cache_fd);
+            unlink(tmp);
+        }
+        return execute_command(&cmd); // 无法缓存时照常执行
+    }
+    if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        close(cache_fd);
+        unlink(tmp);
+        return execute_command(&cmd);
+    }
+
+    memo_header_t hdr = {MEMO_MAGIC, MEMO_VERSION, -1, (uint32_t)key->len};
+    int header_ok = write_all(cache_fd, (const char*)&hdr, sizeof(hdr)) == 0 &&
+                    write_all(cache_fd, key->data, key->len) == 0;
+
+    fflush(NULL);
+    pid_t tee_pid = fork();
+    if (tee_pid == 0) {
+        reset_interrupt_handler();
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        _exit(tee_output(out_pipe[0], err_pipe[0], cache_fd, max_cache_size()));
+    }
+    close(out_pipe[0]);
+    close(err_pipe[0]);
+
+    // 命令的 stdout/stderr 接到 tee 进程，执行完再恢复
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    int saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    if (tee_pid > 0) {
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+    }
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    int status = execute_command(&cmd);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    int tee_status = -1;
+    if (tee_pid > 0) waitpid(tee_pid, &tee_status, 0);
+
+    // 输出完整、命令正常退出时才把退出码写进文件头并发布
+    int stored = 0;
+    if (header_ok && tee_pid > 0 && WIFEXITED(tee_status) && WEXITSTATUS(tee_status) == 0 && status < 128) {
+        hdr.exit_code = status;
+        stored = pwrite(cache_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && rename(tmp, path) == 0;
+    }
+    close(cache_fd);
+    if (!stored) unlink(tmp);
+    else evict_entries();
+    return status;
+}
+
+// =================================================================
+// == memo 内建命令
+// =================================================================
+
+static void format_size(unsigned long long bytes, char* buf, size_t size) {
+    if (bytes >= (1ULL << 30)) snprintf(buf, size, "%.1f GB", bytes / (double)(1ULL << 30));
+    else if (bytes >= (1ULL << 20)) snprintf(buf, size, "%.1f MB", bytes / (double)(1ULL << 20));
+    else if (bytes >= 1024) snprintf(buf, size, "%.1f KB", bytes / 1024.0);
+    else snprintf(buf, size, "%llu B", bytes);
+}
+
+static int print_stats() {
+    memo_stats_t stats;
+    int count;
+    unsigned long long total;
+    update_stats(0, 0, 0, &stats);
+    free(list_entries(&count, &total));
+
+    unsigned long long lookups = stats.hits + stats.misses;
+    printf("memo: %llu hits, %llu misses, hit ratio %.1f%%\n", stats.hits, stats.misses,
+           lookups ? stats.hits * 100.0 / lookups : 0.0);
+    char used[32], limit[32];
+    format_size(total, used, sizeof(used));
+    format_size(max_cache_size(), limit, sizeof(limit));
+    printf("memo: %d entries, %s of %s, %llu evictions\n", count, used, limit, stats.evictions);
+    return 0;
+}
+
+static int clear_cache() {
+    int count;
+    unsigned long long total;
+    entry_info_t* entries = list_entries(&count, &total);
+    for (int i = 0; i < count; i++) {
+        char path[1100];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir(), entries[i].name);
+        unlink(path);
+    }
+    free(entries);
+
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/stats", cache_dir());
+    unlink(path);
+    return 0;
+}
+
+// stdin 是终端（交互输入，照常缓存）或 /dev/null（总是空的）
+static int stdin_is_fixed(const struct stat* st) {
+    if (isatty(STDIN_FILENO)) return 1;
+    struct stat null_st;
+    return S_ISCHR(st->st_mode) && stat("/dev/null", &null_st) == 0 && st->st_rdev == null_st.st_rdev;
+}
+
+// 不查缓存也不写缓存，照常执行命令
+static int run_uncached(char** argv) {
+    command_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    for (int i = 0; argv[i] != NULL && i < MAX_ARGS - 1; i++) cmd.args[i] = argv[i];
+    return execute_command(&cmd);
+}
+
+/**
+ * @description: memo 内建命令：命中缓存时回放输出，否则执行命令并缓存输出
+ * @return {int} - 命令（或回放）的退出码
+ */
+int builtin_memo(char** args) {
+    if (cache_dir() == NULL) {
+        fprintf(stderr, "myshell: memo: cannot create cache directory\n");
+        return 1;
+    }
+    if (args[1] != NULL && strcmp(args[1], "--stats") == 0) return print_stats();
+    if (args[1] != NULL && strcmp(args[1], "--clear") == 0) return clear_cache();
+
+    keybuf_t key = {0};
+    key_add_str(&key, "cwd");
+    char cwd[4096];
+    key_add_str(&key, getcwd(cwd, sizeof(cwd)) ? cwd : "?");
+    const char* path_var = getenv("PATH");
+    key_add_str(&key, "PATH");
+    key_add_str(&key, path_var ? path_var : "");
+
+    int i = 1;
+    for (; args[i] != NULL; i++) {
+        if (strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (args[i][0] != '-') break;
+        struct stat st;
+        if (strcmp(args[i], "--env") == 0 && args[i + 1] != NULL) {
+            const char* value = get_var(args[++i]);
+            key_add_str(&key, "env");
+            key_add_str(&key, args[i]);
+            key_add_str(&key, value ? value : "\x01unset");
+        } else if (strcmp(args[i], "--file") == 0 && args[i + 1] != NULL) {
+            i++;
+            key_add_stat(&key, args[i], stat(args[i], &st) == 0 ? &st : NULL);
+        } else {
+            fprintf(stderr, "myshell: memo: %s: invalid option\n", args[i]);
+            free(key.data);
+            return 2;
+        }
+    }
+    if (args[i] == NULL) {
+        fprintf(stderr, "myshell: memo: usage: memo [--env NAME] [--file PATH] [--] command | memo --stats | memo --clear\n");
+        free(key.data);
+        return 2;
+    }
+
+    // 普通文件形式的 stdin（例如 memo sort < data.txt）也算作输入。
+    // 管道、套接字之类的 stdin 每次内容都可能不同，又没法在不读走的情况下算进键里，不缓存，直接执行
+    struct stat in_st;
+    int have_stdin = fstat(STDIN_FILENO, &in_st) == 0;
+    if (have_stdin && S_ISREG(in_st.st_mode)) {
+        key_add_stat(&key, "<stdin>", &in_st);
+    } else if (have_stdin && !stdin_is_fixed(&in_st)) {
+        free(key.data);
+        return run_uncached(args + i);
+    }
+    key_add_str(&key, "argv");
+    for (int j = i; args[j] != NULL; j++) key_add_str(&key, args[j]);
+
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/%016llx", cache_dir(), (unsigned long long)hash_key(&key));
+
+    int status = replay_entry(path, &key);
+    if (status >= 0) {
+        update_stats(1, 0, 0, NULL);
+    } else {
+        update_stats(0, 1, 0, NULL);
+        status = run_and_store(args + i, path, &key);
+    }
+    free(key.data);
+    return status;
+}
@@ -0,0 +1,134 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-07-24 09:31:08
+ * @FilePath: /linux-shell/src/meter.c
+ * @Descripttion: 管道测速模块-在管道两段之间插入 splice 中继，统计每条边的吞吐量和阻塞时间
+ */
+
+// 用法: cmd1 |> cmd2
+// `|>` 和 `|` 一样连接两个命令，但中间多了一个中继进程：
+//   cmd1 --(管道A)--> 中继 --(管道B)--> cmd2
+// 中继用 splice(2) 在两个管道之间搬运数据，数据页只在内核里移动，不会拷贝到用户态。
+// 中继在等待时记录是在等谁：
+//   - 管道A 没有数据 -> 上游写端 (writer) 慢
+//   - 管道B 已经满了 -> 下游读端 (reader) 慢
+// 管道结束时向 stderr 打印这条边的字节数、MB/s 和两边的阻塞时间。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+#define METER_CHUNK (1 << 20) // 每次 splice 最多搬运的字节数
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 等待 fd 就绪，返回等待的秒数
+static double wait_fd(int fd, short events) {
+    struct pollfd pfd = {fd, events, 0};
+    double start = now_seconds();
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {}
+    return now_seconds() - start;
+}
+
+/**
+ * @description: 中继主循环：把 in_fd 的数据 splice 到 out_fd，直到上游关闭
+ */
+static void relay(int in_fd, int out_fd, int edge, const char* from, const char* to) {
+    unsigned long long bytes = 0;
+    int reader_closed = 0; // 下游提前退出（例如 head），报告里注明
+    double writer_stall = 0, reader_stall = 0;
+    double start = now_seconds();
+
+#ifdef __linux__
+    for (;;) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            bytes += n;
+            continue;
+        }
+        if (n == 0) break; // 上游写端已经全部关闭
+        if (errno == EINTR) continue;
+        if (errno == EPIPE) {
+            reader_closed = 1;
+            break;
+        }
+        if (errno != EAGAIN) break;
+
+        // EAGAIN：要么输入空，要么输出满，看看是哪一边
+        struct pollfd pfd = {in_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) == 0) {
+            writer_stall += wait_fd(in_fd, POLLIN);
+        } else {
+            reader_stall += wait_fd(out_fd, POLLOUT);
+        }
+    }
+#else
+    // 没有 splice 的平台：退化成普通拷贝，只统计字节数
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+        if (write(out_fd, buf, n) != n) {
+            reader_closed = (errno == EPIPE);
+            break;
+        }
+        bytes += n;
+    }
+#endif
+
+    double elapsed = now_seconds() - start;
+    double mb = bytes / (1024.0 * 1024.0);
+    const char* slow = "-";
+    if (writer_stall > reader_stall && writer_stall > elapsed * 0.1) slow = "writer";
+    else if (reader_stall > elapsed * 0.1) slow = "reader";
+    fprintf(stderr,
+            "[meter] edge %d %s -> %s: %.1f MB in %.3f s, %.1f MB/s, "
+            "writer stall %.3f s, reader stall %.3f s, blocked side: %s%s\n",
+            edge, from, to, mb, elapsed, elapsed > 0 ? mb / elapsed : 0.0,
+            writer_stall, reader_stall, slow, reader_closed ? ", reader closed early" : "");
+}
+
+/**
+ * @description: 在管道的一条边上启动测速中继
+ * @param {int} in_fd - 上游管道的读端（中继接管，调用者在返回后应关闭它）
+ * @param {int*} out_fd - 输出：交给下游命令的新管道读端
+ * @param {int} edge - 边的编号（从 1 开始），用于报告
+ * @param {const char*} from - 上游命令名
+ * @param {const char*} to - 下游命令名
+ * @return {pid_t} - 中继进程的 pid，失败返回 -1（此时 *out_fd 等于 in_fd，管道照常工作）
+ */
+pid_t start_pipe_meter(int in_fd, int* out_fd, int edge, const char* from, const char* to) {
+    int fds[2];
+    *out_fd = in_fd;
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // 下游提前退出时得到 EPIPE 而不是被杀死，照样打印报告；
+        // Ctrl+C 由前台命令处理，中继等上游结束后自然退出
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, SIG_IGN);
+        close(fds[0]);
+        relay(in_fd, fds[1], edge, from, to);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    *out_fd = fds[0];
+    return pid;
+}
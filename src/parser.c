@@ -2,135 +2,929 @@
  * @Author: Yuzhe Guo
  * @Date: 2025-07-07 14:51:12
  * @FilePath: /linux-shell/src/parser.c
- * @Descripttion: 命令解析模块,这个模块负责将字符串拆分成 command_t 结构。
+ * @Descripttion: 命令解析模块,这个模块负责把输入文本解析成语法树 (node_t)。
  */
+
+// 语法（简化版的 POSIX shell 文法）:
+//   list     : and_or ((';' | '&' | NEWLINE) and_or)*
+//   and_or   : pipeline (('&&' | '||') pipeline)*
+//   pipeline : ['!'] command (('|' | '|>') command)*
+//   command  : compound redirect* | name '(' ')' compound | simple
+//   simple   : (NAME=value | word | redirect)+
+//   word     : WORD | '<(' list ')' | '>(' list ')'     (进程替换)
+//   compound : '(' list ')' | '{' list '}' | '((' expr '))' | if | while | until | for | case
+//
+// 解析只做一次：循环体、函数体都以语法树的形式保存，执行时不会重新分词。
+// 词法分析时保留引号和 $ 等原始字符，展开工作在执行前由 expand.c 完成。
+
 #include "shell.h"
+#include <ctype.h>
+
+// 词法单元类型
+typedef enum {
+    T_WORD,
+    T_NEWLINE,
+    T_SEMI,     // ;
+    T_DSEMI,    // ;;
+    T_AMP,      // &
+    T_AND_IF,   // &&
+    T_PIPE,     // |
+    T_PIPE_METER, // |> 带测速的管道
+    T_OR_IF,    // ||
+    T_LPAREN,   // (
+    T_RPAREN,   // )
+    T_LESS,     // <
+    T_GREAT,    // >
+    T_DGREAT,   // >>
+    T_SUBST_IN,  // <( 进程替换，命令从中读取
+    T_SUBST_OUT, // >( 进程替换，命令向其中写入
+    T_EOF
+} token_type_t;
+
+typedef struct {
+    token_type_t type;
+    char* text;     // 仅 T_WORD 有效
+    int quoted;     // 词中是否含有引号或转义（带引号的词不会被当成关键字）
+} token_t;
+
+typedef struct {
+    const char* src;
+    size_t pos;         // 下一个未读字符的位置
+    token_t tok;        // 预读的词法单元
+    int have_tok;
+    int error;          // 已经报告过语法错误
+    int incomplete;     // 输入在一条命令中间结束
+} parser_t;
+
+static node_t* parse_list(parser_t* p, int top_level);
+static node_t* parse_compound(parser_t* p);
+
+// =================================================================
+// == 词法分析
+// =================================================================
+
+static int is_meta(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '&' ||
+           c == '|' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+/**
+ * @description: 读取一个词。引号、转义和 ${...} 原样保留在词里。
+ * @return {int} - 成功返回 0，引号未闭合返回 -1
+ */
+static int lex_word(parser_t* p, token_t* tok) {
+    const char* s = p->src;
+    size_t start = p->pos;
+    size_t i = p->pos;
+    int quoted = 0;
+
+    while (s[i] != '\0' && !is_meta(s[i])) {
+        if (s[i] == '\\') {
+            quoted = 1;
+            if (s[i + 1] == '\0') { i++; break; }
+            i += 2;
+        } else if (s[i] == '\'') {
+            quoted = 1;
+            i++;
+            while (s[i] != '\0' && s[i] != '\'') i++;
+            if (s[i] == '\0') return -1;
+            i++;
+        } else if (s[i] == '\"') {
+            quoted = 1;
+            i++;
+            while (s[i] != '\0' && s[i] != '\"') {
+                if (s[i] == '\\' && s[i + 1] != '\0') i++;
+                i++;
+            }
+            if (s[i] == '\0') return -1;
+            i++;
+        } else if (s[i] == '$' && s[i + 1] == '{') {
+            i += 2;
+            while (s[i] != '\0' && s[i] != '}') i++;
+            if (s[i] == '\0') return -1;
+            i++;
+        } else if (s[i] == '$' && s[i + 1] == '(' && s[i + 2] == '(') {
+            // $(( 算术展开 ))，里面的括号、空格和运算符都属于这个词
+            long end = arith_find_end(s + i + 3);
+            if (end == -1) return -1;
+            i += (end >= 0) ? 3 + end + 2 : 1;
+        } else {
+            i++;
+        }
+    }
+
+    tok->type = T_WORD;
+    tok->text = strndup(s + start, i - start);
+    tok->quoted = quoted;
+    p->pos = i;
+    return 0;
+}
+
+/**
+ * @description: 读取下一个词法单元到 p->tok
+ */
+static void lex_next(parser_t* p) {
+    const char* s = p->src;
+    token_t* tok = &p->tok;
+    tok->text = NULL;
+    tok->quoted = 0;
+    p->have_tok = 1;
+
+    // 跳过空白、续行和注释
+    for (;;) {
+        while (s[p->pos] == ' ' || s[p->pos] == '\t') p->pos++;
+        if (s[p->pos] == '\\' && s[p->pos + 1] == '\n') {
+            p->pos += 2;
+            continue;
+        }
+        if (s[p->pos] == '#') {
+            while (s[p->pos] != '\0' && s[p->pos] != '\n') p->pos++;
+        }
+        break;
+    }
+
+    char c = s[p->pos];
+    char n = (c != '\0') ? s[p->pos + 1] : '\0';
+    switch (c) {
+    case '\0': tok->type = T_EOF; return;
+    case '\n': tok->type = T_NEWLINE; p->pos++; return;
+    case ';':
+        if (n == ';') { tok->type = T_DSEMI; p->pos += 2; }
+        else { tok->type = T_SEMI; p->pos++; }
+        return;
+    case '&':
+        if (n == '&') { tok->type = T_AND_IF; p->pos += 2; }
+        else { tok->type = T_AMP; p->pos++; }
+        return;
+    case '|':
+        if (n == '|') { tok->type = T_OR_IF; p->pos += 2; }
+        else if (n == '>') { tok->type = T_PIPE_METER; p->pos += 2; }
+        else { tok->type = T_PIPE; p->pos++; }
+        return;
+    case '(': tok->type = T_LPAREN; p->pos++; return;
+    case ')': tok->type = T_RPAREN; p->pos++; return;
+    case '<':
+        if (n == '(') { tok->type = T_SUBST_IN; p->pos += 2; }
+        else { tok->type = T_LESS; p->pos++; }
+        return;
+    case '>':
+        if (n == '>') { tok->type = T_DGREAT; p->pos += 2; }
+        else if (n == '(') { tok->type = T_SUBST_OUT; p->pos += 2; }
+        else { tok->type = T_GREAT; p->pos++; }
+        return;
+    }
+
+    if (lex_word(p, tok) < 0) {
+        // 引号没关：交互模式下可以继续读下一行
+        p->incomplete = 1;
+        p->pos = strlen(s);
+        tok->type = T_EOF;
+    }
+}
+
+static token_t* peek(parser_t* p) {
+    if (!p->have_tok) lex_next(p);
+    return &p->tok;
+}
+
+static void advance(parser_t* p) {
+    if (p->have_tok && p->tok.type == T_WORD) free(p->tok.text);
+    p->have_tok = 0;
+}
+
+// 取走当前词的文本（所有权转移给调用者）
+static char* take_word(parser_t* p) {
+    char* text = p->tok.text;
+    p->have_tok = 0;
+    return text;
+}
+
+static int is_keyword(token_t* tok, const char* kw) {
+    return tok->type == T_WORD && !tok->quoted && strcmp(tok->text, kw) == 0;
+}
+
+static const char* token_name(token_t* tok) {
+    switch (tok->type) {
+    case T_WORD: return tok->text;
+    case T_NEWLINE: return "newline";
+    case T_SEMI: return ";";
+    case T_DSEMI: return ";;";
+    case T_AMP: return "&";
+    case T_AND_IF: return "&&";
+    case T_PIPE: return "|";
+    case T_PIPE_METER: return "|>";
+    case T_OR_IF: return "||";
+    case T_LPAREN: return "(";
+    case T_RPAREN: return ")";
+    case T_LESS: return "<";
+    case T_GREAT: return ">";
+    case T_DGREAT: return ">>";
+    case T_SUBST_IN: return "<(";
+    case T_SUBST_OUT: return ">(";
+    default: return "EOF";
+    }
+}
+
+/**
+ * @description: 报告语法错误。如果是输入提前结束，只标记为“不完整”而不打印
+ */
+static void syntax_error(parser_t* p) {
+    token_t* tok = peek(p);
+    if (tok->type == T_EOF) {
+        p->incomplete = 1;
+    } else if (!p->error) {
+        fprintf(stderr, "myshell: syntax error near unexpected token `%s'\n", token_name(tok));
+    }
+    p->error = 1;
+}
+
+static void skip_newlines(parser_t* p) {
+    while (peek(p)->type == T_NEWLINE) advance(p);
+}
+
+static int expect_keyword(parser_t* p, const char* kw) {
+    if (!is_keyword(peek(p), kw)) {
+        syntax_error(p);
+        return -1;
+    }
+    advance(p);
+    return 0;
+}
+
+// =================================================================
+// == 节点的创建与释放
+// =================================================================
+
+static node_t* new_node(node_type_t type) {
+    node_t* node = (node_t*)calloc(1, sizeof(node_t));
+    node->type = type;
+    node->refcount = 1;
+    return node;
+}
+
+static node_t* new_binary(node_type_t type, node_t* left, node_t* right) {
+    node_t* node = new_node(type);
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static void free_words(char** words) {
+    if (words == NULL) return;
+    for (int i = 0; words[i] != NULL; i++) free(words[i]);
+    free(words);
+}
+
+// 释放单个 command_t 中的内容（不释放结构体本身）
+static void cleanup_cmd(command_t* cmd) {
+    for (int j = 0; cmd->args[j] != NULL; j++) {
+        free(cmd->args[j]);
+    }
+    free(cmd->input_file);
+    free(cmd->output_file);
+    free_output_targets(cmd->more_outputs);
+    while (cmd->substs != NULL) {
+        proc_subst_t* next = cmd->substs->next;
+        free_node(cmd->substs->body);
+        free(cmd->substs);
+        cmd->substs = next;
+    }
+    free_words(cmd->assigns);
+    free_node(cmd->compound);
+}
 
 // 先声明一个辅助函数，用于清理 command_t 数组的内存
 static void cleanup_cmds(command_t* cmds, int count) {
     for (int i = 0; i < count; i++) {
-        for (int j = 0; cmds[i].args[j] != NULL; j++) {
-            free(cmds[i].args[j]);
-        }
+        cleanup_cmd(&cmds[i]);
+    }
+    free(cmds);
+}
+
+/**
+ * @description: 释放语法树。节点带引用计数，函数定义会额外持有函数体的引用
+ */
+void free_node(node_t* node) {
+    if (node == NULL || --node->refcount > 0) return;
+
+    free_node(node->left);
+    free_node(node->right);
+    free_node(node->else_part);
+    if (node->cmds) cleanup_cmds(node->cmds, node->cmd_count);
+    free(node->name);
+    free_words(node->words);
+    case_item_t* item = node->items;
+    while (item != NULL) {
+        case_item_t* next = item->next;
+        free_words(item->patterns);
+        free_node(item->body);
+        free(item);
+        item = next;
+    }
+    free(node);
+}
+
+// 往以 NULL 结尾的动态数组末尾追加一个词
+static char** push_word(char** words, int* count, char* word) {
+    words = (char**)realloc(words, sizeof(char*) * (*count + 2));
+    words[(*count)++] = word;
+    words[*count] = NULL;
+    return words;
+}
+
+// =================================================================
+// == 语法分析
+// =================================================================
+
+// 判断一个词是否形如 NAME=value
+static int is_assignment(const char* word) {
+    const char* eq = strchr(word, '=');
+    return eq != NULL && eq != word && is_valid_name(word, eq - word);
+}
+
+// 列表在这些位置结束（由外层的复合命令来消费它们）
+static int is_list_terminator(token_t* tok) {
+    if (tok->type == T_EOF || tok->type == T_RPAREN || tok->type == T_DSEMI) return 1;
+    if (tok->type != T_WORD || tok->quoted) return 0;
+    static const char* stops[] = {"then", "elif", "else", "fi", "do", "done", "esac", "}", NULL};
+    for (int i = 0; stops[i] != NULL; i++) {
+        if (strcmp(tok->text, stops[i]) == 0) return 1;
     }
+    return 0;
+}
+
+// 解析复合命令的主体，主体不能为空
+static node_t* parse_body(parser_t* p) {
+    node_t* body = parse_list(p, 0);
+    if (body == NULL && !p->error) syntax_error(p);
+    return body;
+}
+
+/**
+ * @description: 解析进程替换 <(list) / >(list)，加入 cmd 的进程替换列表
+ * @return {char*} - 代替它的占位符词；不是进程替换时返回 NULL（出错时 p->error 已设置）
+ */
+static char* parse_proc_subst(parser_t* p, command_t* cmd) {
+    token_type_t type = peek(p)->type;
+    if (type != T_SUBST_IN && type != T_SUBST_OUT) return NULL;
+    advance(p);
+
+    node_t* body = parse_body(p);
+    if (body == NULL) return NULL;
+    if (peek(p)->type != T_RPAREN) {
+        syntax_error(p);
+        free_node(body);
+        return NULL;
+    }
+    advance(p);
+
+    int index = 0;
+    proc_subst_t** tail = &cmd->substs;
+    for (; *tail != NULL; tail = &(*tail)->next) index++;
+    *tail = (proc_subst_t*)calloc(1, sizeof(proc_subst_t));
+    (*tail)->body = body;
+    (*tail)->is_output = (type == T_SUBST_OUT);
+
+    char mark[16];
+    snprintf(mark, sizeof(mark), "%c%d", SUBST_MARK, index);
+    return strdup(mark);
+}
+
+/**
+ * @description: 解析重定向，把目标文件填入 cmd
+ * @return {int} - 1 表示解析了一个重定向，0 表示当前不是重定向，-1 表示出错
+ */
+static int parse_redirect(parser_t* p, command_t* cmd) {
+    token_type_t type = peek(p)->type;
+    if (type != T_LESS && type != T_GREAT && type != T_DGREAT) return 0;
+    advance(p);
+    char* target;
+    if (peek(p)->type == T_WORD) {
+        target = take_word(p);
+    } else if ((target = parse_proc_subst(p, cmd)) == NULL) { // 例如 done < <(cmd)
+        if (!p->error) syntax_error(p);
+        return -1;
+    }
+    if (type == T_LESS) {
+        free(cmd->input_file);
+        cmd->input_file = target;
+    } else if (cmd->output_file == NULL) {
+        cmd->output_file = target;
+        cmd->append_output = (type == T_DGREAT);
+    } else {
+        // 第二个及之后的输出目标：输出同时写入每一个目标
+        output_target_t* t = (output_target_t*)calloc(1, sizeof(output_target_t));
+        t->file = target;
+        t->append = (type == T_DGREAT);
+        output_target_t** tail = &cmd->more_outputs;
+        while (*tail != NULL) tail = &(*tail)->next;
+        *tail = t;
+    }
+    return 1;
 }
 
 /**
- * @description: 统一的命令行解析函数
- * @param {char*} line - 完整的用户输入行
- * @param {command_t*} cmds - command_t 结构体数组
- * @return {int} - 解析出的命令数量
+ * @description: 解析一条命令（管道中的一段）
+ * @param {command_t*} cmd - 输出：简单命令或复合命令
+ * @param {node_t**} funcdef - 输出：如果这是一个函数定义，返回定义节点
+ * @return {int} - 成功返回 0，出错返回 -1
  */
+static int parse_command(parser_t* p, command_t* cmd, node_t** funcdef) {
+    memset(cmd, 0, sizeof(command_t));
+    *funcdef = NULL;
 
-// line 是用户输入的一整行
-// cmds 是传进来的结构体数组，准备把每个‼️子命令填进去
-// 每个 | 都会“开辟”一个新的 command_t，即我们准备填下一条子命令
-int parse_line(char* line, command_t* cmds) {
-    int cmd_count = 0; //第几个子命令
-    int argc = 0;  // 每个命令的参数数量
-    char* buf = line; // 指向当前正在处理的位置
-    char* arg_start = NULL;
-    int in_quote = 0;
-
-    // 初始化第一个命令
-    memset(&cmds[cmd_count], 0, sizeof(command_t));
-
-
-
-    // 主循环
-    while (*buf != '\0') {
-        // 跳过前导空白
-        while (*buf == ' ' || *buf == '\t') buf++;
-        if (*buf == '\0') break;
-
-        // 检查管道符
-        if (*buf == '|') {
-            if (argc == 0) { // 管道符前没有命令
-                fprintf(stderr, "myshell: syntax error near unexpected token `|'\n");
-                cleanup_cmds(cmds, cmd_count);
-                return 0;
+    // --- 复合命令 ---
+    cmd->compound = parse_compound(p);
+    if (cmd->compound != NULL) {
+        int r;
+        while ((r = parse_redirect(p, cmd)) > 0) {}
+        return r;
+    }
+    if (p->error) return -1;
+
+    // --- 简单命令 ---
+    int argc = 0;
+    int nassigns = 0;
+    for (;;) {
+        int r = parse_redirect(p, cmd);
+        if (r < 0) return -1;
+        if (r > 0) continue;
+
+        char* subst = parse_proc_subst(p, cmd);
+        if (p->error) return -1;
+        if (subst != NULL) {
+            if (argc >= MAX_ARGS - 1) {
+                fprintf(stderr, "myshell: too many arguments\n");
+                free(subst);
+                p->error = 1;
+                return -1;
             }
-            cmds[cmd_count].args[argc] = NULL; // 结束当前命令的参数列表
-            cmd_count++; // 移动到下一个命令
-            argc = 0; // 重置参数计数器
-            memset(&cmds[cmd_count], 0, sizeof(command_t)); // 初始化下一个命令
-            buf++;
+            cmd->args[argc++] = subst;
             continue;
         }
-        
-        // 解析一个参数
-        arg_start = buf;
-        if (*buf == '\"') {
-            // 处理引号内的字符串，支持参数中有空格
-            in_quote = 1;
-            arg_start++; // 跳过开头的引号
-            buf++;
-            while (*buf != '\0' && *buf != '\"') buf++;
-        } else {
-            // 正常参数，遇空格或 | 就结束
-            in_quote = 0;
-            while (*buf != '\0' && *buf != ' ' && *buf != '\t' && *buf != '|') buf++;
-        }
-        
-
-
-        // 把一个完整的参数（字符串）摘出来，填入 args[]
-        char saved_char = *buf;
-        *buf = '\0';
-        cmds[cmd_count].args[argc++] = strdup(arg_start);
-        *buf = saved_char;
-        
-        // 引号未闭检测
-        if (in_quote) {
-            if (*buf == '\"') buf++; // 跳过结束的引号
-            else {
-                // 引号没关，报错
-                fprintf(stderr, "myshell: syntax error: unclosed quote\n");
-                cleanup_cmds(cmds, cmd_count + 1);
-                return 0;
+
+        token_t* tok = peek(p);
+        if (tok->type != T_WORD) break;
+
+        if (argc == 0 && is_assignment(tok->text)) {
+            cmd->assigns = push_word(cmd->assigns, &nassigns, take_word(p));
+            continue;
+        }
+        if (argc >= MAX_ARGS - 1) {
+            fprintf(stderr, "myshell: too many arguments\n");
+            p->error = 1;
+            return -1;
+        }
+        cmd->args[argc++] = take_word(p);
+
+        // name() compound —— 函数定义
+        if (argc == 1 && nassigns == 0 && peek(p)->type == T_LPAREN) {
+            advance(p);
+            if (peek(p)->type != T_RPAREN || !is_valid_name(cmd->args[0], strlen(cmd->args[0]))) {
+                syntax_error(p);
+                return -1;
             }
+            advance(p);
+            skip_newlines(p);
+            node_t* body = parse_compound(p);
+            if (body == NULL) {
+                if (!p->error) syntax_error(p);
+                return -1;
+            }
+            node_t* def = new_node(NODE_FUNCDEF);
+            def->name = cmd->args[0];
+            def->left = body;
+            cmd->args[0] = NULL;
+            *funcdef = def;
+            return 0;
+        }
+    }
+
+    if (argc == 0 && nassigns == 0 && cmd->input_file == NULL && cmd->output_file == NULL) {
+        syntax_error(p);
+        return -1;
+    }
+    return 0;
+}
+
+// if 之后的部分：cond; then list; [elif ...|else list;] fi
+static node_t* parse_if_rest(parser_t* p) {
+    node_t* node = new_node(NODE_IF);
+    if ((node->left = parse_body(p)) == NULL || expect_keyword(p, "then") < 0 ||
+        (node->right = parse_body(p)) == NULL) {
+        free_node(node);
+        return NULL;
+    }
+    if (is_keyword(peek(p), "elif")) {
+        advance(p);
+        if ((node->else_part = parse_if_rest(p)) == NULL) {
+            free_node(node);
+            return NULL;
+        }
+        return node; // 内层的 if 已经消费了 fi
+    }
+    if (is_keyword(peek(p), "else")) {
+        advance(p);
+        if ((node->else_part = parse_body(p)) == NULL) {
+            free_node(node);
+            return NULL;
+        }
+    }
+    if (expect_keyword(p, "fi") < 0) {
+        free_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+// do list; done
+static node_t* parse_do_group(parser_t* p) {
+    if (expect_keyword(p, "do") < 0) return NULL;
+    node_t* body = parse_body(p);
+    if (body == NULL) return NULL;
+    if (expect_keyword(p, "done") < 0) {
+        free_node(body);
+        return NULL;
+    }
+    return body;
+}
+
+/**
+ * @description: 读取 (( 之后的算术表达式，直到配对的 ))
+ * @return {char*} - 表达式原文；不是算术表达式（比如 ((a); b) 这样的嵌套子 Shell）返回 NULL，
+ *                   输入在中途结束时返回 NULL 并标记为不完整
+ */
+static char* lex_arith(parser_t* p) {
+    const char* start = p->src + p->pos + 1;
+    long end = arith_find_end(start);
+    if (end == -1) {
+        p->pos = strlen(p->src);
+        syntax_error(p);
+        return NULL;
+    }
+    if (end == -2) return NULL;
+    p->pos += 1 + end + 2;
+    return strndup(start, end);
+}
+
+// (( expr ))
+static node_t* parse_arith_command(parser_t* p) {
+    char* expr = lex_arith(p);
+    if (expr == NULL) return NULL;
+    node_t* node = new_node(NODE_ARITH);
+    node->name = expr;
+    return node;
+}
+
+// for ((init; cond; step)) 之后的部分，三个表达式存在 words 里
+static node_t* parse_arith_for(parser_t* p) {
+    char* text = lex_arith(p);
+    if (text == NULL) {
+        if (!p->error) syntax_error(p);
+        return NULL;
+    }
+    int semis = 0;
+    for (const char* c = text; *c; c++) semis += (*c == ';');
+    if (semis != 2) {
+        fprintf(stderr, "myshell: syntax error: `((%s))': expected three expressions\n", text);
+        free(text);
+        p->error = 1;
+        return NULL;
+    }
+
+    // 按 ; 分成三段，去掉两端的空白，省略的表达式是空串
+    char* parts[3];
+    char* s = text;
+    for (int i = 0; i < 3; i++) {
+        char* end = strchr(s, ';');
+        if (end == NULL) end = s + strlen(s);
+        char* last = end;
+        while (*s == ' ' || *s == '\t' || *s == '\n') s++;
+        while (last > s && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\n')) last--;
+        parts[i] = strndup(s, last - s);
+        s = end + (*end != '\0');
+    }
+    free(text);
+
+    node_t* node = new_node(NODE_ARITH_FOR);
+    node->words = (char**)calloc(4, sizeof(char*));
+    for (int i = 0; i < 3; i++) node->words[i] = parts[i];
+
+    if (peek(p)->type == T_SEMI) advance(p);
+    skip_newlines(p);
+    if ((node->right = parse_do_group(p)) == NULL) {
+        free_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+static node_t* parse_for(parser_t* p) {
+    if (peek(p)->type == T_LPAREN && p->src[p->pos] == '(') {
+        advance(p);
+        return parse_arith_for(p);
+    }
+    if (peek(p)->type != T_WORD || !is_valid_name(p->tok.text, strlen(p->tok.text))) {
+        syntax_error(p);
+        return NULL;
+    }
+    node_t* node = new_node(NODE_FOR);
+    node->name = take_word(p);
+
+    skip_newlines(p);
+    if (is_keyword(peek(p), "in")) {
+        advance(p);
+        int count = 0;
+        node->words = (char**)calloc(1, sizeof(char*)); // 空列表也要和“省略 in”区分开
+        while (peek(p)->type == T_WORD) {
+            node->words = push_word(node->words, &count, take_word(p));
+        }
+        if (p->tok.type != T_SEMI && p->tok.type != T_NEWLINE) {
+            syntax_error(p);
+            free_node(node);
+            return NULL;
         }
+        advance(p);
+    } else if (peek(p)->type == T_SEMI) {
+        advance(p);
+    }
+    skip_newlines(p);
+
+    if ((node->right = parse_do_group(p)) == NULL) {
+        free_node(node);
+        return NULL;
+    }
+    return node;
+}
+
+static node_t* parse_case(parser_t* p) {
+    if (peek(p)->type != T_WORD) {
+        syntax_error(p);
+        return NULL;
     }
+    node_t* node = new_node(NODE_CASE);
+    node->name = take_word(p);
+    skip_newlines(p);
+    if (expect_keyword(p, "in") < 0) {
+        free_node(node);
+        return NULL;
+    }
+
+    case_item_t** tail = &node->items;
+    for (;;) {
+        skip_newlines(p);
+        if (is_keyword(peek(p), "esac")) {
+            advance(p);
+            return node;
+        }
 
-    // 结束
-    if (argc > 0) {
-        cmds[cmd_count].args[argc] = NULL;
-        cmd_count++;
-    }
-
-    // 后处理：扫描每个命令的参数来查找重定向和后台符号
-    // execvp() 只接受真正的“命令+参数”
-    for (int i = 0; i < cmd_count; i++) {
-        for (int j = 0; cmds[i].args[j] != NULL; j++) {
-            // 检查重定向符号 < 和 >，以及后台符号 &
-            // cat < input.txt
-            // 会解析出参数 ["cat", "<", "input.txt"]
-            if (strcmp(cmds[i].args[j], "<") == 0) {
-                cmds[i].input_file = strdup(cmds[i].args[j+1]);
-                free(cmds[i].args[j]);
-                free(cmds[i].args[j+1]);
-                cmds[i].args[j] = NULL; // 从参数中移除
-                cmds[i].args[j+1] = NULL;
-            } else if (strcmp(cmds[i].args[j], ">") == 0) {
-                cmds[i].output_file = strdup(cmds[i].args[j+1]);
-                free(cmds[i].args[j]);
-                free(cmds[i].args[j+1]);
-                cmds[i].args[j] = NULL;
-            } else if (strcmp(cmds[i].args[j], "&") == 0) {
-                cmds[i].is_background = 1;
-                free(cmds[i].args[j]);
-                cmds[i].args[j] = NULL;
+        case_item_t* item = (case_item_t*)calloc(1, sizeof(case_item_t));
+        *tail = item;
+        tail = &item->next;
+
+        if (peek(p)->type == T_LPAREN) advance(p);
+        int count = 0;
+        for (;;) {
+            if (peek(p)->type != T_WORD) {
+                syntax_error(p);
+                free_node(node);
+                return NULL;
             }
+            item->patterns = push_word(item->patterns, &count, take_word(p));
+            if (peek(p)->type != T_PIPE) break;
+            advance(p);
+        }
+        if (peek(p)->type != T_RPAREN) {
+            syntax_error(p);
+            free_node(node);
+            return NULL;
+        }
+        advance(p);
+
+        item->body = parse_list(p, 0); // 分支体允许为空
+        if (p->error) {
+            free_node(node);
+            return NULL;
+        }
+        if (peek(p)->type == T_DSEMI) {
+            advance(p);
+        } else if (!is_keyword(peek(p), "esac")) {
+            syntax_error(p);
+            free_node(node);
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @description: 如果当前位置是复合命令，解析它
+ * @return {node_t*} - 复合命令节点；不是复合命令或出错时返回 NULL（出错时 p->error 被置位）
+ */
+static node_t* parse_compound(parser_t* p) {
+    token_t* tok = peek(p);
+    node_t* node = NULL;
+
+    if (tok->type == T_LPAREN) {
+        advance(p);
+        if (p->src[p->pos] == '(') {
+            node = parse_arith_command(p);
+            if (node != NULL || p->error) return node;
+        }
+        node = new_node(NODE_SUBSHELL);
+        if ((node->left = parse_body(p)) == NULL) goto fail;
+        if (peek(p)->type != T_RPAREN) {
+            syntax_error(p);
+            goto fail;
+        }
+        advance(p);
+        return node;
+    }
+    if (tok->type != T_WORD || tok->quoted) return NULL;
+
+    if (strcmp(tok->text, "{") == 0) {
+        advance(p);
+        node = new_node(NODE_GROUP);
+        if ((node->left = parse_body(p)) == NULL || expect_keyword(p, "}") < 0) goto fail;
+        return node;
+    }
+    if (strcmp(tok->text, "if") == 0) {
+        advance(p);
+        return parse_if_rest(p);
+    }
+    if (strcmp(tok->text, "while") == 0 || strcmp(tok->text, "until") == 0) {
+        node = new_node(tok->text[0] == 'w' ? NODE_WHILE : NODE_UNTIL);
+        advance(p);
+        if ((node->left = parse_body(p)) == NULL || (node->right = parse_do_group(p)) == NULL) goto fail;
+        return node;
+    }
+    if (strcmp(tok->text, "for") == 0) {
+        advance(p);
+        return parse_for(p);
+    }
+    if (strcmp(tok->text, "case") == 0) {
+        advance(p);
+        return parse_case(p);
+    }
+    return NULL;
+
+fail:
+    free_node(node);
+    return NULL;
+}
+
+static node_t* parse_pipeline(parser_t* p) {
+    int timed = 0;
+    if (is_keyword(peek(p), "time")) {
+        advance(p);
+        timed = 1;
+    }
+    int negate = 0;
+    if (is_keyword(peek(p), "!")) {
+        advance(p);
+        negate = 1;
+    }
+
+    command_t* cmds = NULL;
+    int count = 0;
+    for (;;) {
+        cmds = (command_t*)realloc(cmds, sizeof(command_t) * (count + 1));
+        node_t* funcdef = NULL;
+        if (parse_command(p, &cmds[count], &funcdef) < 0) {
+            cleanup_cmds(cmds, count + 1);
+            return NULL;
         }
-        // 清理参数数组中的 NULL “空洞”
-        int write_idx = 0;
-        for (int read_idx = 0; cmds[i].args[read_idx] != NULL; read_idx++) {
-            if (cmds[i].args[read_idx] != NULL) { // 检查是多余的，但为了安全
-                cmds[i].args[write_idx++] = cmds[i].args[read_idx];
+        if (funcdef != NULL) {
+            // 函数定义只能单独出现
+            cleanup_cmd(&cmds[count]);
+            cleanup_cmds(cmds, count);
+            if (count > 0 || negate || timed || peek(p)->type == T_PIPE || peek(p)->type == T_PIPE_METER) {
+                free_node(funcdef);
+                syntax_error(p);
+                return NULL;
             }
+            return funcdef;
+        }
+        count++;
+
+        token_type_t type = peek(p)->type;
+        if (type != T_PIPE && type != T_PIPE_METER) break;
+        cmds[count - 1].meter_output = (type == T_PIPE_METER);
+        advance(p);
+        skip_newlines(p);
+    }
+
+    node_t* node = new_node(NODE_PIPELINE);
+    node->cmds = cmds;
+    node->cmd_count = count;
+    if (negate) {
+        node_t* not = new_node(NODE_NOT);
+        not->left = node;
+        node = not;
+    }
+    node->timed = timed;
+    return node;
+}
+
+static node_t* parse_and_or(parser_t* p) {
+    node_t* left = parse_pipeline(p);
+    if (left == NULL) return NULL;
+
+    for (;;) {
+        token_type_t type = peek(p)->type;
+        if (type != T_AND_IF && type != T_OR_IF) return left;
+        advance(p);
+        skip_newlines(p);
+        node_t* right = parse_pipeline(p);
+        if (right == NULL) {
+            free_node(left);
+            return NULL;
+        }
+        left = new_binary(type == T_AND_IF ? NODE_AND : NODE_OR, left, right);
+    }
+}
+
+/**
+ * @description: 解析一个命令列表
+ * @param {int} top_level - 为 1 时在第一个换行处结束（用于逐条读取输入）
+ * @return {node_t*} - 列表节点；列表为空或出错时返回 NULL
+ */
+static node_t* parse_list(parser_t* p, int top_level) {
+    node_t* result = NULL;
+
+    for (;;) {
+        if (!top_level) skip_newlines(p);
+        token_t* tok = peek(p);
+        if (top_level && tok->type == T_NEWLINE) {
+            advance(p);
+            break;
+        }
+        if (is_list_terminator(tok)) break;
+
+        node_t* node = parse_and_or(p);
+        if (node == NULL) {
+            free_node(result);
+            return NULL;
+        }
+        result = result ? new_binary(NODE_SEQUENCE, result, node) : node;
+
+        tok = peek(p);
+        if (tok->type == T_AMP) {
+            node->is_background = 1;
+            advance(p);
+        } else if (tok->type == T_SEMI) {
+            advance(p);
+        } else if (tok->type == T_NEWLINE) {
+            advance(p);
+            if (top_level) break;
+        } else if (!is_list_terminator(tok)) {
+            syntax_error(p);
+            free_node(result);
+            return NULL;
         }
-        cmds[i].args[write_idx] = NULL;
+    }
+    return result;
+}
+
+/**
+ * @description: 从 src 的 *pos 处解析下一条完整命令（到换行为止，复合命令可以跨行）
+ * @param {const char*} src - 输入文本
+ * @param {size_t*} pos - 输入/输出：当前解析位置
+ * @param {node_t**} out - 输出：解析出的语法树（调用者负责 free_node）
+ * @return {int} - PARSE_OK / PARSE_EOF / PARSE_ERROR / PARSE_INCOMPLETE
+ */
+int parse_next(const char* src, size_t* pos, node_t** out) {
+    parser_t p = {0};
+    p.src = src;
+    p.pos = *pos;
+    *out = NULL;
+
+    skip_newlines(&p);
+    if (peek(&p)->type == T_EOF) {
+        *pos = p.pos;
+        return p.incomplete ? PARSE_INCOMPLETE : PARSE_EOF;
     }
 
-    return cmd_count;
-}
\ No newline at end of file
+    node_t* node = parse_list(&p, 1);
+    if (!p.error && p.have_tok && p.tok.type != T_EOF) {
+        // 顶层出现了 ) fi done 之类多余的结束符
+        syntax_error(&p);
+        free_node(node);
+        node = NULL;
+    }
+    if (p.have_tok) advance(&p);
+
+    if (p.incomplete) {
+        free_node(node);
+        return PARSE_INCOMPLETE;
+    }
+    if (node == NULL) {
+        // 出错时丢弃这一行剩下的内容，从下一行继续
+        const char* nl = strchr(src + p.pos, '\n');
+        *pos = nl ? (size_t)(nl - src) + 1 : strlen(src);
+        return PARSE_ERROR;
+    }
+
+    *pos = p.pos;
+    *out = node;
+    return PARSE_OK;
+}
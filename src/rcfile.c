@@ -0,0 +1,545 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-07-29 20:17:45
+ * @FilePath: /linux-shell/src/rcfile.c
+ * @Descripttion: 启动配置模块-加载 ~/.myshellrc，并用二进制快照加速之后的启动
+ */
+
+// 第一次启动时逐行执行 ~/.myshellrc，执行完后把得到的别名表、变量和函数语法树
+// 写进二进制快照 ~/.myshellrc.snap。之后启动时，如果 rc 文件没有变化，就直接 mmap
+// 快照恢复这些状态，不再解析和执行 rc 文件。
+//
+// 快照只在下面两个条件都满足时才有效：
+//   1. rc 文件的 inode、大小和修改时间 (mtime) 与快照里记录的一致；
+//   2. rc 执行时读过的环境变量（例如 PATH=$HOME/bin:$PATH 中的 HOME、PATH）值没有变。
+// 如果 rc 文件里执行了外部命令或者有输出的内建命令（cd、echo 等），它的效果无法保存，
+// 这时不写快照，每次启动都照常执行 rc 文件。
+
+#include "shell.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SNAP_MAGIC   0x50414e53u // "SNAP"
+#define SNAP_VERSION 5
+#define NULL_STRING  0xffffffffu
+
+// 启动统计，myshell --startup-stats 时打印
+static struct {
+    int rc_found;
+    int snapshot_hit;
+    int snapshot_written;
+    int aliases, vars, functions;
+} rc_stats;
+
+// =================================================================
+// == 写快照：一个简单的可增长字节缓冲区
+// =================================================================
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} outbuf_t;
+
+static void put_bytes(outbuf_t* b, const void* p, size_t n) {
+    if (b->len + n > b->cap) {
+        while (b->len + n > b->cap) b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = (char*)realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_u32(outbuf_t* b, unsigned int v) {
+    put_bytes(b, &v, sizeof(v));
+}
+
+static void put_u8(outbuf_t* b, int v) {
+    unsigned char c = (unsigned char)v;
+    put_bytes(b, &c, 1);
+}
+
+// 字符串带长度和结尾的 '\0'，读取时可以直接使用映射内存中的指针
+static void put_str(outbuf_t* b, const char* s) {
+    if (s == NULL) {
+        put_u32(b, NULL_STRING);
+        return;
+    }
+    unsigned int len = strlen(s);
+    put_u32(b, len);
+    put_bytes(b, s, len + 1);
+}
+
+// 以 NULL 结尾的字符串数组；present 为 0 表示数组本身是 NULL
+static void put_strlist(outbuf_t* b, char** list) {
+    if (list == NULL) {
+        put_u32(b, NULL_STRING);
+        return;
+    }
+    unsigned int n = 0;
+    while (list[n] != NULL) n++;
+    put_u32(b, n);
+    for (unsigned int i = 0; i < n; i++) put_str(b, list[i]);
+}
+
+static void put_node(outbuf_t* b, node_t* node);
+
+static void put_command(outbuf_t* b, command_t* cmd) {
+    put_strlist(b, cmd->args);
+    put_str(b, cmd->input_file);
+    put_str(b, cmd->output_file);
+    put_u8(b, cmd->append_output);
+    for (output_target_t* t = cmd->more_outputs; t != NULL; t = t->next) {
+        put_u8(b, 1);
+        put_str(b, t->file);
+        put_u8(b, t->append);
+    }
+    put_u8(b, 0);
+    put_u8(b, cmd->is_background);
+    put_u8(b, cmd->meter_output);
+    put_strlist(b, cmd->assigns);
+    put_node(b, cmd->compound);
+    for (proc_subst_t* ps = cmd->substs; ps != NULL; ps = ps->next) {
+        put_u8(b, 1);
+        put_u8(b, ps->is_output);
+        put_node(b, ps->body);
+    }
+    put_u8(b, 0);
+}
+
+static void put_node(outbuf_t* b, node_t* node) {
+    if (node == NULL) {
+        put_u8(b, 0);
+        return;
+    }
+    put_u8(b, 1);
+    put_u8(b, node->type);
+    put_u8(b, node->is_background);
+    put_u8(b, node->timed);
+    put_str(b, node->name);
+    put_strlist(b, node->words);
+    put_node(b, node->left);
+    put_node(b, node->right);
+    put_node(b, node->else_part);
+    put_u32(b, node->cmd_count);
+    for (int i = 0; i < node->cmd_count; i++) put_command(b, &node->cmds[i]);
+
+    unsigned int items = 0;
+    for (case_item_t* it = node->items; it != NULL; it = it->next) items++;
+    put_u32(b, items);
+    for (case_item_t* it = node->items; it != NULL; it = it->next) {
+        put_strlist(b, it->patterns);
+        put_node(b, it->body);
+    }
+}
+
+// =================================================================
+// == 读快照：从 mmap 的内存中解码，所有读取都做越界检查
+// =================================================================
+
+typedef struct {
+    const char* data;
+    size_t len;
+    size_t pos;
+    int error;
+} inbuf_t;
+
+static const void* get_bytes(inbuf_t* b, size_t n) {
+    if (b->error || b->len - b->pos < n) {
+        b->error = 1;
+        return NULL;
+    }
+    const void* p = b->data + b->pos;
+    b->pos += n;
+    return p;
+}
+
+static unsigned int get_u32(inbuf_t* b) {
+    unsigned int v = 0;
+    const void* p = get_bytes(b, sizeof(v));
+    if (p) memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int get_u8(inbuf_t* b) {
+    const unsigned char* p = (const unsigned char*)get_bytes(b, 1);
+    return p ? *p : 0;
+}
+
+// 返回指向映射内存的指针（不复制）
+static const char* get_str(inbuf_t* b) {
+    unsigned int len = get_u32(b);
+    if (len == NULL_STRING || b->error) return NULL;
+    const char* s = (const char*)get_bytes(b, (size_t)len + 1);
+    if (s == NULL || s[len] != '\0') {
+        b->error = 1;
+        return NULL;
+    }
+    return s;
+}
+
+static char* dup_str(inbuf_t* b) {
+    const char* s = get_str(b);
+    return s ? strdup(s) : NULL;
+}
+
+static char** get_strlist(inbuf_t* b, int max) {
+    unsigned int n = get_u32(b);
+    if (n == NULL_STRING || b->error) return NULL;
+    if (max > 0 && n >= (unsigned int)max) {
+        b->error = 1;
+        return NULL;
+    }
+    if (n > b->len) { // 明显损坏
+        b->error = 1;
+        return NULL;
+    }
+    char** list = (char**)calloc(n + 1, sizeof(char*));
+    for (unsigned int i = 0; i < n; i++) list[i] = dup_str(b);
+    return list;
+}
+
+static node_t* get_node(inbuf_t* b, int depth);
+
+static void get_command(inbuf_t* b, command_t* cmd, int depth) {
+    memset(cmd, 0, sizeof(command_t));
+    char** args = get_strlist(b, MAX_ARGS);
+    if (args != NULL) {
+        for (int i = 0; args[i] != NULL; i++) cmd->args[i] = args[i];
+        free(args);
+    }
+    cmd->input_file = dup_str(b);
+    cmd->output_file = dup_str(b);
+    cmd->append_output = get_u8(b);
+    output_target_t** tail = &cmd->more_outputs;
+    while (!b->error && get_u8(b) == 1) {
+        output_target_t* t = (output_target_t*)calloc(1, sizeof(output_target_t));
+        t->file = dup_str(b);
+        t->append = get_u8(b);
+        *tail = t;
+        tail = &t->next;
+    }
+    cmd->is_background = get_u8(b);
+    cmd->meter_output = get_u8(b);
+    cmd->assigns = get_strlist(b, 0);
+    cmd->compound = get_node(b, depth + 1);
+    proc_subst_t** subst_tail = &cmd->substs;
+    while (!b->error && get_u8(b) == 1) {
+        proc_subst_t* ps = (proc_subst_t*)calloc(1, sizeof(proc_subst_t));
+        ps->is_output = get_u8(b);
+        ps->body = get_node(b, depth + 1);
+        *subst_tail = ps;
+        subst_tail = &ps->next;
+    }
+}
+
+static node_t* get_node(inbuf_t* b, int depth) {
+    if (depth > 1000) b->error = 1; // 防止损坏的文件导致无限递归
+    if (b->error || get_u8(b) == 0) return NULL;
+
+    node_t* node = (node_t*)calloc(1, sizeof(node_t));
+    node->refcount = 1;
+    node->type = (node_type_t)get_u8(b);
+    node->is_background = get_u8(b);
+    node->timed = get_u8(b);
+    if (node->type > NODE_ARITH_FOR) b->error = 1;
+    node->name = dup_str(b);
+    node->words = get_strlist(b, 0);
+    node->left = get_node(b, depth + 1);
+    node->right = get_node(b, depth + 1);
+    node->else_part = get_node(b, depth + 1);
+
+    unsigned int count = get_u32(b);
+    if (count >= 0x10000) b->error = 1; // 损坏或截断的快照：整个丢弃，重新解析 rc 文件
+    if (count > 0 && !b->error) {
+        node->cmds = (command_t*)calloc(count, sizeof(command_t));
+        node->cmd_count = count;
+        for (unsigned int i = 0; i < count; i++) get_command(b, &node->cmds[i], depth);
+    }
+
+    unsigned int items = get_u32(b);
+    case_item_t** tail = &node->items;
+    for (unsigned int i = 0; i < items && !b->error; i++) {
+        case_item_t* item = (case_item_t*)calloc(1, sizeof(case_item_t));
+        item->patterns = get_strlist(b, 0);
+        item->body = get_node(b, depth + 1);
+        *tail = item;
+        tail = &item->next;
+    }
+    return node;
+}
+
+// =================================================================
+// == 快照文件的读写
+// =================================================================
+
+static char* snapshot_path(const char* rc_path) {
+    size_t len = strlen(rc_path) + 6;
+    char* path = (char*)malloc(len);
+    snprintf(path, len, "%s.snap", rc_path);
+    return path;
+}
+
+// 文件头：用来判断快照是否对应当前的 rc 文件
+static void put_header(outbuf_t* b, const struct stat* st) {
+    put_u32(b, SNAP_MAGIC);
+    put_u32(b, SNAP_VERSION);
+    unsigned long long fields[5] = {
+        (unsigned long long)st->st_dev, (unsigned long long)st->st_ino,
+        (unsigned long long)st->st_size, (unsigned long long)st->st_mtim.tv_sec,
+        (unsigned long long)st->st_mtim.tv_nsec
+    };
+    put_bytes(b, fields, sizeof(fields));
+}
+
+static void put_var(const char* name, const char* value, int exported, void* ctx) {
+    outbuf_t* b = (outbuf_t*)ctx;
+    put_u8(b, 1);
+    put_str(b, name);
+    put_str(b, value);
+    put_u8(b, exported);
+}
+
+static void put_function(const char* name, node_t* body, void* ctx) {
+    outbuf_t* b = (outbuf_t*)ctx;
+    put_u8(b, 1);
+    put_str(b, name);
+    put_node(b, body);
+}
+
+/**
+ * @description: 把当前的别名、变量和函数写入快照（先写临时文件再 rename，保证原子性）
+ */
+static void write_snapshot(const char* rc_path, const struct stat* st,
+                           char** dep_names, char** dep_values, int dep_count) {
+    outbuf_t b = {0};
+    put_header(&b, st);
+
+    // 依赖的环境变量
+    put_u32(&b, dep_count);
+    for (int i = 0; i < dep_count; i++) {
+        put_str(&b, dep_names[i]);
+        put_str(&b, dep_values[i]);
+    }
+
+    // 别名表（链表是头插的，倒序写出，恢复时就是原来的顺序）
+    int alias_count = 0;
+    for (const Alias* a = get_alias_list(); a != NULL; a = a->next) alias_count++;
+    const Alias** aliases = (const Alias**)malloc(sizeof(Alias*) * (alias_count + 1));
+    int n = 0;
+    for (const Alias* a = get_alias_list(); a != NULL; a = a->next) aliases[n++] = a;
+    put_u32(&b, alias_count);
+    for (int i = alias_count - 1; i >= 0; i--) {
+        put_str(&b, aliases[i]->name);
+        put_str(&b, aliases[i]->command);
+    }
+    free(aliases);
+
+    for_each_var(put_var, &b);
+    put_u8(&b, 0);
+    for_each_function(put_function, &b);
+    put_u8(&b, 0);
+
+    char* path = snapshot_path(rc_path);
+    size_t tmp_len = strlen(path) + 32;
+    char* tmp = (char*)malloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.%d.tmp", path, (int)getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        ssize_t written = write(fd, b.data, b.len);
+        close(fd);
+        if (written == (ssize_t)b.len && rename(tmp, path) == 0) {
+            rc_stats.snapshot_written = 1;
+        } else {
+            unlink(tmp);
+        }
+    }
+    free(tmp);
+    free(path);
+    free(b.data);
+}
+
+typedef struct {
+    const char* name;
+    const char* value;
+    int exported;
+} snap_var_t;
+
+typedef struct {
+    const char* name;
+    node_t* body;
+} snap_func_t;
+
+/**
+ * @description: 尝试从快照恢复状态
+ * @return {int} - 快照有效并已恢复返回 0，否则返回 -1（状态不受影响）
+ */
+static int load_snapshot(const char* rc_path, const struct stat* st) {
+    char* path = snapshot_path(rc_path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) return -1;
+
+    struct stat snap_st;
+    if (fstat(fd, &snap_st) < 0 || snap_st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, snap_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    inbuf_t b = {(const char*)map, (size_t)snap_st.st_size, 0, 0};
+    int ok = 0;
+    snap_var_t* vars = NULL;
+    snap_func_t* funcs = NULL;
+    int var_count = 0, func_count = 0;
+    unsigned int alias_count = 0;
+    size_t alias_pos = 0;
+
+    // 1. 文件头必须和当前 rc 文件一致
+    outbuf_t expect = {0};
+    put_header(&expect, st);
+    const void* header = get_bytes(&b, expect.len);
+    int header_ok = header && memcmp(header, expect.data, expect.len) == 0;
+    free(expect.data);
+    if (!header_ok) goto done;
+
+    // 2. rc 读过的环境变量没有变化
+    unsigned int deps = get_u32(&b);
+    for (unsigned int i = 0; i < deps && !b.error; i++) {
+        const char* name = get_str(&b);
+        const char* value = get_str(&b);
+        if (b.error || name == NULL) goto done;
+        const char* now = getenv(name);
+        if ((now == NULL) != (value == NULL) || (now && strcmp(now, value) != 0)) goto done;
+    }
+
+    // 3. 先完整解码，全部成功后才修改 Shell 状态
+    alias_count = get_u32(&b);
+    alias_pos = b.pos;
+    for (unsigned int i = 0; i < alias_count && !b.error; i++) {
+        get_str(&b);
+        get_str(&b);
+    }
+    while (!b.error && get_u8(&b) == 1) {
+        vars = (snap_var_t*)realloc(vars, sizeof(snap_var_t) * (var_count + 1));
+        vars[var_count].name = get_str(&b);
+        vars[var_count].value = get_str(&b);
+        vars[var_count].exported = get_u8(&b);
+        if (vars[var_count].name == NULL || vars[var_count].value == NULL) b.error = 1;
+        var_count++;
+    }
+    while (!b.error && get_u8(&b) == 1) {
+        funcs = (snap_func_t*)realloc(funcs, sizeof(snap_func_t) * (func_count + 1));
+        funcs[func_count].name = get_str(&b);
+        funcs[func_count].body = get_node(&b, 0);
+        func_count++;
+        if (funcs[func_count - 1].name == NULL || funcs[func_count - 1].body == NULL) b.error = 1;
+    }
+    if (b.error) goto done;
+
+    // 4. 应用
+    b.pos = alias_pos;
+    for (unsigned int i = 0; i < alias_count; i++) {
+        const char* name = get_str(&b);
+        const char* command = get_str(&b);
+        define_alias(name, command);
+    }
+    for (int i = 0; i < var_count; i++) {
+        set_var(vars[i].name, vars[i].value);
+        if (vars[i].exported) export_var(vars[i].name);
+    }
+    for (int i = 0; i < func_count; i++) {
+        define_function(funcs[i].name, funcs[i].body);
+    }
+    rc_stats.aliases = alias_count;
+    rc_stats.vars = var_count;
+    rc_stats.functions = func_count;
+    ok = 1;
+
+done:
+    // define_function 持有自己的引用，这里释放解码时的那一份
+    for (int i = 0; i < func_count; i++) free_node(funcs[i].body);
+    free(funcs);
+    free(vars);
+    munmap(map, snap_st.st_size);
+    return ok ? 0 : -1;
+}
+
+// =================================================================
+// == 对外接口
+// =================================================================
+
+static void count_var(const char* name, const char* value, int exported, void* ctx) {
+    (*(int*)ctx)++;
+}
+
+static void count_function(const char* name, node_t* body, void* ctx) {
+    (*(int*)ctx)++;
+}
+
+/**
+ * @description: 加载 ~/.myshellrc：快照有效时直接恢复，否则执行 rc 文件并尝试写快照
+ */
+void load_rc_file() {
+    const char* home = getenv("HOME");
+    if (home == NULL) return;
+
+    char rc_path[1024];
+    snprintf(rc_path, sizeof(rc_path), "%s/.myshellrc", home);
+    struct stat st;
+    if (stat(rc_path, &st) < 0 || !S_ISREG(st.st_mode)) return;
+    rc_stats.rc_found = 1;
+
+    if (load_snapshot(rc_path, &st) == 0) {
+        rc_stats.snapshot_hit = 1;
+        return;
+    }
+
+    FILE* fp = fopen(rc_path, "r");
+    if (fp == NULL) return;
+    char* src = (char*)malloc(st.st_size + 1);
+    size_t len = fread(src, 1, st.st_size, fp);
+    src[len] = '\0';
+    fclose(fp);
+
+    int effects_before = side_effect_count;
+    start_var_tracking();
+    execute_string(src);
+    char** dep_names;
+    char** dep_values;
+    int dep_count = stop_var_tracking(&dep_names, &dep_values);
+    free(src);
+
+    for (const Alias* a = get_alias_list(); a != NULL; a = a->next) rc_stats.aliases++;
+    for_each_var(count_var, &rc_stats.vars);
+    for_each_function(count_function, &rc_stats.functions);
+
+    // rc 文件只改变了 Shell 内部状态时，才能用快照代替它
+    if (side_effect_count == effects_before) {
+        write_snapshot(rc_path, &st, dep_names, dep_values, dep_count);
+    }
+
+    for (int i = 0; i < dep_count; i++) {
+        free(dep_names[i]);
+        free(dep_values[i]);
+    }
+    free(dep_names);
+    free(dep_values);
+}
+
+/**
+ * @description: 打印启动统计（myshell --startup-stats）
+ * @param {double} elapsed_ms - 从进入 main 到显示第一个提示符的时间（毫秒）
+ */
+void print_startup_stats(double elapsed_ms) {
+    const char* source = !rc_stats.rc_found ? "no rc file"
+                       : rc_stats.snapshot_hit ? "snapshot"
+                       : rc_stats.snapshot_written ? "rc file (snapshot written)"
+                       : "rc file (not snapshotable)";
+    fprintf(stderr, "startup: %.3f ms to first prompt, config from %s: %d aliases, %d variables, %d functions\n",
+            elapsed_ms, source, rc_stats.aliases, rc_stats.vars, rc_stats.functions);
+}
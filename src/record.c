@@ -0,0 +1,116 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-09-02 10:18:47
+ * @FilePath: /linux-shell/src/record.c
+ * @Descripttion: 会话录制模块-myshell --record 文件，把交互模式下的每一行输入连同时间戳和各阶段耗时写入文件
+ */
+
+// 录制文件是文本格式，每条记录一行，字段用制表符分隔:
+//   # myshell session record v1 <开始时间 (Unix 秒)>
+//   L <时间> <等待> <提示符> <补全> <解析> <执行> <退出码> <输入行>    逐行输入（包括续行）
+//   P <时间> <等待> <提示符> <补全> <解析> <执行> <退出码> <粘贴内容>  一次多行粘贴
+//   C <时间> <补全> <光标前的内容>                                    一次 Tab 补全
+// <时间> 是距开始录制的毫秒数，其余耗时都是微秒:
+//   等待   显示提示符到这一行输入完成（用户输入的时间，回放时不比较）
+//   提示符 生成并显示上一个提示符
+//   补全   输入这一行期间所有 Tab 补全的合计
+//   解析   历史展开、别名展开和语法分析
+//   执行   执行命令，包括 fork/exec 和等待前台命令结束
+// 输入内容中的 \ 、制表符、换行和回车写成 \\ \t \n \r。
+// 回放和比较由 replay/replay.sh 完成。
+
+#include "shell.h"
+#include <time.h>
+
+static FILE* record_fp = NULL;
+static double record_start;                  // 开始录制的时刻（毫秒）
+static double phase_begin[RECORD_PHASES];    // 正在计时的阶段从什么时候开始
+static double phase_total[RECORD_PHASES];    // 当前这一行各阶段的累计耗时
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @description: 打开录制文件（追加写入），此后交互模式的每一行输入都会记录下来
+ * @param {const char*} path - 录制文件路径
+ * @return {int} - 成功返回 0，打不开文件返回 -1
+ */
+int record_open(const char* path) {
+    // "e": O_CLOEXEC，子进程不会继承录制文件
+    record_fp = fopen(path, "ae");
+    if (record_fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    record_start = now_ms();
+    fprintf(record_fp, "# myshell session record v1 %ld\n", (long)time(NULL));
+    fflush(record_fp);
+    return 0;
+}
+
+int record_enabled() {
+    return record_fp != NULL;
+}
+
+void record_begin(record_phase_t phase) {
+    if (record_fp != NULL) phase_begin[phase] = now_ms();
+}
+
+void record_end(record_phase_t phase) {
+    if (record_fp != NULL) phase_total[phase] += now_ms() - phase_begin[phase];
+}
+
+// 写出转义后的输入内容
+static void write_text(const char* text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        switch (text[i]) {
+            case '\\': fputs("\\\\", record_fp); break;
+            case '\t': fputs("\\t", record_fp); break;
+            case '\n': fputs("\\n", record_fp); break;
+            case '\r': fputs("\\r", record_fp); break;
+            default: fputc(text[i], record_fp);
+        }
+    }
+    fputc('\n', record_fp);
+}
+
+/**
+ * @description: 结束 RECORD_COMPLETE 阶段的计时，并记录这次补全
+ * @param {const char*} line - 输入行
+ * @param {int} point - 光标位置，记录光标之前的内容
+ */
+void record_completion(const char* line, int point) {
+    if (record_fp == NULL) return;
+    double end = now_ms();
+    double us = (end - phase_begin[RECORD_COMPLETE]) * 1e3;
+    phase_total[RECORD_COMPLETE] += end - phase_begin[RECORD_COMPLETE];
+    fprintf(record_fp, "C\t%.3f\t%.1f\t", end - record_start, us);
+    write_text(line, (size_t)point);
+    fflush(record_fp);
+}
+
+/**
+ * @description: 一行输入处理完毕（执行完，或者作为续行等待下一行）后写出它的记录，并清零各阶段耗时
+ * @param {char} type - 'L' 逐行输入，'P' 粘贴
+ * @param {const char*} text - 输入内容
+ * @param {double} received - 收到这一行的时刻（record_clock 的返回值）
+ */
+void record_input(char type, const char* text, double received) {
+    if (record_fp == NULL) return;
+    fprintf(record_fp, "%c\t%.3f", type, received - record_start);
+    for (int i = 0; i < RECORD_PHASES; i++) {
+        fprintf(record_fp, "\t%.1f", phase_total[i] * 1e3);
+        phase_total[i] = 0;
+    }
+    fprintf(record_fp, "\t%d\t", last_exit_status);
+    write_text(text, strlen(text));
+    fflush(record_fp);
+}
+
+// 当前时刻（毫秒），未录制时返回 0
+double record_clock() {
+    return record_fp != NULL ? now_ms() : 0;
+}
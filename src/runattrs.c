@@ -0,0 +1,307 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-07-26 16:05:22
+ * @FilePath: /linux-shell/src/runattrs.c
+ * @Descripttion: run 前缀模块-为管道中的每个命令设置 CPU 亲和性、优先级、资源限制和管道容量
+ */
+
+// 用法:
+//   run [--cpus 0-3,6] [--nice N] [--rlimit 名称=值]... [--pipe-size 大小]
+//       [--timeout 时长] [--kill-after 时长] [--] 命令 ...
+//   timeout [-k 时长] 时长 命令 ...          （相当于 run --timeout 时长 [--kill-after 时长] --）
+//
+// 写在管道第一段的 run 对整条管道的每一段都生效；后面的某一段也可以写自己的 run，
+// 这一段就只使用它自己的设置，例如:
+//   run --cpus 0-3 -- gzip -dc big.gz | run --cpus 4-7 --nice 10 -- sort
+// 设置在子进程 fork 之后、exec 之前生效，Shell 自身不受影响。
+// --pipe-size 用 fcntl(F_SETPIPE_SZ) 调整这一段输出管道的容量。
+// --timeout 给整条管道设置时限（由 waiter.c 在等待时执行），前缀可以叠加，例如
+//   timeout 10 run --nice 5 -- make
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <ctype.h>
+#include <errno.h>
+
+#define MAX_RUN_RLIMITS 8
+
+struct spawn_attrs {
+    int has_cpus;
+    cpu_set_t cpus;
+    int has_nice;
+    int nice;               // 相对当前优先级的增量，与 nice(1) 相同
+    int rlimit_count;
+    int rlimit_resource[MAX_RUN_RLIMITS];
+    struct rlimit rlimit_value[MAX_RUN_RLIMITS];
+    int pipe_size;          // 0 表示保持默认
+    double timeout;         // 0 表示不限时
+    double kill_after;      // 超时发 SIGTERM 后再等多久发 SIGKILL，小于 0 表示默认值
+};
+
+static const struct {
+    const char* name;
+    int resource;
+} rlimit_names[] = {
+    {"as", RLIMIT_AS},
+    {"core", RLIMIT_CORE},
+    {"cpu", RLIMIT_CPU},
+    {"data", RLIMIT_DATA},
+    {"fsize", RLIMIT_FSIZE},
+    {"memlock", RLIMIT_MEMLOCK},
+    {"nofile", RLIMIT_NOFILE},
+    {"nproc", RLIMIT_NPROC},
+    {"stack", RLIMIT_STACK},
+    {NULL, 0}
+};
+
+/**
+ * @description: 解析带 K/M/G 后缀的大小，"unlimited" 表示不限制
+ * @return {int} - 成功返回 0，格式错误返回 -1
+ */
+int parse_size(const char* s, unsigned long long* out) {
+    if (strcmp(s, "unlimited") == 0) {
+        *out = RLIM_INFINITY;
+        return 0;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (end == s || errno != 0) return -1;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': value <<= 10; end++; break;
+    case 'M': value <<= 20; end++; break;
+    case 'G': value <<= 30; end++; break;
+    }
+    if (*end == 'B' || *end == 'b') end++;
+    if (*end != '\0') return -1;
+    *out = value;
+    return 0;
+}
+
+// 解析 CPU 列表，例如 "0-3,6,8-9"
+static int parse_cpu_list(const char* s, cpu_set_t* set) {
+    CPU_ZERO(set);
+    while (*s) {
+        char* end;
+        long first = strtol(s, &end, 10);
+        if (end == s || first < 0) return -1;
+        long last = first;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) return -1;
+        }
+        if (last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        s = end;
+    }
+    return 0;
+}
+
+static int parse_rlimit(const char* spec, struct spawn_attrs* attrs) {
+    const char* eq = strchr(spec, '=');
+    if (eq == NULL || attrs->rlimit_count >= MAX_RUN_RLIMITS) return -1;
+
+    for (int i = 0; rlimit_names[i].name != NULL; i++) {
+        if (strlen(rlimit_names[i].name) == (size_t)(eq - spec) &&
+            strncmp(spec, rlimit_names[i].name, eq - spec) == 0) {
+            unsigned long long value;
+            if (parse_size(eq + 1, &value) < 0) return -1;
+            int n = attrs->rlimit_count++;
+            attrs->rlimit_resource[n] = rlimit_names[i].resource;
+            attrs->rlimit_value[n].rlim_cur = value;
+            attrs->rlimit_value[n].rlim_max = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 去掉前缀：前 n 个参数释放掉，剩下的前移
+static void drop_args(command_t* cmd, int n) {
+    for (int j = 0; j < n; j++) free(cmd->args[j]);
+    int k = 0;
+    for (; cmd->args[n + k] != NULL; k++) cmd->args[k] = cmd->args[n + k];
+    cmd->args[k] = NULL;
+}
+
+static int parse_timeout_value(const char* prefix, const char* value, double* out) {
+    if (parse_duration(value, out) < 0) {
+        fprintf(stderr, "myshell: %s: invalid duration `%s'\n", prefix, value);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @description: 解析一个 run 前缀的选项，结果写入 attrs
+ * @return {int} - 成功返回 0，出错返回 -1（已打印错误）
+ */
+static int parse_run_options(command_t* cmd, struct spawn_attrs* attrs) {
+    int i = 1;
+    for (; cmd->args[i] != NULL; i++) {
+        char* opt = cmd->args[i];
+        char* value = cmd->args[i + 1];
+        if (strcmp(opt, "--") == 0) {
+            i++;
+            break;
+        }
+        if (opt[0] != '-') break;
+        if (value == NULL) {
+            fprintf(stderr, "myshell: run: %s: option requires an argument\n", opt);
+            return -1;
+        }
+
+        unsigned long long size;
+        if (strcmp(opt, "--cpus") == 0) {
+            if (parse_cpu_list(value, &attrs->cpus) < 0) {
+                fprintf(stderr, "myshell: run: invalid cpu list `%s'\n", value);
+                return -1;
+            }
+            attrs->has_cpus = 1;
+        } else if (strcmp(opt, "--nice") == 0) {
+            char* end;
+            errno = 0;
+            long nice_value = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || errno != 0 || nice_value < -20 || nice_value > 19) {
+                fprintf(stderr, "myshell: run: invalid nice value `%s' (expected -20 to 19)\n", value);
+                return -1;
+            }
+            attrs->has_nice = 1;
+            attrs->nice = (int)nice_value;
+        } else if (strcmp(opt, "--rlimit") == 0) {
+            if (parse_rlimit(value, attrs) < 0) {
+                fprintf(stderr, "myshell: run: invalid rlimit `%s'\n", value);
+                return -1;
+            }
+        } else if (strcmp(opt, "--pipe-size") == 0) {
+            if (parse_size(value, &size) < 0 || size == 0 || size > 0x7fffffff) {
+                fprintf(stderr, "myshell: run: invalid pipe size `%s'\n", value);
+                return -1;
+            }
+            attrs->pipe_size = (int)size;
+        } else if (strcmp(opt, "--timeout") == 0) {
+            if (parse_timeout_value("run", value, &attrs->timeout) < 0) return -1;
+        } else if (strcmp(opt, "--kill-after") == 0) {
+            if (parse_timeout_value("run", value, &attrs->kill_after) < 0) return -1;
+        } else {
+            fprintf(stderr, "myshell: run: %s: invalid option\n", opt);
+            return -1;
+        }
+        i++;
+    }
+
+    if (cmd->args[i] == NULL) {
+        fprintf(stderr, "myshell: run: usage: " RUN_USAGE "\n");
+        return -1;
+    }
+    drop_args(cmd, i);
+    return 0;
+}
+
+/**
+ * @description: 解析一个 timeout 前缀: timeout [-k 时长] 时长 命令
+ * @return {int} - 成功返回 0，出错返回 -1（已打印错误）
+ */
+static int parse_timeout_options(command_t* cmd, struct spawn_attrs* attrs) {
+    int i = 1;
+    if (cmd->args[i] != NULL && (strcmp(cmd->args[i], "-k") == 0 || strcmp(cmd->args[i], "--kill-after") == 0)) {
+        if (cmd->args[i + 1] == NULL) goto usage;
+        if (parse_timeout_value("timeout", cmd->args[i + 1], &attrs->kill_after) < 0) return -1;
+        i += 2;
+    }
+    if (cmd->args[i] != NULL && strcmp(cmd->args[i], "--") == 0) i++;
+    if (cmd->args[i] == NULL || cmd->args[i + 1] == NULL) goto usage;
+    if (parse_timeout_value("timeout", cmd->args[i], &attrs->timeout) < 0) return -1;
+    drop_args(cmd, i + 1);
+    return 0;
+
+usage:
+    fprintf(stderr, "myshell: timeout: usage: timeout [-k DURATION] DURATION command\n");
+    return -1;
+}
+
+/**
+ * @description: 如果命令以 run 或 timeout 开头，解析它的选项，并把前缀从参数中去掉。
+ * 前缀可以叠加，设置合并到同一个 spawn_attrs 中
+ * @param {command_t*} cmd - 展开后的命令（会被原地修改）
+ * @return {int} - 没有前缀返回 0，解析成功返回 1，出错返回 -1（已打印错误）
+ */
+int parse_run_prefix(command_t* cmd) {
+    int found = 0;
+    while (cmd->args[0] != NULL) {
+        int is_run = strcmp(cmd->args[0], "run") == 0;
+        if (!is_run && strcmp(cmd->args[0], "timeout") != 0) break;
+
+        if (cmd->attrs == NULL) {
+            // 交给 cmd 持有，出错时由 free_expanded_command 释放
+            cmd->attrs = (struct spawn_attrs*)calloc(1, sizeof(struct spawn_attrs));
+            cmd->attrs->kill_after = -1;
+        }
+        int rc = is_run ? parse_run_options(cmd, cmd->attrs) : parse_timeout_options(cmd, cmd->attrs);
+        if (rc < 0) return -1;
+        found = 1;
+    }
+    return found;
+}
+
+/**
+ * @description: 取出 run --timeout / timeout 前缀设置的时限
+ * @return {int} - 设置了时限返回 1，否则返回 0
+ */
+int spawn_timeout(const struct spawn_attrs* attrs, timeout_t* out) {
+    if (attrs == NULL || attrs->timeout <= 0) return 0;
+    if (out != NULL) {
+        out->seconds = attrs->timeout;
+        out->grace = attrs->kill_after >= 0 ? attrs->kill_after : TIMEOUT_KILL_GRACE;
+    }
+    return 1;
+}
+
+/**
+ * @description: 复制一份设置（管道第一段的 run 会复制给其他段）
+ */
+struct spawn_attrs* copy_spawn_attrs(const struct spawn_attrs* attrs) {
+    if (attrs == NULL) return NULL;
+    struct spawn_attrs* copy = (struct spawn_attrs*)malloc(sizeof(struct spawn_attrs));
+    memcpy(copy, attrs, sizeof(struct spawn_attrs));
+    return copy;
+}
+
+/**
+ * @description: 子进程中 exec 之前应用设置。失败只打印警告，命令照常执行
+ */
+void apply_spawn_attrs(const struct spawn_attrs* attrs) {
+    if (attrs == NULL) return;
+
+    if (attrs->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &attrs->cpus) < 0) {
+        perror("run: sched_setaffinity");
+    }
+    if (attrs->has_nice) {
+        errno = 0;
+        int prio = getpriority(PRIO_PROCESS, 0);
+        if (errno == 0 && setpriority(PRIO_PROCESS, 0, prio + attrs->nice) < 0) {
+            perror("run: setpriority");
+        }
+    }
+    for (int i = 0; i < attrs->rlimit_count; i++) {
+        if (setrlimit(attrs->rlimit_resource[i], &attrs->rlimit_value[i]) < 0) {
+            perror("run: setrlimit");
+        }
+    }
+}
+
+/**
+ * @description: 按设置调整一个管道的容量（fd 是管道的任意一端）
+ */
+void apply_pipe_size(const struct spawn_attrs* attrs, int fd) {
+#ifdef F_SETPIPE_SZ
+    if (attrs != NULL && attrs->pipe_size > 0 && fcntl(fd, F_SETPIPE_SZ, attrs->pipe_size) < 0) {
+        perror("run: F_SETPIPE_SZ");
+    }
+#endif
+}
@@ -0,0 +1,344 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-27 14:06:33
+ * @FilePath: /linux-shell/src/suggest.c
+ * @Descripttion: 命令建议模块-找不到命令时，从内建命令、别名、函数和 PATH 中找出拼写最接近的几个
+ */
+
+// 例如输入 gti，Shell 在命令结束后提示:
+//   myshell: gti: command not found
+//   myshell: did you mean: git, gio?
+//
+// PATH 中的可执行文件名建成一个按长度分组、去过重的索引，只在第一次需要时扫描目录；
+// 之后 PATH 的值或其中某个目录的 mtime（装了新命令）变了才重建。
+// 编辑距离用 Myers 的位并行算法（Hyyrö 的 Levenshtein 版本）：输入的命令名（不超过 64 个字符）
+// 的每个字符对应一个机器字中的一位，比较一个候选名只需要对它的每个字符做十几次位运算，
+// 两万个名字也只要零点几毫秒。长度相差或字符集合相差超过允许距离的候选直接跳过。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SUGGEST_MAX 3         // 最多给出几个建议
+#define SUGGEST_MAX_LEN 64    // 位并行算法一个机器字能容纳的命令名长度
+
+typedef struct {
+    char* dir;
+    struct timespec mtime;
+} path_dir_t;
+
+typedef struct {
+    char* path;          // 建索引时的 PATH
+    path_dir_t* dirs;
+    int dir_count;
+    char** names;        // 去过重的可执行文件名，按长度排列，同样长度的按字母顺序
+    int count;
+    uint64_t* sigs;      // 每个名字的字符集合签名，见 char_signature
+    int by_len[SUGGEST_MAX_LEN + 2]; // 长度为 l 的名字是 names[by_len[l]] 到 names[by_len[l + 1] - 1]
+} command_index_t;
+
+static command_index_t index_cache = {0};
+
+typedef struct {
+    const char* name;
+    int distance;
+    int shared;   // 与输入共有的字符数（按多重集合计算），字母互换的拼写错误共有全部字符
+} candidate_t;
+
+// =================================================================
+// == PATH 索引
+// =================================================================
+
+// 名字中出现过的字符（按低 6 位）组成的集合。一次插入或删除最多改变集合中的 1 位，
+// 一次替换最多改变 2 位，所以两个签名相差的位数超过 2 * 距离上限时不用再算编辑距离
+static uint64_t char_signature(const char* s) {
+    uint64_t sig = 0;
+    for (const unsigned char* c = (const unsigned char*)s; *c; c++) sig |= 1ULL << (*c & 63);
+    return sig;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int compare_lengths(const void* a, const void* b) {
+    size_t la = strlen(*(char* const*)a), lb = strlen(*(char* const*)b);
+    if (la != lb) return la < lb ? -1 : 1;
+    return compare_names(a, b);
+}
+
+static void free_index(command_index_t* idx) {
+    for (int i = 0; i < idx->count; i++) free(idx->names[i]);
+    for (int i = 0; i < idx->dir_count; i++) free(idx->dirs[i].dir);
+    free(idx->names);
+    free(idx->sigs);
+    free(idx->dirs);
+    free(idx->path);
+    memset(idx, 0, sizeof(*idx));
+}
+
+// PATH 没变、每个目录的 mtime 也没变时，索引仍然有效
+static int index_is_fresh(const command_index_t* idx, const char* path) {
+    if (idx->path == NULL || strcmp(idx->path, path) != 0) return 0;
+    for (int i = 0; i < idx->dir_count; i++) {
+        struct stat st;
+        if (stat(idx->dirs[i].dir, &st) < 0) {
+            if (idx->dirs[i].mtime.tv_sec != 0) return 0;
+        } else if (st.st_mtim.tv_sec != idx->dirs[i].mtime.tv_sec ||
+                   st.st_mtim.tv_nsec != idx->dirs[i].mtime.tv_nsec) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void add_name(command_index_t* idx, int* cap, const char* name) {
+    if (idx->count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        idx->names = (char**)realloc(idx->names, sizeof(char*) * (*cap));
+    }
+    idx->names[idx->count++] = strdup(name);
+}
+
+// 扫描 PATH 中每个目录的可执行文件
+static void build_index(command_index_t* idx, const char* path) {
+    free_index(idx);
+    idx->path = strdup(path);
+    int cap = 0;
+
+    char* copy = strdup(path);
+    char* save = NULL;
+    for (char* dir = strtok_r(copy, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save)) {
+        idx->dirs = (path_dir_t*)realloc(idx->dirs, sizeof(path_dir_t) * (idx->dir_count + 1));
+        path_dir_t* pd = &idx->dirs[idx->dir_count++];
+        pd->dir = strdup(dir);
+        memset(&pd->mtime, 0, sizeof(pd->mtime));
+
+        struct stat st;
+        DIR* d = opendir(dir);
+        if (d == NULL) continue;
+        if (fstat(dirfd(d), &st) == 0) pd->mtime = st.st_mtim;
+        struct dirent* ent;
+        while ((ent = readdir(d)) != NULL) {
+            if (ent->d_name[0] == '.' || ent->d_type == DT_DIR || strlen(ent->d_name) > SUGGEST_MAX_LEN) continue;
+            if (faccessat(dirfd(d), ent->d_name, X_OK, 0) < 0) continue;
+            add_name(idx, &cap, ent->d_name);
+        }
+        closedir(d);
+    }
+    free(copy);
+
+    qsort(idx->names, idx->count, sizeof(char*), compare_names);
+    int unique = 0;
+    for (int i = 0; i < idx->count; i++) {
+        if (unique > 0 && strcmp(idx->names[unique - 1], idx->names[i]) == 0) free(idx->names[i]);
+        else idx->names[unique++] = idx->names[i];
+    }
+    idx->count = unique;
+
+    // 按长度分组：只有长度相差不超过允许距离的名字才需要计算编辑距离
+    qsort(idx->names, idx->count, sizeof(char*), compare_lengths);
+    int next = 0;
+    for (int l = 0; l <= SUGGEST_MAX_LEN + 1; l++) {
+        while (next < idx->count && (int)strlen(idx->names[next]) < l) next++;
+        idx->by_len[l] = next;
+    }
+    idx->sigs = (uint64_t*)malloc(sizeof(uint64_t) * (idx->count > 0 ? idx->count : 1));
+    for (int i = 0; i < idx->count; i++) idx->sigs[i] = char_signature(idx->names[i]);
+}
+
+static const command_index_t* command_index() {
+    const char* path = getenv("PATH");
+    if (path == NULL) path = "";
+    if (!index_is_fresh(&index_cache, path)) build_index(&index_cache, path);
+    return &index_cache;
+}
+
+/**
+ * @description: 预先建好命令索引（交互模式启动后由定时器调用），第一次拼错命令时不用等待扫描目录
+ */
+void warm_command_index(int fd, void* ctx) {
+    (void)fd;
+    (void)ctx;
+    command_index();
+}
+
+/**
+ * @description: 按 execvp 的规则在 PATH 中查找命令
+ * @return {int} - 找到可执行文件返回 1
+ */
+static int found_in_path(const char* name) {
+    const char* path = getenv("PATH");
+    if (path == NULL) return 0;
+    char* copy = strdup(path);
+    char* save = NULL;
+    int found = 0;
+    for (char* dir = strtok_r(copy, ":", &save); dir != NULL && !found; dir = strtok_r(NULL, ":", &save)) {
+        char full[4096];
+        snprintf(full, sizeof(full), "%s/%s", dir, name);
+        found = access(full, X_OK) == 0;
+    }
+    free(copy);
+    return found;
+}
+
+// =================================================================
+// == 位并行编辑距离
+// =================================================================
+
+typedef struct {
+    uint64_t peq[256];   // peq[c] 的第 i 位为 1 表示模式串第 i 个字符是 c
+    int len;
+} pattern_t;
+
+static void compile_pattern(pattern_t* p, const char* s) {
+    memset(p->peq, 0, sizeof(p->peq));
+    p->len = (int)strlen(s);
+    for (int i = 0; i < p->len; i++) {
+        p->peq[(unsigned char)s[i]] |= 1ULL << i;
+    }
+}
+
+/**
+ * @description: 模式串与 text 的 Levenshtein 距离（Myers/Hyyrö 位并行算法）。
+ * 每处理 text 的一个字符，更新 DP 矩阵这一列的垂直差分 Pv/Mv，并跟踪最后一行的分数
+ * @param {int} limit - 距离已经超过 limit + 剩余字符数时提前放弃，返回 limit + 1
+ */
+static int edit_distance(const pattern_t* p, const char* text, int limit) {
+    if (p->len == 0) return (int)strlen(text);
+    uint64_t pv = p->len == 64 ? ~0ULL : (1ULL << p->len) - 1;
+    uint64_t mv = 0;
+    uint64_t last = 1ULL << (p->len - 1);
+    int score = p->len;
+    int remaining = (int)strlen(text);
+
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        uint64_t eq = p->peq[*c];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & last) score++;
+        else if (mh & last) score--;
+        // 第 0 行是 0,1,2,...，每一列在顶部的水平差分都是 +1
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        // 剩下的每个字符最多让分数减 1
+        if (score - --remaining > limit) return limit + 1;
+    }
+    return score;
+}
+
+// 输入越长，允许的拼写错误越多（互换两个字母算 2）
+static int distance_limit(int len) {
+    if (len <= 2) return 1;
+    if (len <= 7) return 2;
+    return 3;
+}
+
+static int shared_chars(const char* a, const char* b) {
+    int counts[256] = {0};
+    int shared = 0;
+    for (const unsigned char* c = (const unsigned char*)a; *c; c++) counts[*c]++;
+    for (const unsigned char* c = (const unsigned char*)b; *c; c++) {
+        if (counts[*c] > 0) {
+            counts[*c]--;
+            shared++;
+        }
+    }
+    return shared;
+}
+
+// 距离小的在前；同样距离时共有字符多的、首字母相同的在前，再按长度差和字母顺序
+static int better(const candidate_t* a, const candidate_t* b, const char* typed) {
+    if (a->distance != b->distance) return a->distance < b->distance;
+    if (a->shared != b->shared) return a->shared > b->shared;
+    int a_first = a->name[0] == typed[0], b_first = b->name[0] == typed[0];
+    if (a_first != b_first) return a_first;
+    int len = (int)strlen(typed);
+    int a_diff = abs((int)strlen(a->name) - len), b_diff = abs((int)strlen(b->name) - len);
+    if (a_diff != b_diff) return a_diff < b_diff;
+    return strcmp(a->name, b->name) < 0;
+}
+
+typedef struct {
+    const char* typed;
+    pattern_t pattern;
+    int limit;
+    candidate_t best[SUGGEST_MAX];
+    int count;
+} search_t;
+
+static void consider(search_t* s, const char* name) {
+    int len = (int)strlen(name);
+    if (abs(len - s->pattern.len) > s->limit || strcmp(name, s->typed) == 0) return;
+    for (int i = 0; i < s->count; i++) {
+        if (strcmp(s->best[i].name, name) == 0) return; // 别名和 PATH 中的命令同名
+    }
+    candidate_t c = {name, edit_distance(&s->pattern, name, s->limit), 0};
+    if (c.distance > s->limit) return;
+    c.shared = shared_chars(s->typed, name);
+    if (s->count == SUGGEST_MAX && !better(&c, &s->best[SUGGEST_MAX - 1], s->typed)) return;
+
+    int pos = s->count < SUGGEST_MAX ? s->count++ : SUGGEST_MAX - 1;
+    while (pos > 0 && better(&c, &s->best[pos - 1], s->typed)) {
+        s->best[pos] = s->best[pos - 1];
+        pos--;
+    }
+    s->best[pos] = c;
+}
+
+static void consider_function(const char* name, node_t* body, void* ctx) {
+    (void)body;
+    consider((search_t*)ctx, name);
+}
+
+/**
+ * @description: 找出与 typed 拼写最接近的命令名
+ * @param {const char**} out - 输出：最多 SUGGEST_MAX 个名字，按接近程度排列（在下一次调用前有效）
+ * @return {int} - 建议的个数
+ */
+int suggest_commands(const char* typed, const char** out) {
+    static search_t s;
+    int len = (int)strlen(typed);
+    if (len == 0 || len > SUGGEST_MAX_LEN) return 0;
+    s.typed = typed;
+    s.limit = distance_limit(len);
+    s.count = 0;
+    compile_pattern(&s.pattern, typed);
+
+    for (int i = 0; i < num_builtins(); i++) consider(&s, builtin_str[i]);
+    for (const Alias* a = get_alias_list(); a != NULL; a = a->next) consider(&s, a->name);
+    for_each_function(consider_function, &s);
+    const command_index_t* idx = command_index();
+    int from = len - s.limit > 0 ? len - s.limit : 0;
+    int to = len + s.limit < SUGGEST_MAX_LEN ? len + s.limit : SUGGEST_MAX_LEN;
+    uint64_t sig = char_signature(typed);
+    for (int i = idx->by_len[from]; i < idx->by_len[to + 1]; i++) {
+        if (__builtin_popcountll(sig ^ idx->sigs[i]) <= 2 * s.limit) consider(&s, idx->names[i]);
+    }
+
+    for (int i = 0; i < s.count; i++) out[i] = s.best[i].name;
+    return s.count;
+}
+
+/**
+ * @description: 前台命令以 127 退出后调用：确认命令确实不存在（而不是程序自己返回 127），
+ * 然后打印拼写建议。"command not found" 本身由执行 exec 的子进程打印
+ */
+void report_command_not_found(const char* name) {
+    if (name == NULL || strchr(name, '/') != NULL || is_builtin(name) || lookup_function(name) != NULL) return;
+    if (found_in_path(name)) return;
+
+    const char* names[SUGGEST_MAX];
+    int count = suggest_commands(name, names);
+    if (count == 0) return;
+    fprintf(stderr, "myshell: did you mean: ");
+    for (int i = 0; i < count; i++) fprintf(stderr, "%s%s", i > 0 ? ", " : "", names[i]);
+    fprintf(stderr, "?\n");
+}
@@ -0,0 +1,317 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-07-21 10:12:40
+ * @FilePath: /linux-shell/src/variables.c
+ * @Descripttion: 变量模块-Shell 变量、位置参数和函数表
+ */
+#include "shell.h"
+#include <ctype.h>
+
+// =================================================================
+// == Shell 变量
+// =================================================================
+
+// Shell 变量存放在一个简单的哈希表里；被 export 的变量同时写入环境变量，
+// 这样 fork 出来的子进程可以直接继承。查不到的变量再去环境变量里找。
+#define VAR_BUCKETS 64
+
+typedef struct Var {
+    char* name;
+    char* value;
+    int exported;
+    struct Var* next;
+} Var;
+
+static Var* var_table[VAR_BUCKETS];
+
+// 依赖记录：执行 rc 文件时记下读过哪些来自环境的变量，供启动快照判断是否过期
+static int tracking_deps = 0;
+static char** dep_names = NULL;
+static char** dep_values = NULL; // NULL 表示当时变量不存在
+static int dep_count = 0;
+
+static unsigned int hash_name(const char* name) {
+    unsigned int h = 5381;
+    while (*name) h = h * 33 + (unsigned char)*name++;
+    return h % VAR_BUCKETS;
+}
+
+static Var* find_var(const char* name) {
+    for (Var* v = var_table[hash_name(name)]; v != NULL; v = v->next) {
+        if (strcmp(v->name, name) == 0) return v;
+    }
+    return NULL;
+}
+
+/**
+ * @description: 判断 s 的前 len 个字符是否是合法的变量名
+ */
+int is_valid_name(const char* s, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_')) return 0;
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @description: 读取变量的值
+ * @return {const char*} - 变量不存在时返回 NULL
+ */
+const char* get_var(const char* name) {
+    Var* v = find_var(name);
+    if (v != NULL) return v->value;
+    const char* value = getenv(name);
+    if (tracking_deps) {
+        for (int i = 0; i < dep_count; i++) {
+            if (strcmp(dep_names[i], name) == 0) return value;
+        }
+        dep_names = (char**)realloc(dep_names, sizeof(char*) * (dep_count + 1));
+        dep_values = (char**)realloc(dep_values, sizeof(char*) * (dep_count + 1));
+        dep_names[dep_count] = strdup(name);
+        dep_values[dep_count] = value ? strdup(value) : NULL;
+        dep_count++;
+    }
+    return value;
+}
+
+/**
+ * @description: 开始/停止记录从环境变量读取的变量（见 get_var）
+ * stop_var_tracking 返回记录的个数，名字和值通过 names/values 返回，调用者负责释放
+ */
+void start_var_tracking() {
+    tracking_deps = 1;
+    dep_names = dep_values = NULL;
+    dep_count = 0;
+}
+
+int stop_var_tracking(char*** names, char*** values) {
+    tracking_deps = 0;
+    *names = dep_names;
+    *values = dep_values;
+    return dep_count;
+}
+
+/**
+ * @description: 遍历所有 Shell 变量
+ */
+void for_each_var(void (*fn)(const char* name, const char* value, int exported, void* ctx), void* ctx) {
+    for (int i = 0; i < VAR_BUCKETS; i++) {
+        for (Var* v = var_table[i]; v != NULL; v = v->next) {
+            fn(v->name, v->value, v->exported, ctx);
+        }
+    }
+}
+
+/**
+ * @description: 设置变量。已经在环境变量中的变量会同步更新环境变量
+ */
+void set_var(const char* name, const char* value) {
+    Var* v = find_var(name);
+    if (v == NULL) {
+        unsigned int h = hash_name(name);
+        v = (Var*)calloc(1, sizeof(Var));
+        v->name = strdup(name);
+        v->exported = (getenv(name) != NULL);
+        v->next = var_table[h];
+        var_table[h] = v;
+    } else {
+        free(v->value);
+    }
+    v->value = strdup(value);
+    if (v->exported) {
+        setenv(name, value, 1);
+    }
+}
+
+void unset_var(const char* name) {
+    Var** link = &var_table[hash_name(name)];
+    while (*link != NULL) {
+        Var* v = *link;
+        if (strcmp(v->name, name) == 0) {
+            *link = v->next;
+            free(v->name);
+            free(v->value);
+            free(v);
+            break;
+        }
+        link = &v->next;
+    }
+    unsetenv(name);
+}
+
+/**
+ * @description: 把变量导出到环境变量中
+ */
+void export_var(const char* name) {
+    Var* v = find_var(name);
+    if (v == NULL) {
+        // 还没有值的变量：先建一个空的，等赋值时再写入环境
+        const char* env = getenv(name);
+        set_var(name, env ? env : "");
+        v = find_var(name);
+    }
+    v->exported = 1;
+    setenv(name, v->value, 1);
+}
+
+// =================================================================
+// == 位置参数 ($0, $1 ... $#, $@)
+// =================================================================
+
+// 每次调用函数都会压入一帧新的位置参数，返回时弹出
+typedef struct ParamFrame {
+    int count;              // 参数个数（不含 $0）
+    char** params;          // params[0] 是 $1
+    struct ParamFrame* prev;
+} ParamFrame;
+
+static ParamFrame base_frame = {0, NULL, NULL};
+static ParamFrame* current_frame = &base_frame;
+static char* script_name = NULL;
+
+static void fill_frame(ParamFrame* frame, int argc, char** argv) {
+    frame->count = argc > 1 ? argc - 1 : 0;
+    frame->params = (char**)malloc(sizeof(char*) * (frame->count + 1));
+    for (int i = 0; i < frame->count; i++) {
+        frame->params[i] = strdup(argv[i + 1]);
+    }
+    frame->params[frame->count] = NULL;
+}
+
+static void clear_frame(ParamFrame* frame) {
+    for (int i = 0; i < frame->count; i++) free(frame->params[i]);
+    free(frame->params);
+    frame->params = NULL;
+    frame->count = 0;
+}
+
+/**
+ * @description: 设置 Shell 自身的位置参数，argv[0] 成为 $0
+ */
+void set_positional_params(int argc, char** argv) {
+    if (argc > 0) {
+        free(script_name);
+        script_name = strdup(argv[0]);
+    }
+    clear_frame(current_frame);
+    fill_frame(current_frame, argc, argv);
+}
+
+/**
+ * @description: 函数调用时压入新的位置参数（argv[0] 是函数名，$0 保持不变）
+ */
+void push_positional_params(int argc, char** argv) {
+    ParamFrame* frame = (ParamFrame*)calloc(1, sizeof(ParamFrame));
+    fill_frame(frame, argc, argv);
+    frame->prev = current_frame;
+    current_frame = frame;
+}
+
+void pop_positional_params() {
+    if (current_frame == &base_frame) return;
+    ParamFrame* frame = current_frame;
+    current_frame = frame->prev;
+    clear_frame(frame);
+    free(frame);
+}
+
+int get_positional_count() {
+    return current_frame->count;
+}
+
+/**
+ * @description: 取第 n 个位置参数，n 为 0 时返回 $0
+ */
+const char* get_positional(int n) {
+    if (n == 0) return script_name ? script_name : "myshell";
+    if (n < 1 || n > current_frame->count) return NULL;
+    return current_frame->params[n - 1];
+}
+
+/**
+ * @description: 用 values 替换当前的位置参数，$0 不变。values（以 NULL 结尾）和其中的字符串归位置参数所有
+ */
+void adopt_positional_params(char** values, int count) {
+    clear_frame(current_frame);
+    current_frame->params = values;
+    current_frame->count = count;
+}
+
+/**
+ * @description: shift 内建命令的实现：丢弃前 n 个位置参数
+ * @return {int} - 成功返回 0，n 超过参数个数时返回 -1
+ */
+int shift_positional_params(int n) {
+    ParamFrame* frame = current_frame;
+    if (n < 0 || n > frame->count) return -1;
+    for (int i = 0; i < n; i++) free(frame->params[i]);
+    memmove(frame->params, frame->params + n, sizeof(char*) * (frame->count - n + 1));
+    frame->count -= n;
+    return 0;
+}
+
+// =================================================================
+// == 函数表
+// =================================================================
+
+// 函数体是解析好的语法树，定义时增加引用计数，执行时直接遍历，不再重新解析
+typedef struct Function {
+    char* name;
+    node_t* body;
+    struct Function* next;
+} Function;
+
+static Function* function_list_head = NULL;
+
+void define_function(const char* name, node_t* body) {
+    body->refcount++;
+    for (Function* f = function_list_head; f != NULL; f = f->next) {
+        if (strcmp(f->name, name) == 0) {
+            free_node(f->body);
+            f->body = body;
+            return;
+        }
+    }
+    Function* f = (Function*)malloc(sizeof(Function));
+    f->name = strdup(name);
+    f->body = body;
+    f->next = function_list_head;
+    function_list_head = f;
+}
+
+node_t* lookup_function(const char* name) {
+    for (Function* f = function_list_head; f != NULL; f = f->next) {
+        if (strcmp(f->name, name) == 0) return f->body;
+    }
+    return NULL;
+}
+
+/**
+ * @description: 遍历所有函数定义
+ */
+void for_each_function(void (*fn)(const char* name, node_t* body, void* ctx), void* ctx) {
+    for (Function* f = function_list_head; f != NULL; f = f->next) {
+        fn(f->name, f->body, ctx);
+    }
+}
+
+/**
+ * @description: 删除一个函数定义
+ * @return {int} - 找到并删除返回 1，否则返回 0
+ */
+int remove_function(const char* name) {
+    Function** link = &function_list_head;
+    while (*link != NULL) {
+        Function* f = *link;
+        if (strcmp(f->name, name) == 0) {
+            *link = f->next;
+            free_node(f->body);
+            free(f->name);
+            free(f);
+            return 1;
+        }
+        link = &f->next;
+    }
+    return 0;
+}
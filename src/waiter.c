@@ -0,0 +1,283 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-18 10:12:36
+ * @FilePath: /linux-shell/src/waiter.c
+ * @Descripttion: 等待模块-用 pidfd 和 epoll 同时等待一条命令或管道的所有子进程，支持超时
+ */
+
+// 每个 fork 出来的子进程打开一个 pidfd 放进 epoll，哪一段先结束就先回收哪一段，
+// 不再按顺序一个个 waitpid。命令有时限时（timeout 前缀、run --timeout 或 TMOUT_CMD），
+// epoll_wait 带上截止时间：到期后给整个进程组发 SIGTERM，宽限期过后还没结束就发 SIGKILL，
+// 并报告是哪一段超时。
+//
+// 等待期间屏蔽 SIGINT/SIGQUIT：Ctrl+C 只结束前台命令，Shell 自己不会被杀死。
+// 内核不支持 pidfd 时退回到 waitpid(WNOHANG) 轮询。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <termios.h>
+#include <time.h>
+
+#define POLL_INTERVAL_MS 10    // 没有 pidfd 时的轮询间隔
+#define MAX_EVENTS 16
+
+int wait_got_sigint = 0; // 最近一次 wait_children 等待期间 Shell 自己也收到了 SIGINT
+
+static int epoll_fd = -1;
+static pid_t epoll_owner = 0; // 创建 epoll 的进程；fork 出来的子 Shell 要用自己的 epoll
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @description: 解析时长，例如 10、1.5s、500ms、2m、1h（不带单位时是秒）
+ * @return {int} - 成功返回 0，格式错误返回 -1
+ */
+int parse_duration(const char* s, double* out) {
+    char* end;
+    errno = 0;
+    double value = strtod(s, &end);
+    if (end == s || errno != 0 || value < 0) return -1;
+    if (strcmp(end, "ms") == 0) value /= 1000;
+    else if (strcmp(end, "m") == 0) value *= 60;
+    else if (strcmp(end, "h") == 0) value *= 3600;
+    else if (*end != '\0' && strcmp(end, "s") != 0) return -1;
+    *out = value;
+    return 0;
+}
+
+/**
+ * @description: 读取 TMOUT_CMD 设置的默认时限（对没有 timeout 前缀的前台命令生效）
+ * @return {int} - 设置了有效时限返回 1，否则返回 0
+ */
+int default_timeout(timeout_t* out) {
+    const char* value = get_var("TMOUT_CMD");
+    double seconds;
+    if (value == NULL || value[0] == '\0' || parse_duration(value, &seconds) < 0 || seconds <= 0) {
+        return 0;
+    }
+    if (out != NULL) {
+        out->seconds = seconds;
+        out->grace = TIMEOUT_KILL_GRACE;
+    }
+    return 1;
+}
+
+// =================================================================
+// == 终端的前台进程组
+// =================================================================
+
+// Shell 是否是终端的前台进程组（交互模式）
+int shell_owns_terminal() {
+    return isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+}
+
+/**
+ * @description: 把终端交给一个进程组。限时的命令在自己的进程组里，
+ * 需要成为前台进程组才能读终端，Ctrl+C 也才会发给它。结束后再交还给 Shell
+ */
+void set_terminal_pgrp(pid_t pgid) {
+    // 后台进程组调用 tcsetpgrp 会收到 SIGTTOU，调用期间屏蔽它
+    sigset_t mask, old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+// =================================================================
+// == 等待子进程
+// =================================================================
+
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    if (epoll_fd < 0) return -1;
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN};
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+// 给还没结束的命令发信号：有进程组时发给整组，否则逐个发
+static void signal_stages(const pid_t* pids, const int* done, int count, pid_t pgid, int sig) {
+    if (pgid > 0 && kill(-pgid, sig) == 0) return;
+    for (int i = 0; i < count; i++) {
+        if (!done[i]) kill(pids[i], sig);
+    }
+}
+
+// 报告到时还在运行的所有段（管道中卡住的未必是排在最前面的那一段）
+static void report_overrun(const char** names, const int* done, int count, double seconds) {
+    if (count == 1) {
+        fprintf(stderr, "myshell: timeout: %s ran over %gs, sending SIGTERM\n", names[0], seconds);
+        return;
+    }
+    char list[1024];
+    size_t len = 0;
+    int running = 0;
+    for (int i = 0; i < count && len < sizeof(list); i++) {
+        if (done[i]) continue;
+        len += snprintf(list + len, sizeof(list) - len, "%s%d/%d (%s)", running ? ", " : "", i + 1, count, names[i]);
+        running++;
+    }
+    fprintf(stderr, "myshell: timeout: stage%s %s ran over %gs, sending SIGTERM\n", running > 1 ? "s" : "", list,
+            seconds);
+}
+
+// 丢掉等待期间收到的 SIGINT/SIGQUIT（它们已经由终端发给了前台命令）
+static void discard_signals(const sigset_t* set) {
+    sigset_t pending;
+    struct timespec zero = {0, 0};
+    wait_got_sigint = sigpending(&pending) == 0 && sigismember(&pending, SIGINT);
+    while (sigpending(&pending) == 0 && (sigismember(&pending, SIGINT) || sigismember(&pending, SIGQUIT))) {
+        if (sigtimedwait(set, NULL, &zero) < 0) break;
+    }
+}
+
+/**
+ * @description: 等待一条命令或管道的所有子进程结束
+ * @param {const pid_t*} pids - 各段的 pid
+ * @param {const int*} via_zygote - 各段是否由孵化器启动（由孵化器回收，不计时）
+ * @param {int} count - 段数
+ * @param {int*} statuses - 输出：各段 waitpid 格式的状态
+ * @param {const timeout_t*} limit - 时限，NULL 表示不限时
+ * @param {pid_t} pgid - 这些命令所在的进程组，超时后整组结束；0 表示逐个发信号
+ * @param {const char**} names - 各段的命令名，用于超时报告
+ * @return {int} - 超时时还在运行的第一段的下标（所有还在运行的段都已报告），没有超时返回 -1
+ */
+int wait_children(const pid_t* pids, const int* via_zygote, int count, int* statuses,
+                  const timeout_t* limit, pid_t pgid, const char** names) {
+    int pidfds[count];
+    int done[count];
+    int running = 0, polled = 0;
+
+    sigset_t block, old_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGQUIT);
+    sigprocmask(SIG_BLOCK, &block, &old_mask);
+
+    if (epoll_owner != getpid()) {
+        if (epoll_fd >= 0) close(epoll_fd);
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_owner = getpid();
+    }
+
+    for (int i = 0; i < count; i++) {
+        statuses[i] = 0;
+        pidfds[i] = -1;
+        done[i] = via_zygote[i];
+        if (done[i]) continue;
+        pidfds[i] = open_pidfd(pids[i]);
+        if (pidfds[i] < 0) polled++;
+        running++;
+    }
+
+    double deadline = (limit != NULL && limit->seconds > 0) ? now_seconds() + limit->seconds : 0;
+    int phase = 0; // 0: 未超时  1: 已发 SIGTERM  2: 已发 SIGKILL
+    int overrun = -1;
+
+    while (running > 0) {
+        // 没有 pidfd 的子进程只能轮询
+        for (int i = 0; i < count && polled > 0; i++) {
+            if (!done[i] && pidfds[i] < 0 && waitpid(pids[i], &statuses[i], WNOHANG) != 0) {
+                done[i] = 1;
+                running--;
+                polled--;
+            }
+        }
+        if (running == 0) break;
+
+        int timeout_ms = -1;
+        if (deadline > 0) {
+            double left = deadline - now_seconds();
+            timeout_ms = left > 0 ? (int)(left * 1000) + 1 : 0;
+        }
+        if (polled > 0 && (timeout_ms < 0 || timeout_ms > POLL_INTERVAL_MS)) {
+            timeout_ms = POLL_INTERVAL_MS;
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_fd >= 0 ? epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms) : 0;
+        if (epoll_fd < 0 && timeout_ms != 0) {
+            struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+        if (n < 0 && errno != EINTR) break;
+
+        for (int e = 0; e < n; e++) {
+            for (int i = 0; i < count; i++) {
+                if (pidfds[i] != events[e].data.fd) continue;
+                waitpid(pids[i], &statuses[i], 0);
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfds[i], NULL);
+                close(pidfds[i]);
+                pidfds[i] = -1;
+                done[i] = 1;
+                running--;
+                break;
+            }
+        }
+
+        if (running == 0 || deadline == 0 || now_seconds() < deadline) continue;
+        if (phase == 0) {
+            // 恰好在时限前后结束、事件还没处理的段先回收，不算超时
+            for (int i = 0; i < count; i++) {
+                if (done[i] || waitpid(pids[i], &statuses[i], WNOHANG) != pids[i]) continue;
+                if (pidfds[i] >= 0) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfds[i], NULL);
+                    close(pidfds[i]);
+                    pidfds[i] = -1;
+                } else {
+                    polled--;
+                }
+                done[i] = 1;
+                running--;
+            }
+            if (running == 0) break;
+            for (overrun = 0; done[overrun]; overrun++) {}
+            report_overrun(names, done, count, limit->seconds);
+            signal_stages(pids, done, count, pgid, SIGTERM);
+            phase = 1;
+            deadline = limit->grace > 0 ? now_seconds() + limit->grace : 0;
+            if (deadline == 0) phase = 2;
+        } else {
+            fprintf(stderr, "myshell: timeout: still running after %gs grace, sending SIGKILL\n", limit->grace);
+            signal_stages(pids, done, count, pgid, SIGKILL);
+            phase = 2;
+            deadline = 0;
+        }
+    }
+
+    // 出错退出循环时不留下打开的 pidfd
+    for (int i = 0; i < count; i++) {
+        if (pidfds[i] >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfds[i], NULL);
+            close(pidfds[i]);
+            waitpid(pids[i], &statuses[i], 0);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (via_zygote[i]) statuses[i] = zygote_wait(pids[i]);
+    }
+
+    discard_signals(&block);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    return overrun;
+}
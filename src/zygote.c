@@ -0,0 +1,409 @@
+/*
+ * @Author: Yuzhe Guo
+ * @Date: 2025-08-02 11:26:37
+ * @FilePath: /linux-shell/src/zygote.c
+ * @Descripttion: 孵化器模块-预先 fork 出的小进程，代替 Shell 创建外部命令进程
+ */
+
+// myshell --zygote 启动时，在 main 的最开始（还没有加载 rc、历史记录等状态）fork 出一个
+// 孵化器进程 (zygote)。它的内存映射很小，从它 fork 比从越来越“胖”的交互 Shell fork 更快。
+//
+// Shell 和孵化器之间用一对 SOCK_SEQPACKET 的 Unix 套接字通信：
+//   请求 SPAWN:   id、argv、envp，以及通过 SCM_RIGHTS 传递的 stdin/stdout/stderr 和当前目录 fd
+//   回复 STARTED: id、子进程 pid（失败时 pid 为 -errno）
+//   回复 EXITED:  pid、waitpid 状态、子进程的 rusage
+// 孵化器用 signalfd 接收 SIGCHLD，并用 wait4 回收子进程。Shell 退出后套接字关闭，孵化器随之退出。
+//
+// 只有普通外部命令走孵化器；内建命令、函数、复合命令和带 run 前缀的命令仍然直接 fork。
+// 设置 SPAWN_BACKEND=fork 可以临时切回 fork。
+
+#define _GNU_SOURCE
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+
+#define ZYGOTE_MSG_MAX (128 * 1024)
+#define ZYGOTE_FDS 4            // stdin, stdout, stderr, 当前目录
+#define ZYGOTE_STASH_MAX 256    // 暂存的、还没人等待的退出消息个数上限
+
+enum { MSG_SPAWN = 1, MSG_STARTED, MSG_EXITED };
+
+typedef struct {
+    int type;
+    int id;
+    int pid;
+    int status;
+    int argc;
+    int envc;
+    struct timeval utime;
+    struct timeval stime;
+} zygote_msg_t;
+
+static int zygote_fd = -1;
+static int next_request_id = 1;
+
+// 孵化器报告的子进程 CPU 时间总和，供 time 统计（这些进程不是 Shell 的子进程）
+static struct timeval children_utime;
+static struct timeval children_stime;
+
+// 先到达、但调用者还没开始等待的退出消息
+typedef struct ExitStash {
+    pid_t pid;
+    int status;
+    struct ExitStash* next;
+} ExitStash;
+
+static ExitStash* stash_head = NULL;
+static int stash_count = 0;
+
+// =================================================================
+// == 孵化器进程
+// =================================================================
+
+// 收一条带 fd 的消息，返回消息长度，对端关闭返回 0
+static ssize_t recv_with_fds(int sock, char* buf, size_t size, int* fds, int* nfds) {
+    char control[CMSG_SPACE(sizeof(int) * ZYGOTE_FDS)];
+    struct iovec iov = {buf, size};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+
+    *nfds = 0;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            *nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (*nfds > ZYGOTE_FDS) *nfds = ZYGOTE_FDS;
+            memcpy(fds, CMSG_DATA(c), sizeof(int) * *nfds);
+        }
+    }
+    return n;
+}
+
+// 把消息体中以 '\0' 分隔的字符串切成数组
+static char** split_strings(char** cursor, char* end, int count) {
+    char** list = (char**)malloc(sizeof(char*) * (count + 1));
+    for (int i = 0; i < count; i++) {
+        if (*cursor >= end) {
+            free(list);
+            return NULL;
+        }
+        list[i] = *cursor;
+        *cursor += strlen(*cursor) + 1;
+    }
+    list[count] = NULL;
+    return list;
+}
+
+static void handle_spawn(int sock, char* buf, ssize_t len, int* fds, int nfds) {
+    zygote_msg_t* req = (zygote_msg_t*)buf;
+    zygote_msg_t reply = {0};
+    reply.type = MSG_STARTED;
+    reply.id = req->id;
+
+    char* cursor = buf + sizeof(zygote_msg_t);
+    char* end = buf + len;
+    char** argv = split_strings(&cursor, end, req->argc);
+    char** envp = argv ? split_strings(&cursor, end, req->envc) : NULL;
+
+    if (argv == NULL || envp == NULL || nfds != ZYGOTE_FDS || req->argc == 0) {
+        reply.pid = -EINVAL;
+    } else {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // 子进程：恢复默认的信号处理，接上 Shell 传来的 fd，然后 exec
+            sigset_t empty;
+            sigemptyset(&empty);
+            sigprocmask(SIG_SETMASK, &empty, NULL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            if (fchdir(fds[3]) < 0) perror("chdir");
+            for (int i = 0; i < 3; i++) dup2(fds[i], i);
+
+            extern char** environ;
+            environ = envp; // execvp 按新环境里的 PATH 查找命令
+            execvp(argv[0], argv);
+            if (errno == ENOENT && strchr(argv[0], '/') == NULL) {
+                fprintf(stderr, "myshell: %s: command not found\n", argv[0]);
+            } else {
+                perror(argv[0]);
+            }
+            _exit(127);
+        }
+        reply.pid = (pid < 0) ? -errno : pid;
+    }
+
+    for (int i = 0; i < nfds; i++) close(fds[i]);
+    free(argv);
+    free(envp);
+    send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+static void reap_children(int sock) {
+    int status;
+    struct rusage ru;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        zygote_msg_t msg = {0};
+        msg.type = MSG_EXITED;
+        msg.pid = pid;
+        msg.status = status;
+        msg.utime = ru.ru_utime;
+        msg.stime = ru.ru_stime;
+        send(sock, &msg, sizeof(msg), MSG_NOSIGNAL);
+    }
+}
+
+static void zygote_main(int sock) {
+    // Ctrl+C 发给整个前台进程组，孵化器自己不能被它杀掉
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    char* buf = (char*)malloc(ZYGOTE_MSG_MAX);
+    struct pollfd pfds[2] = {{sock, POLLIN, 0}, {sfd, POLLIN, 0}};
+    for (;;) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) < 0 && errno == EINTR) {}
+            reap_children(sock);
+        }
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            int fds[ZYGOTE_FDS];
+            int nfds;
+            ssize_t n = recv_with_fds(sock, buf, ZYGOTE_MSG_MAX, fds, &nfds);
+            if (n <= 0) break; // Shell 已经退出
+            if ((size_t)n >= sizeof(zygote_msg_t) && ((zygote_msg_t*)buf)->type == MSG_SPAWN) {
+                handle_spawn(sock, buf, n, fds, nfds);
+            } else {
+                for (int i = 0; i < nfds; i++) close(fds[i]);
+            }
+        }
+    }
+    _exit(0);
+}
+
+// =================================================================
+// == Shell 一侧
+// =================================================================
+
+/**
+ * @description: 启动孵化器。应该在 main 的最开始调用，让孵化器的内存尽可能小
+ * @return {int} - 成功返回 0，失败返回 -1（之后照常使用 fork）
+ */
+int start_zygote() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("zygote: socketpair");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("zygote: fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    zygote_fd = sv[0];
+    return 0;
+}
+
+/**
+ * @description: 当前是否使用孵化器创建进程
+ */
+int zygote_enabled() {
+    if (zygote_fd < 0) return 0;
+    const char* backend = get_var("SPAWN_BACKEND");
+    return backend == NULL || strcmp(backend, "fork") != 0;
+}
+
+// 孵化器异常退出后关闭套接字，之后全部退回 fork
+static void zygote_lost() {
+    fprintf(stderr, "myshell: zygote exited, falling back to fork\n");
+    close(zygote_fd);
+    zygote_fd = -1;
+}
+
+static void add_time(struct timeval* total, const struct timeval* t) {
+    total->tv_sec += t->tv_sec;
+    total->tv_usec += t->tv_usec;
+    if (total->tv_usec >= 1000000) {
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
+    }
+}
+
+static void stash_exit(pid_t pid, int status) {
+    ExitStash* e = (ExitStash*)malloc(sizeof(ExitStash));
+    e->pid = pid;
+    e->status = status;
+    e->next = stash_head;
+    stash_head = e;
+    if (++stash_count > ZYGOTE_STASH_MAX) {
+        // 后台命令的退出消息没有人等待，丢掉最旧的
+        ExitStash** link = &stash_head;
+        while ((*link)->next != NULL) link = &(*link)->next;
+        free(*link);
+        *link = NULL;
+        stash_count--;
+    }
+}
+
+static int take_stashed(pid_t pid, int* status) {
+    for (ExitStash** link = &stash_head; *link != NULL; link = &(*link)->next) {
+        if ((*link)->pid == pid) {
+            ExitStash* e = *link;
+            *status = e->status;
+            *link = e->next;
+            free(e);
+            stash_count--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @description: 读取孵化器发来的一条消息；EXITED 消息会顺便累计 CPU 时间
+ * @return {int} - 成功返回 0，孵化器退出返回 -1
+ */
+static int read_message(zygote_msg_t* msg) {
+    ssize_t n;
+    while ((n = recv(zygote_fd, msg, sizeof(*msg), 0)) < 0 && errno == EINTR) {}
+    if (n != sizeof(*msg)) {
+        zygote_lost();
+        return -1;
+    }
+    if (msg->type == MSG_EXITED) {
+        add_time(&children_utime, &msg->utime);
+        add_time(&children_stime, &msg->stime);
+    }
+    return 0;
+}
+
+/**
+ * @description: 请孵化器启动一个外部命令
+ * @param {char**} argv - 参数列表
+ * @param {char**} assigns - 额外的 NAME=value 环境变量（可为 NULL）
+ * @param {int*} fds - 子进程的 stdin、stdout、stderr
+ * @return {pid_t} - 子进程 pid；孵化器不可用时返回 -1，调用者应改用 fork
+ */
+pid_t zygote_spawn(char** argv, char** assigns, int fds[3]) {
+    extern char** environ;
+    if (zygote_fd < 0) return -1;
+    invalidate_read_buffers(); // 新进程和 Shell 共享标准输入等 fd，可能读走数据
+
+    char* buf = (char*)malloc(ZYGOTE_MSG_MAX);
+    zygote_msg_t* req = (zygote_msg_t*)buf;
+    memset(req, 0, sizeof(*req));
+    req->type = MSG_SPAWN;
+    req->id = next_request_id++;
+    size_t len = sizeof(zygote_msg_t);
+
+    // 写入以 '\0' 分隔的 argv 和 envp，放不下时退回 fork
+    char** lists[3] = {argv, assigns, environ};
+    for (int l = 0; l < 3; l++) {
+        for (int i = 0; lists[l] != NULL && lists[l][i] != NULL; i++) {
+            size_t n = strlen(lists[l][i]) + 1;
+            if (len + n > ZYGOTE_MSG_MAX) {
+                free(buf);
+                return -1;
+            }
+            memcpy(buf + len, lists[l][i], n);
+            len += n;
+            if (l == 0) req->argc++;
+            else req->envc++;
+        }
+    }
+
+    int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd < 0) {
+        free(buf);
+        return -1;
+    }
+    int all_fds[ZYGOTE_FDS] = {fds[0], fds[1], fds[2], cwd_fd};
+    char control[CMSG_SPACE(sizeof(all_fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {buf, len};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(all_fds));
+    memcpy(CMSG_DATA(c), all_fds, sizeof(all_fds));
+
+    ssize_t sent;
+    while ((sent = sendmsg(zygote_fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    close(cwd_fd);
+    int id = req->id;
+    free(buf);
+    if (sent < 0) {
+        zygote_lost();
+        return -1;
+    }
+
+    // 等待 STARTED 回复；期间到达的退出消息先暂存
+    zygote_msg_t reply;
+    for (;;) {
+        if (read_message(&reply) < 0) return -1;
+        if (reply.type == MSG_STARTED && reply.id == id) break;
+        if (reply.type == MSG_EXITED) stash_exit(reply.pid, reply.status);
+    }
+    if (reply.pid < 0) {
+        errno = -reply.pid;
+        perror(argv[0]);
+        return -1;
+    }
+    return reply.pid;
+}
+
+/**
+ * @description: 等待孵化器启动的某个子进程结束
+ * @return {int} - waitpid 格式的状态；孵化器中途退出时按退出码 1 处理
+ */
+int zygote_wait(pid_t pid) {
+    int status;
+    if (take_stashed(pid, &status)) return status;
+
+    zygote_msg_t msg;
+    for (;;) {
+        if (zygote_fd < 0 || read_message(&msg) < 0) return 1 << 8;
+        if (msg.type != MSG_EXITED) continue;
+        if (msg.pid == pid) return msg.status;
+        stash_exit(msg.pid, msg.status);
+    }
+}
+
+/**
+ * @description: 孵化器启动的子进程累计使用的 CPU 时间（秒）
+ */
+void zygote_children_times(double* user, double* sys) {
+    *user = children_utime.tv_sec + children_utime.tv_usec / 1e6;
+    *sys = children_stime.tv_sec + children_stime.tv_usec / 1e6;
+}
@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# @Descripttion: 回归检查-memo 的 stdin 是管道时不能回放上一次的输出：同一条命令两次读到不同的输入，输出也要不同
+# 用法: tests/memo_stdin.sh [myshell 路径]
+
+SHELL_BIN=${1:-./myshell}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+export HOME="$TMP" # 缓存目录 ~/.cache/myshell/memo 放在临时目录
+
+out=$("$SHELL_BIN" --norc -c 'echo aaa | memo cat; echo bbb | memo cat' < /dev/null 2>&1)
+if [ "$out" != "$(printf 'aaa\nbbb')" ]; then
+    echo "FAIL: piped stdin: expected aaa, bbb; got: $out"
+    exit 1
+fi
+
+# 普通文件形式的 stdin 照常缓存：内容变了（mtime/大小变化）才重新执行
+echo one > "$TMP/in"
+out=$("$SHELL_BIN" --norc -c "memo cat < $TMP/in; memo cat < $TMP/in; memo --stats" < /dev/null 2>&1)
+if ! printf '%s\n' "$out" | grep -q "1 hits, 1 misses"; then
+    echo "FAIL: file stdin should be cached; got: $out"
+    exit 1
+fi
+echo "ok"